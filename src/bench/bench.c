@@ -1,65 +1,312 @@
+#include <apr_file_io.h>
 #include <apr_general.h>
 #include <apr_getopt.h>
+#include <apr_network_io.h>
 #include <apr_strings.h>
+#include <apr_thread_proc.h>
 #include <apr_time.h>
 
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "c4-api.h"
 #include "util/thread_sync.h"
 
 typedef void (*program_install_f)(C4Client *c);
+typedef void (*net_program_install_f)(C4Client *c, apr_pool_t *pool);
 
 static void
 usage(void)
 {
-    printf("Usage: bench [ -a | -n | -j ]\n");
+    printf("Usage: bench [ -a | -c | -d | -n | -j ]\n");
     exit(1);
 }
 
+/*
+ * The network benchmark bounces NET_NCHAINS independent chains of "ping"
+ * tuples back and forth between two C4 runtimes, NET_NHOPS times each. Many
+ * chains are in flight at once, so each fixpoint sends a batch of tuples
+ * to the other runtime. The peer runs in a child process: runtimes in the
+ * same process exchange tuples directly, bypassing the network.
+ */
+#define NET_NCHAINS     50
+#define NET_NHOPS       2000
+
+typedef struct NetBenchState
+{
+    C4ThreadSync *sync;
+    int ndone;
+    /* Signal the sync once this many tuples have arrived */
+    int nwant;
+} NetBenchState;
+
 static void
-done_table_cb(struct Tuple *tuple, struct TableDef *tbl_def,
-              bool is_delete, void *data)
+net_done_cb(struct Tuple *tuple, struct TableDef *tbl_def,
+            bool is_delete, void *data)
 {
-    C4ThreadSync *sync = (C4ThreadSync *) data;
+    NetBenchState *state = (NetBenchState *) data;
 
-    printf("%s invoked!\n", __func__);
-    thread_sync_signal(sync);
+    state->ndone++;
+    if (state->ndone == state->nwant)
+        thread_sync_signal(state->sync);
 }
 
 static void
-net_install_program(C4Client *c)
+net_install_program(C4Client *c, apr_pool_t *pool)
 {
-    c4_install_str(c, "define(ping, {@string, string, int});");
+    c4_install_str(c, "define(ping, {@addr, addr, int, int});");
     c4_install_str(c, "define(done, {int});");
-    c4_install_str(c, "ping(X, Y, C + 1) :- ping(Y, X, C), C < 100000;");
-    c4_install_str(c, "done(C) :- ping(_, _, C), C >= 100000;");
+    c4_install_str(c, apr_psprintf(pool,
+                                   "ping(Y, X, N, C + 1) :- "
+                                   "ping(X, Y, N, C), C < %d;",
+                                   NET_NHOPS));
+    c4_install_str(c, apr_psprintf(pool,
+                                   "done(N) :- ping(_, _, N, C), C >= %d;",
+                                   NET_NHOPS));
+}
+
+/*
+ * Start the peer runtime in a child process, and return its port number.
+ * The child runs until it is killed by the parent.
+ */
+static int
+net_start_peer(apr_proc_t *proc, net_program_install_f prog,
+               apr_pool_t *pool)
+{
+    apr_file_t *pipe_in;
+    apr_file_t *pipe_out;
+    apr_status_t s;
+    int port;
+
+    (void) apr_file_pipe_create(&pipe_in, &pipe_out, pool);
+    s = apr_proc_fork(proc, pool);
+    if (s == APR_INCHILD)
+    {
+        C4Client *c;
+
+        c = c4_make(pool, 0);
+        (*prog)(c, pool);
+        port = c4_get_port(c);
+        (void) apr_file_write_full(pipe_out, &port, sizeof(port), NULL);
+
+        while (true)
+            apr_sleep(apr_time_from_sec(1));
+    }
+    if (s != APR_INPARENT)
+    {
+        printf("Failed to fork network peer\n");
+        exit(1);
+    }
+
+    (void) apr_file_read_full(pipe_in, &port, sizeof(port), NULL);
+    (void) apr_file_close(pipe_in);
+    (void) apr_file_close(pipe_out);
+    return port;
 }
 
 static void
 do_net_bench(apr_pool_t *pool)
 {
-    C4Client *c1;
-    C4Client *c2;
-    C4ThreadSync *sync;
-    char *ping_fact;
+    C4Client *c;
+    NetBenchState state;
+    apr_proc_t peer;
+    int peer_port;
+    char *ping_facts;
+    apr_time_t start_time;
+    apr_time_t duration;
+    int i;
+
+    /* Fork before starting any runtime threads in this process */
+    peer_port = net_start_peer(&peer, net_install_program, pool);
+
+    c = c4_make(pool, 0);
+    net_install_program(c, pool);
+
+    state.sync = thread_sync_make(pool);
+    state.ndone = 0;
+    state.nwant = NET_NCHAINS;
+    c4_register_callback(c, "done", net_done_cb, &state);
+
+    ping_facts = "";
+    for (i = 0; i < NET_NCHAINS; i++)
+        ping_facts = apr_psprintf(pool, "%sping(\"tcp:localhost:%d\", "
+                                  "\"tcp:localhost:%d\", %d, 0);",
+                                  ping_facts, c4_get_port(c), peer_port, i);
+
+    start_time = apr_time_now();
+    c4_install_str(c, ping_facts);
+    thread_sync_wait(state.sync);
+    duration = apr_time_now() - start_time;
+
+    printf("Network: %d tuples in %" APR_TIME_T_FMT " usec (%.0f tuples/sec)\n",
+           NET_NCHAINS * NET_NHOPS, duration,
+           (NET_NCHAINS * NET_NHOPS) / ((double) duration / APR_USEC_PER_SEC));
+
+    (void) apr_proc_kill(&peer, SIGTERM);
+    (void) apr_proc_wait(&peer, NULL, NULL, APR_WAIT);
+}
+
+/*
+ * The codec check sends tuples with awkward values to a peer runtime, which
+ * echoes them back; both directions use the compact network encoding. Each
+ * address is sent both as the base address of the connection (i.e. the
+ * tuple's location specifier) and as some other address. The tuples are
+ * sent twice: once to the peer's IP address, and once to it by name (via
+ * "localhost", which makes for a separate connection), so that both kinds
+ * of base address are covered. Every tuple should come back unchanged.
+ */
+static void
+codec_install_program(C4Client *c, apr_pool_t *pool)
+{
+    c4_install_str(c, "define(echo_req, {@addr, addr, int, string, addr});");
+    c4_install_str(c, "define(echo_resp, {@addr, int, string, addr});");
+    c4_install_str(c, "echo_resp(R, I, S, A) :- echo_req(_, R, I, S, A);");
+}
+
+static int
+count_lines(const char *str)
+{
+    int n = 0;
+
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '\n')
+            n++;
+    }
 
-    c1 = c4_make(pool, 0);
-    c2 = c4_make(pool, 0);
+    return n;
+}
 
-    net_install_program(c1);
-    net_install_program(c2);
+/*
+ * Return the IPv4 address of this host, so that the peer and the runtime
+ * in this process agree on the base address of each connection.
+ */
+static char *
+get_local_ip(apr_pool_t *pool)
+{
+    char host[APRMAXHOSTLEN + 1];
+    apr_sockaddr_t *sa;
+    char *ip;
+
+    if (apr_gethostname(host, sizeof(host), pool) != APR_SUCCESS ||
+        apr_sockaddr_info_get(&sa, host, APR_INET, 0, 0, pool) != APR_SUCCESS ||
+        apr_sockaddr_ip_get(&ip, sa) != APR_SUCCESS)
+    {
+        printf("Failed to get local address\n");
+        exit(1);
+    }
 
-    sync = thread_sync_make(pool);
-    c4_register_callback(c1, "done", done_table_cb, sync);
+    return ip;
+}
 
-    ping_fact = apr_psprintf(pool, "ping(\"tcp:localhost:%d\", \"tcp:localhost:%d\", 0);",
-                             c4_get_port(c1), c4_get_port(c2));
+static char *
+make_long_str(int len, apr_pool_t *pool)
+{
+    char *str;
 
-    c4_install_str(c1, ping_fact);
-    thread_sync_wait(sync);
+    str = apr_palloc(pool, len + 1);
+    memset(str, 'x', len);
+    str[len] = '\0';
+    return str;
+}
+
+static void
+do_codec_check(apr_pool_t *pool)
+{
+    C4Client *c;
+    NetBenchState state;
+    apr_proc_t peer;
+    int peer_port;
+    char *ip;
+    char *self_addr;
+    char *peer_addr;
+    char *named_self_addr;
+    char *named_peer_addr;
+    char *bad;
+    int nsent;
+    int ngot;
+
+    peer_port = net_start_peer(&peer, codec_install_program, pool);
+
+    c = c4_make(pool, 0);
+    codec_install_program(c, pool);
+
+    ip = get_local_ip(pool);
+    self_addr = apr_psprintf(pool, "tcp:%s:%d", ip, c4_get_port(c));
+    peer_addr = apr_psprintf(pool, "tcp:%s:%d", ip, peer_port);
+    named_self_addr = apr_psprintf(pool, "tcp:localhost:%d", c4_get_port(c));
+    named_peer_addr = apr_psprintf(pool, "tcp:localhost:%d", peer_port);
+
+    c4_install_str(c, "define(echo_int, {int});");
+    c4_install_str(c, "define(echo_str, {string});");
+    c4_install_str(c, "define(echo_addr, {addr});");
+    c4_install_str(c, "define(echo_want, {int, string, addr});");
+    c4_install_str(c, "define(echo_got, {int, string, addr});");
+    c4_install_str(c, "define(echo_bad, {int, string, addr});");
+    c4_install_str(c, "define(echo_peer, {addr, addr});");
+
+    /* Varints change length at 64 and 8192, after zigzag encoding */
+    c4_install_str(c, "echo_int(0); echo_int(63); echo_int(64);");
+    c4_install_str(c, "echo_int(8191); echo_int(8192);");
+    c4_install_str(c, "echo_int(9223372036854775807);");
+    /* A string's length is a one-byte varint up to 127 */
+    c4_install_str(c, "echo_str(\"\"); echo_str(\"abc\");");
+    c4_install_str(c, apr_psprintf(pool, "echo_str(\"%s\");",
+                                   make_long_str(127, pool)));
+    c4_install_str(c, apr_psprintf(pool, "echo_str(\"%s\");",
+                                   make_long_str(128, pool)));
+    c4_install_str(c, apr_psprintf(pool, "echo_addr(\"%s\");", self_addr));
+    c4_install_str(c, apr_psprintf(pool, "echo_addr(\"%s\");", peer_addr));
+    c4_install_str(c, apr_psprintf(pool, "echo_addr(\"%s\");",
+                                   named_self_addr));
+    c4_install_str(c, apr_psprintf(pool, "echo_addr(\"%s\");",
+                                   named_peer_addr));
+    c4_install_str(c, "echo_addr(\"tcp:10.1.2.3:4\");");
+    c4_install_str(c, "echo_addr(\"tcp:some.host.invalid:10001\");");
+
+    /* Negative ints include -I - 1 for I = INT64_MAX, i.e. INT64_MIN */
+    c4_install_str(c, "echo_want(I, S, A) :- "
+                   "echo_int(I), echo_str(S), echo_addr(A);");
+    c4_install_str(c, "echo_want(-I, S, A) :- "
+                   "echo_int(I), echo_str(S), echo_addr(A);");
+    c4_install_str(c, "echo_want(-I - 1, S, A) :- "
+                   "echo_int(I), echo_str(S), echo_addr(A);");
+    c4_install_str(c, "echo_got(I, S, A) :- echo_resp(_, I, S, A);");
+    c4_install_str(c, "echo_bad(I, S, A) :- "
+                   "echo_got(I, S, A), notin echo_want(I, S, A);");
+
+    state.sync = thread_sync_make(pool);
+    state.ndone = 0;
+    nsent = count_lines(c4_dump_table(c, "echo_want"));
+    /* Responses to the two peer addresses differ in their loc spec */
+    state.nwant = 2 * nsent;
+    c4_register_callback(c, "echo_resp", net_done_cb, &state);
+
+    c4_install_str(c, "echo_req(P, R, I, S, A) :- "
+                   "echo_peer(P, R), echo_want(I, S, A);");
+    c4_install_str(c, apr_psprintf(pool, "echo_peer(\"%s\", \"%s\");",
+                                   peer_addr, self_addr));
+    c4_install_str(c, apr_psprintf(pool, "echo_peer(\"%s\", \"%s\");",
+                                   named_peer_addr, named_self_addr));
+    thread_sync_wait(state.sync);
+
+    ngot = count_lines(c4_dump_table(c, "echo_got"));
+    bad = c4_dump_table(c, "echo_bad");
+
+    (void) apr_proc_kill(&peer, SIGTERM);
+    (void) apr_proc_wait(&peer, NULL, NULL, APR_WAIT);
+
+    if (ngot != nsent || *bad != '\0')
+    {
+        printf("Codec check FAILED: sent %d tuples, got %d back; "
+               "unexpected tuples:\n%s", nsent, ngot, bad);
+        exit(1);
+    }
+
+    printf("Codec check: %d tuples round-tripped\n", nsent);
 }
 
 static void
@@ -74,6 +321,20 @@ agg_install_program(C4Client *c)
     c4_install_str(c, "c(X, count<Y>) :- b(X, Y);");
 }
 
+/*
+ * Derive many duplicate tuples, which exercises tuple hashing in the router
+ * and in table inserts. Build with -DC4_STATS=ON to have the runtime report
+ * how many tuple hash computations were avoided by the cached hash code.
+ */
+static void
+dup_install_program(C4Client *c)
+{
+    c4_install_str(c, "define(t, {int});");
+    c4_install_str(c, "define(s, {int, int});");
+    c4_install_str(c, "t(A + 1) :- t(A), A < 1000000;");
+    c4_install_str(c, "s(A % 1000, A % 7) :- t(A);");
+}
+
 static void
 perf_install_program(C4Client *c)
 {
@@ -108,6 +369,8 @@ main(int argc, const char *argv[])
     static const apr_getopt_option_t opt_option[] =
         {
             {"agg", 'a', false, "agg benchmark"},
+            {"codec", 'c', false, "network encoding round-trip check"},
+            {"dup", 'd', false, "duplicate elimination benchmark"},
             {"join", 'j', false, "join benchmark"},
             {"net", 'n', false, "network benchmark"},
             { NULL, 0, 0, NULL }
@@ -118,6 +381,8 @@ main(int argc, const char *argv[])
     const char *optarg;
     apr_status_t s;
     bool agg_bench = false;
+    bool codec_check = false;
+    bool dup_bench = false;
     bool join_bench = false;
     bool net_bench = false;
     apr_time_t start_time;
@@ -136,6 +401,14 @@ main(int argc, const char *argv[])
                 agg_bench = true;
                 break;
 
+            case 'c':
+                codec_check = true;
+                break;
+
+            case 'd':
+                dup_bench = true;
+                break;
+
             case 'j':
                 join_bench = true;
                 break;
@@ -157,10 +430,14 @@ main(int argc, const char *argv[])
 
     if (agg_bench)
         do_simple_bench(agg_install_program, pool);
+    else if (dup_bench)
+        do_simple_bench(dup_install_program, pool);
     else if (join_bench)
         do_simple_bench(join_install_program, pool);
     else if (net_bench)
         do_net_bench(pool);
+    else if (codec_check)
+        do_codec_check(pool);
     else
         do_simple_bench(perf_install_program, pool);
 
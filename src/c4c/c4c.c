@@ -0,0 +1,107 @@
+/*
+ * c4c: compile the expressions of an Overlog program to C. The output is
+ * meant to be built into a shared library and loaded with "c4i -l"; see
+ * libc4/planner/codegen.c.
+ */
+#include <apr_general.h>
+#include <apr_getopt.h>
+#include <apr_strings.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "c4-api.h"
+
+static void usage(void);
+
+int
+main(int argc, const char *argv[])
+{
+    static const apr_getopt_option_t opt_option[] =
+        {
+            { "help", 'h', false, "show help" },
+            { "output", 'o', true, "output file" },
+            { NULL, 0, 0, NULL }
+        };
+    apr_pool_t *pool;
+    apr_getopt_t *opt;
+    int optch;
+    const char *optarg;
+    apr_status_t s;
+    const char *out_path = NULL;
+    const char *src_path;
+    C4Client *c;
+    char *code;
+    FILE *out;
+
+    c4_initialize();
+
+    (void) apr_pool_create(&pool, NULL);
+    (void) apr_getopt_init(&opt, pool, argc, argv);
+
+    while ((s = apr_getopt_long(opt, opt_option,
+                                &optch, &optarg)) == APR_SUCCESS)
+    {
+        switch (optch)
+        {
+            case 'h':
+                usage();
+                break;
+
+            case 'o':
+                if (out_path != NULL)
+                    usage();
+                out_path = apr_pstrdup(pool, optarg);
+                break;
+
+            default:
+                printf("Unrecognized option: %c\n", optch);
+                usage();
+        }
+    }
+
+    if (s != APR_EOF)
+        usage();
+
+    /* We expect exactly one more argv element (input source file) */
+    if (opt->ind + 1 != argc)
+        usage();
+    src_path = argv[opt->ind];
+
+    c = c4_make(pool, 0);
+    code = c4_compile_file(c, src_path);
+    if (code == NULL)
+    {
+        printf("Failed to read file \"%s\"\n", src_path);
+        exit(1);
+    }
+
+    if (out_path == NULL)
+        out = stdout;
+    else
+    {
+        out = fopen(out_path, "w");
+        if (out == NULL)
+        {
+            printf("Failed to open output file \"%s\"\n", out_path);
+            exit(1);
+        }
+    }
+
+    fputs(code, out);
+    if (out != stdout)
+        fclose(out);
+
+    c4_destroy(c);
+    apr_pool_destroy(pool);
+    c4_terminate();
+    return 0;
+}
+
+static void
+usage(void)
+{
+    printf("Usage: c4c [ -h | -o outfile ] srcfile\n");
+    exit(1);
+}
@@ -10,10 +10,11 @@
 #include "c4-api.h"
 
 #define MAX_SOURCE_STRINGS 32
+#define MAX_INSTANCES 256
 
 static void usage(void);
 static C4Client *setup_c4(apr_pool_t *pool, apr_int16_t port,
-                          const char *srcfile);
+                          const char *lib_path, const char *srcfile);
 
 int
 main(int argc, const char *argv[])
@@ -23,6 +24,8 @@ main(int argc, const char *argv[])
             { "src-string", 's', true, "install source" },
             { "help", 'h', false, "show help" },
             { "port", 'p', true, "port number" },
+            { "instances", 'n', true, "number of C4 instances" },
+            { "library", 'l', true, "compiled expression library" },
             { NULL, 0, 0, NULL }
         };
     apr_pool_t *pool;
@@ -31,10 +34,13 @@ main(int argc, const char *argv[])
     const char *optarg;
     apr_status_t s;
     apr_int64_t port = 0;
+    apr_int64_t num_instances = 0;
+    const char *lib_path = NULL;
     char **src_strings;
     int num_strings;
     int i;
-    C4Client *c;
+    int j;
+    C4Client **c;
 
     c4_initialize();
 
@@ -61,6 +67,20 @@ main(int argc, const char *argv[])
                     usage();
                 break;
 
+            case 'n':
+                if (num_instances != 0)
+                    usage();
+                num_instances = apr_atoi64(optarg);
+                if (num_instances <= 0 || num_instances > MAX_INSTANCES)
+                    usage();
+                break;
+
+            case 'l':
+                if (lib_path != NULL)
+                    usage();
+                lib_path = apr_pstrdup(pool, optarg);
+                break;
+
             case 's':
                 if (num_strings + 1 == MAX_SOURCE_STRINGS)
                     usage();
@@ -85,10 +105,30 @@ main(int argc, const char *argv[])
     if (opt->ind + 1 != argc)
         usage();
 
-    c = setup_c4(pool, (apr_int16_t) port, argv[opt->ind]);
+    if (num_instances == 0)
+        num_instances = 1;
+    if (port != 0 && port + num_instances - 1 > APR_INT16_MAX)
+        usage();
 
-    for (i = 0; i < num_strings; i++)
-        c4_install_str(c, src_strings[i]);
+    /*
+     * Each instance runs in its own thread; instances exchange tuples
+     * in-process, so a program that partitions its data across instances
+     * via location specifiers can use multiple cores. If a port was
+     * specified, instances use consecutive ports starting from it.
+     */
+    c = apr_palloc(pool, sizeof(*c) * num_instances);
+    for (j = 0; j < num_instances; j++)
+    {
+        apr_int16_t inst_port = (port == 0) ? 0 : (apr_int16_t) (port + j);
+
+        c[j] = setup_c4(pool, inst_port, lib_path, argv[opt->ind]);
+    }
+
+    for (j = 0; j < num_instances; j++)
+    {
+        for (i = 0; i < num_strings; i++)
+            c4_install_str(c[j], src_strings[i]);
+    }
 
     while (true)
         sleep(1);
@@ -101,17 +141,24 @@ main(int argc, const char *argv[])
 static void
 usage(void)
 {
-    printf("Usage: c4i [ -h | -p port | -s srctext ] srcfile\n");
+    printf("Usage: c4i [ -h | -p port | -n instances | -l library | "
+           "-s srctext ] srcfile\n");
     exit(1);
 }
 
 static C4Client *
-setup_c4(apr_pool_t *pool, apr_int16_t port, const char *srcfile)
+setup_c4(apr_pool_t *pool, apr_int16_t port, const char *lib_path,
+         const char *srcfile)
 {
     C4Client *c;
     C4Status s;
 
     c = c4_make(pool, port);
+
+    /* Compiled expressions must be loaded before the program is installed */
+    if (lib_path != NULL)
+        c4_load_library(c, lib_path);
+
     s = c4_install_file(c, srcfile);
     if (s)
         printf("Failed to install file \"%s\": %d\n", srcfile, (int) s);
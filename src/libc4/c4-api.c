@@ -3,8 +3,10 @@
 
 #include "c4-api.h"
 #include "c4-internal.h"
+#include "net/exchange.h"
 #include "router.h"
 #include "runtime.h"
+#include "util/host_tbl.h"
 #include "util/thread_sync.h"
 
 /*
@@ -34,6 +36,9 @@ c4_initialize(void)
     apr_status_t s = apr_initialize();
     if (s != APR_SUCCESS)
         FAIL_APR(s);
+
+    exchange_initialize();
+    host_tbl_initialize();
 }
 
 void
@@ -98,28 +103,24 @@ c4_get_port(C4Client *client)
 }
 
 /*
- * Read the file at the specified filesystem path into memory, parse it, and
- * then install the resulting program into the specified C4 runtime. XXX:
+ * Read the file at the specified filesystem path into memory, allocated in
+ * the client's tmp_pool. Returns NULL if the file could not be opened. XXX:
  * We assume that the file is small enough that it can be slurped into a
  * single memory buffer without too much pain.
  */
-C4Status
-c4_install_file(C4Client *client, const char *path)
+static char *
+read_file(C4Client *client, const char *path)
 {
     apr_status_t s;
     apr_file_t *file;
     apr_finfo_t finfo;
     char *buf;
     apr_size_t file_size;
-    C4Status result;
 
     s = apr_file_open(&file, path, APR_READ | APR_BUFFERED,
                       APR_OS_DEFAULT, client->tmp_pool);
     if (s != APR_SUCCESS)
-    {
-        result = C4_ERROR;
-        goto done;
-    }
+        return NULL;
 
     /*
      * Get the file size, and allocate an appropriately-sized buffer to hold
@@ -139,9 +140,25 @@ c4_install_file(C4Client *client, const char *path)
         FAIL();
 
     buf[file_size] = '\0';
-    result = c4_install_str(client, buf);
+    return buf;
+}
+
+/*
+ * Read the file at the specified filesystem path into memory, parse it, and
+ * then install the resulting program into the specified C4 runtime.
+ */
+C4Status
+c4_install_file(C4Client *client, const char *path)
+{
+    char *buf;
+    C4Status result;
+
+    buf = read_file(client, path);
+    if (buf == NULL)
+        result = C4_ERROR;
+    else
+        result = c4_install_str(client, buf);
 
-done:
     apr_pool_clear(client->tmp_pool);
     return result;
 }
@@ -162,6 +179,56 @@ c4_install_str(C4Client *client, const char *str)
     return C4_OK;
 }
 
+/*
+ * Return C source code for the compiled expressions of the program in the
+ * specified file, or NULL if the file could not be read. The program is
+ * planned against the runtime's catalog, but not installed.
+ */
+char *
+c4_compile_file(C4Client *client, const char *path)
+{
+    char *buf;
+    char *result;
+
+    buf = read_file(client, path);
+    if (buf == NULL)
+        result = NULL;
+    else
+        result = c4_compile_str(client, buf);
+
+    apr_pool_clear(client->tmp_pool);
+    return result;
+}
+
+char *
+c4_compile_str(C4Client *client, const char *str)
+{
+    WorkItem *wi = client->wi;
+
+    wi->kind = WI_COMPILE;
+    wi->program_src = str;
+    wi->buf = sbuf_make(client->pool);
+    runtime_enqueue_work(client->runtime, wi);
+
+    return wi->buf->data;
+}
+
+/*
+ * Load a shared library of compiled expressions, which is used by programs
+ * installed subsequently.
+ */
+C4Status
+c4_load_library(C4Client *client, const char *path)
+{
+    WorkItem *wi = client->wi;
+
+    wi->kind = WI_LOAD_LIBRARY;
+    wi->lib_path = path;
+    runtime_enqueue_work(client->runtime, wi);
+
+    return C4_OK;
+}
+
 char *
 c4_dump_table(C4Client *client, const char *tbl_name)
 {
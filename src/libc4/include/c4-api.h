@@ -40,6 +40,17 @@ int c4_get_port(C4Client *c4);
 C4Status c4_install_file(C4Client *c4, const char *path);
 C4Status c4_install_str(C4Client *c4, const char *str);
 
+/*
+ * Ahead-of-time compilation. c4_compile_file() and c4_compile_str() return C
+ * source code for the expressions of a program, which can be built into a
+ * shared library and loaded into a C4 instance with c4_load_library(); the
+ * compiled expressions are used by programs installed after the library is
+ * loaded. See the c4c tool.
+ */
+char *c4_compile_file(C4Client *c4, const char *path);
+char *c4_compile_str(C4Client *c4, const char *str);
+C4Status c4_load_library(C4Client *c4, const char *path);
+
 char *c4_dump_table(C4Client *c4, const char *tbl_name);
 
 /*
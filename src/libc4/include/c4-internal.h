@@ -3,6 +3,7 @@
 
 /* Commonly-used external headers */
 #include <apr_general.h>
+#include <apr_hash.h>
 #include <apr_pools.h>
 #include <apr_strings.h>
 #include <stdbool.h>
@@ -38,15 +39,21 @@ struct C4Runtime
     /* Various C4 subsystems */
     C4Logger *log;
     struct C4Catalog *cat;
+    struct C4Exchange *exchange;
     struct C4Network *net;
     struct C4Router *router;
     struct SQLiteState *sql;
     struct C4Timer *timer;
     struct TuplePoolMgr *tpool_mgr;
+    struct InternTable *intern_tbl;
+    struct HostCache *host_cache;
 
     int port;
     Datum local_addr;
     char *base_dir;
+
+    /* Map from expression signature => loaded C4CompiledExpr */
+    apr_hash_t *compiled_exprs;
 };
 
 /* Utility macros */
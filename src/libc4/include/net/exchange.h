@@ -0,0 +1,27 @@
+#ifndef EXCHANGE_H
+#define EXCHANGE_H
+
+#include "types/catalog.h"
+#include "types/tuple.h"
+
+/*
+ * The exchange allows C4 instances that run in the same process (each on its
+ * own runtime thread) to send tuples to one another without going through
+ * the TCP stack. A common way to use multiple cores is to hash-partition the
+ * data of a program across several C4 instances in one process, using
+ * location specifiers to route tuples to the instance that owns them; the
+ * exchange makes the resulting cross-partition traffic cheap.
+ *
+ * Each instance has an inbox, which is a queue of serialized tuples
+ * protected by a mutex. Instances are found via a process-wide registry,
+ * which maps the location specifiers of each instance to its inbox.
+ */
+typedef struct C4Exchange C4Exchange;
+
+void exchange_initialize(void);
+
+C4Exchange *exchange_make(C4Runtime *c4);
+bool exchange_send(C4Exchange *xchg, Tuple *tuple, TableDef *tbl_def);
+bool exchange_drain(C4Exchange *xchg);
+
+#endif  /* EXCHANGE_H */
@@ -10,7 +10,7 @@ AstProgram *make_program(List *defines, List *timers, List *facts,
 AstDefine *make_define(const char *name, AstStorageKind storage,
                        List *schema, apr_pool_t *p);
 AstTimer *make_ast_timer(const char *name, apr_int64_t period,
-                         apr_pool_t *p);
+                         AstTimerPolicy policy, apr_pool_t *p);
 AstSchemaElt *make_schema_elt(const char *type_name, bool is_loc_spec,
                               apr_pool_t *p);
 AstRule *make_rule(const char *name, bool is_delete, bool is_network,
@@ -34,6 +34,7 @@ InsertPlan *make_insert_plan(AstTableRef *head, List *proj_list, apr_pool_t *p);
 ProjectPlan *make_project_plan(List *proj_list, apr_pool_t *p);
 ScanPlan *make_scan_plan(AstJoinClause *scan_rel, List *quals,
                          List *qual_exprs, List *proj_list,
+                         List *index_cols, List *index_exprs,
                          apr_pool_t *p);
 
 ExprOp *make_expr_op(DataType type, AstOperKind op_kind,
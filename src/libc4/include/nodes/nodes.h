@@ -30,6 +30,7 @@ typedef enum C4NodeKind
     /* Executor nodes */
     OPER_AGG,
     OPER_FILTER,
+    OPER_INDEX_SCAN,
     OPER_INSERT,
     OPER_PROJECT,
     OPER_SCAN,
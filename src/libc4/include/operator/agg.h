@@ -23,9 +23,14 @@ typedef struct AggGroupState
      * that we can release the pin when the group is removed.
      */
     Tuple *key;
+    /* The last output tuple we emitted for the group, or NULL */
     Tuple *output_tup;
     int count;
     AggStateVal *state_vals;
+    /* Has the group changed since its output was last emitted? */
+    bool dirty;
+    struct AggGroupState *next_dirty;
+    /* Free list link */
     struct AggGroupState *next;
 } AggGroupState;
 
@@ -39,9 +44,14 @@ typedef struct AggOperator
     rset_t *tuple_set;
     c4_hash_t *group_tbl;
     AggGroupState *free_groups;
+    /* Groups whose output needs to be emitted by the next agg_flush() */
+    AggGroupState *dirty_groups;
+    /* Link in the router's list of aggs that need to be flushed */
+    struct AggOperator *next_dirty_agg;
     TableDef *output_tbl;
 } AggOperator;
 
 AggOperator *agg_op_make(AggPlan *plan, OpChain *chain);
+void agg_flush(AggOperator *agg_op);
 
 #endif  /* AGG_H */
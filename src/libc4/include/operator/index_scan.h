@@ -0,0 +1,43 @@
+#ifndef INDEX_SCAN_H
+#define INDEX_SCAN_H
+
+#include "operator/operator.h"
+#include "operator/scancursor.h"
+#include "planner/planner.h"
+#include "storage/hash_index.h"
+#include "storage/ordered_index.h"
+
+/*
+ * An IndexScanOperator is a variant of the scan operator that uses an index
+ * on the scan relation, rather than examining every tuple in the relation.
+ * It is used when the planner has found quals that compare columns of the
+ * scan relation with the operator's input, and the scan relation supports
+ * indexing. Equality quals are used to probe a hash index; if there are
+ * none, range quals are used to do a bounded scan of an ordered index.
+ */
+typedef struct IndexScanOperator
+{
+    Operator op;
+    int nquals;
+    ExprState **qual_ary;
+    bool anti_scan;
+
+    /* Hash index probe: key exprs are evaluated against the input tuple */
+    HashIndex *hash_index;
+    int nkeys;
+    ExprState **key_ary;
+    Datum *key_vals;
+
+    /* Range scan: a NULL bound expr means the range is unbounded */
+    OrderedIndex *ordered_index;
+    ExprState *lower_expr;
+    bool lower_incl;
+    ExprState *upper_expr;
+    bool upper_incl;
+    ScanCursor *cursor;
+} IndexScanOperator;
+
+IndexScanOperator *index_scan_op_make(ScanPlan *plan, Operator *next_op,
+                                      OpChain *chain);
+
+#endif  /* INDEX_SCAN_H */
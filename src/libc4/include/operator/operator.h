@@ -21,10 +21,26 @@ struct OpChain
     C4Runtime *c4;
     TableDef *delta_tbl;
     AstTableRef *head;
+    TableDef *head_tbl;
     bool anti_chain;
+    /* Does the chain contain a scan of its own delta table? */
+    bool self_join;
     Operator *chain_start;
     int length;
 
+    /*
+     * Is this the op chain used to rederive the rule's head tuples after an
+     * over-deletion (see router.c)? If so, the rederive keys map columns of
+     * the delta table to the head columns that are bound to them by a
+     * variable; "rederive_index" is a hash index on those delta table
+     * columns, created on first use.
+     */
+    bool rederive;
+    int nrederive_keys;
+    int *rederive_delta_cols;
+    int *rederive_head_cols;
+    struct HashIndex *rederive_index;
+
     /*
      * In the router, a pointer to the next op chain for the same delta
      * table
@@ -34,6 +50,25 @@ struct OpChain
 
 typedef void (*op_invoke_func)(Operator *op, Tuple *t);
 
+/*
+ * Invoke the operator on a batch of input tuples. This has the same effect as
+ * invoking the operator on each tuple of the batch in turn, but avoids the
+ * per-tuple dispatch overhead. A batch contains at most OP_BATCH_SIZE
+ * tuples; the caller retains its pins on the tuples in the batch.
+ */
+typedef void (*op_invoke_batch_func)(Operator *op, Tuple **batch, int nbatch);
+
+#define OP_BATCH_SIZE 128
+
+/*
+ * Invoke the operator on an update, which replaces "old_t" with "new_t". This
+ * has the same effect as invoking the operator on a deletion of "old_t" and
+ * then an insertion of "new_t", but allows operators to pass the update down
+ * the chain as a unit. Updates are only passed down non-anti op chains.
+ */
+typedef void (*op_invoke_update_func)(Operator *op, Tuple *old_t,
+                                      Tuple *new_t);
+
 struct Operator
 {
     C4Node node;
@@ -49,6 +84,14 @@ struct Operator
     Schema *proj_schema;
 
     op_invoke_func invoke;
+    op_invoke_batch_func invoke_batch;
+    op_invoke_update_func invoke_update;
+
+    /*
+     * Output batch for this operator, which is passed to the next operator
+     * via invoke_batch. NULL if this is the last operator in the chain.
+     */
+    Tuple **batch_buf;
 };
 
 /*
@@ -60,14 +103,20 @@ typedef struct OpChainList
 {
     OpChain *head;
     int length;
+    /* Does any op chain in the list have "self_join" set? */
+    bool self_join;
 } OpChainList;
 
 /* Generic support routines for operators */
 Operator *operator_make(C4NodeKind kind, apr_size_t sz, PlanNode *plan,
                         Operator *next_op, OpChain *chain,
-                        op_invoke_func invoke_f);
+                        op_invoke_func invoke_f,
+                        op_invoke_batch_func invoke_batch_f,
+                        op_invoke_update_func invoke_update_f);
 
 Tuple *operator_do_project(Operator *op);
+void operator_flush_batch(Operator *op, int nbatch);
+void operator_invoke_delta(Operator *op, Tuple *t, bool is_delete);
 
 OpChainList *opchain_list_make(apr_pool_t *pool);
 void opchain_list_add(OpChainList *list, OpChain *op_chain);
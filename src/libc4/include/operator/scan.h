@@ -6,6 +6,23 @@
 #include "planner/planner.h"
 #include "storage/table.h"
 
+/*
+ * An element of the transient hash table that the scan operator builds over
+ * a batch of input tuples. "key" holds the values of the key exprs for the
+ * input tuple.
+ */
+typedef struct ScanBatchEntry
+{
+    Tuple *tuple;
+    Datum *key;
+    apr_uint32_t hash;
+    bool matched;
+    struct ScanBatchEntry *next;
+} ScanBatchEntry;
+
+/* Must be a power of 2 */
+#define SCAN_BATCH_NBUCKETS     (OP_BATCH_SIZE * 2)
+
 typedef struct ScanOperator
 {
     Operator op;
@@ -14,6 +31,19 @@ typedef struct ScanOperator
     AbstractTable *table;
     ScanCursor *cursor;
     bool anti_scan;
+
+    /*
+     * Equality quals between the scan relation and the input tuple: key_ary
+     * are evaluated against the input tuple, and compared with the columns
+     * key_colnos of the scan relation.
+     */
+    int nkeys;
+    int *key_colnos;
+    ExprState **key_ary;
+
+    /* Per-batch state */
+    ScanBatchEntry *batch_entries;
+    ScanBatchEntry **batch_buckets;
 } ScanOperator;
 
 ScanOperator *scan_op_make(ScanPlan *plan, Operator *next_op, OpChain *chain);
@@ -3,13 +3,21 @@
 
 #include <sqlite3.h>
 
+#include "types/datum.h"
 #include "util/rset.h"
 
+struct OrderedIndexNode;
+
 typedef struct ScanCursor
 {
     apr_pool_t *pool;
     /* Cursor over MemTable */
     rset_index_t *rset_iter;
+    /* Range scan over an OrderedIndex on a MemTable */
+    struct OrderedIndexNode *range_next;
+    Datum range_upper;
+    bool range_has_upper;
+    bool range_upper_incl;
     /* Cursor over SQLiteTable */
     sqlite3_stmt *sqlite_stmt;
 } ScanCursor;
@@ -30,11 +30,26 @@ typedef struct AstDefine
     List *schema;
 } AstDefine;
 
+/*
+ * What to do when a timer falls behind, and more than one of its periods
+ * have elapsed by the time it is polled. FIRE_ALL inserts one tuple for
+ * each elapsed period; SKIP inserts a single tuple for the most recent
+ * period; COALESCE also inserts a single tuple, which has an additional
+ * column holding the number of elapsed periods.
+ */
+typedef enum AstTimerPolicy
+{
+    AST_TIMER_FIRE_ALL,
+    AST_TIMER_SKIP,
+    AST_TIMER_COALESCE
+} AstTimerPolicy;
+
 typedef struct AstTimer
 {
     C4Node node;
     char *name;
     apr_int64_t period;         /* Timer period in milliseconds */
+    AstTimerPolicy policy;
 } AstTimer;
 
 typedef struct AstSchemaElt
@@ -123,7 +138,8 @@ typedef enum AstConstKind
     AST_CONST_CHAR,
     AST_CONST_DOUBLE,
     AST_CONST_INT,
-    AST_CONST_STRING
+    AST_CONST_STRING,
+    AST_CONST_ADDR      /* Not produced by the parser; see analyze.c */
 } AstConstKind;
 
 typedef struct AstConstExpr
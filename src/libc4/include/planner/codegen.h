@@ -0,0 +1,10 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "planner/planner.h"
+#include "util/strbuf.h"
+
+void codegen_program(ProgramPlan *plan, StrBuf *buf, apr_pool_t *pool);
+void codegen_load_library(C4Runtime *c4, const char *path);
+
+#endif  /* CODEGEN_H */
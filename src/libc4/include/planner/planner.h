@@ -4,6 +4,8 @@
 #include "parser/ast.h"
 #include "util/list.h"
 
+struct ExprNode;
+
 typedef struct PlanNode
 {
     C4Node node;
@@ -43,6 +45,27 @@ typedef struct ScanPlan
 {
     PlanNode plan;
     AstJoinClause *scan_rel;
+    /*
+     * Equality quals between a column of the scan relation and an expression
+     * that only references the operator's input. If the scan relation has a
+     * suitable index, these can be used to probe it directly: index_cols is
+     * a list of column numbers in the scan relation, and index_exprs is the
+     * corresponding list of ExprNodes that yield the key to probe for.
+     */
+    List *index_cols;
+    List *index_exprs;
+    /*
+     * Range quals on a column of the scan relation, of the form "outer_var
+     * OP expr" where OP is one of <, <=, > or >= and "expr" only references
+     * the operator's input. range_col is -1 if there are no such quals;
+     * otherwise, either of range_lower and range_upper might be NULL (which
+     * means the range is unbounded in that direction).
+     */
+    int range_col;
+    struct ExprNode *range_lower;
+    bool range_lower_incl;
+    struct ExprNode *range_upper;
+    bool range_upper_incl;
 } ScanPlan;
 
 typedef struct ProgramPlan
@@ -8,8 +8,11 @@
 
 typedef struct C4Router C4Router;
 
+struct AggOperator;
+
 C4Router *router_make(C4Runtime *c4);
 void router_main_loop(C4Router *router);
+void router_set_nstrata(C4Router *router, int nstrata);
 
 /* Public APIs */
 char *runtime_enqueue_dump_table(C4Runtime *c4, const char *tbl_name,
@@ -18,11 +21,17 @@ char *runtime_enqueue_dump_table(C4Runtime *c4, const char *tbl_name,
 /* Internal APIs: XXX: clearer naming */
 void router_insert_tuple(C4Router *router, Tuple *tuple,
                          TableDef *tbl_def, bool check_remote);
+void router_insert_derived_tuple(C4Router *router, Tuple *tuple,
+                                 TableDef *tbl_def);
 void router_delete_tuple(C4Router *router, Tuple *tuple, TableDef *tbl_def);
+void router_update_tuple(C4Router *router, Tuple *old_tuple, Tuple *new_tuple,
+                         TableDef *tbl_def, bool check_remote);
 void router_enqueue_internal(C4Router *router, Tuple *tuple, TableDef *tbl_def);
 
 OpChainList *router_get_opchain_list(C4Router *router, const char *tbl_name);
 void router_add_op_chain(C4Router *router, OpChain *op_chain);
+void router_add_dirty_agg(C4Router *router, struct AggOperator *agg_op);
 bool router_is_deleting(C4Router *router);
+void router_set_deleting(C4Router *router, bool is_deleting);
 
 #endif  /* ROUTER_H */
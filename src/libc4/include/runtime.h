@@ -15,6 +15,8 @@ C4Runtime *c4_runtime_start(int port, C4ThreadSync *thread_sync,
 typedef enum WorkItemKind
 {
     WI_PROGRAM,
+    WI_COMPILE,
+    WI_LOAD_LIBRARY,
     WI_DUMP_TABLE,
     WI_CALLBACK,
     WI_SHUTDOWN
@@ -25,11 +27,16 @@ typedef struct WorkItem
     WorkItemKind kind;
     C4ThreadSync *sync;
 
-    /* WI_PROGRAM: */
+    /* WI_PROGRAM, WI_COMPILE: */
     const char *program_src;
 
+    /* WI_LOAD_LIBRARY: */
+    const char *lib_path;
+
     /* WI_DUMP_TABLE: */
     const char *tbl_name;
+
+    /* WI_DUMP_TABLE, WI_COMPILE: */
     StrBuf *buf;
 
     /* WI_CALLBACK */
@@ -0,0 +1,49 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include "types/tuple.h"
+#include "util/hash.h"
+
+/*
+ * A HashIndex maps a set of key columns to the tuples of a MemTable that
+ * have those key values. Tuples with equal keys are kept in the same
+ * bucket, so a probe yields exactly the tuples that match the key. The
+ * index does not pin the tuples it contains: it is the responsibility of the
+ * owning table to remove a tuple from the index before releasing its pin.
+ */
+typedef struct HashIndexEntry
+{
+    Tuple *tuple;
+    struct HashIndexEntry *next;
+} HashIndexEntry;
+
+typedef struct HashIndexBucket
+{
+    /* Key values for this bucket; each Datum is pinned by the bucket */
+    Datum *key;
+    HashIndexEntry *entries;
+    struct HashIndexBucket *next_free;
+} HashIndexBucket;
+
+typedef struct HashIndex
+{
+    apr_pool_t *pool;
+    Schema *schema;
+    int ncols;
+    int *colnos;
+    /* Map from key => HashIndexBucket */
+    c4_hash_t *bucket_tbl;
+    /* Scratch space for the key of the tuple being added or removed */
+    Datum *tmp_key;
+    HashIndexBucket *free_buckets;
+    HashIndexEntry *free_entries;
+} HashIndex;
+
+HashIndex *hash_index_make(Schema *schema, int ncols, int *colnos,
+                           apr_pool_t *pool);
+bool hash_index_has_cols(HashIndex *idx, int ncols, int *colnos);
+void hash_index_add(HashIndex *idx, Tuple *t);
+void hash_index_remove(HashIndex *idx, Tuple *t);
+HashIndexEntry *hash_index_probe(HashIndex *idx, Datum *key);
+
+#endif  /* HASH_INDEX_H */
@@ -1,15 +1,23 @@
 #ifndef MEM_TABLE_H
 #define MEM_TABLE_H
 
+#include "storage/hash_index.h"
+#include "storage/ordered_index.h"
 #include "storage/table.h"
+#include "util/list.h"
 #include "util/rset.h"
 
 typedef struct MemTable
 {
     AbstractTable table;
     rset_t *tuples;
+    /* Lists of HashIndex and OrderedIndex; maintained on insert and delete */
+    List *hash_indexes;
+    List *ordered_indexes;
 } MemTable;
 
 MemTable *mem_table_make(TableDef *def, C4Runtime *c4, apr_pool_t *pool);
+HashIndex *mem_table_add_hash_index(MemTable *tbl, int ncols, int *colnos);
+OrderedIndex *mem_table_add_ordered_index(MemTable *tbl, int colno);
 
 #endif  /* MEM_TABLE_H */
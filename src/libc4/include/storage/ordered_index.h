@@ -0,0 +1,51 @@
+#ifndef ORDERED_INDEX_H
+#define ORDERED_INDEX_H
+
+#include "operator/scancursor.h"
+#include "types/tuple.h"
+#include "util/rbtree.h"
+
+/*
+ * An OrderedIndex keeps the tuples of a MemTable sorted by the value of a
+ * single column, which allows the tuples whose key falls within a range to
+ * be found without examining the entire table. Tuples with equal keys are
+ * ordered by address, so every tuple in the table has its own node in the
+ * tree. As with HashIndex, the index does not pin the tuples it contains.
+ */
+typedef struct OrderedIndexNode
+{
+    RB_ENTRY(OrderedIndexNode) entry;
+    Datum key;
+    Tuple *tuple;
+    /*
+     * Only used for search keys: -1 (+1) sorts the search key before (after)
+     * all the tuples with an equal key. Zero for nodes in the tree.
+     */
+    int bound;
+    struct OrderedIndexNode *next_free;
+} OrderedIndexNode;
+
+typedef struct OrderedIndex OrderedIndex;
+
+RB_HEAD(ordered_index_tree, OrderedIndexNode, OrderedIndex *);
+
+struct OrderedIndex
+{
+    apr_pool_t *pool;
+    Schema *schema;
+    int colno;
+    datum_cmp_func cmp_func;
+    struct ordered_index_tree tree;
+    OrderedIndexNode *free_head;
+};
+
+OrderedIndex *ordered_index_make(Schema *schema, int colno, apr_pool_t *pool);
+void ordered_index_add(OrderedIndex *idx, Tuple *t);
+void ordered_index_remove(OrderedIndex *idx, Tuple *t);
+
+void ordered_index_scan_reset(OrderedIndex *idx, ScanCursor *cur,
+                              Datum *lower, bool lower_incl,
+                              Datum *upper, bool upper_incl);
+Tuple *ordered_index_scan_next(OrderedIndex *idx, ScanCursor *cur);
+
+#endif  /* ORDERED_INDEX_H */
@@ -27,9 +27,30 @@ typedef struct TableDef
     AstStorageKind storage;
     Schema *schema;
 
+    /*
+     * Internal ID of the table, unique within this C4 instance. IDs are not
+     * reused, and are small enough to index an array.
+     */
+    int id;
+
     /* Column number of location spec, or -1 if none */
     int ls_colno;
 
+    /*
+     * The table's stratum in the rule dependency graph. Tuples are routed
+     * stratum-by-stratum: all the pending tuples in lower strata are routed
+     * before any tuples in this stratum. This is recomputed by the router
+     * thread when a program is installed; see cat_stratify().
+     */
+    int stratum;
+
+    /*
+     * Does the table depend on itself? Recursive memory tables have set
+     * semantics, and deletions from them are handled with DRed (see
+     * router.c) rather than with derivation counts.
+     */
+    bool recursive;
+
     /* List of callbacks registered for this table */
     CallbackRecord *cb;
 
@@ -61,6 +82,10 @@ bool cat_table_exists(C4Catalog *cat, const char *name);
 TableDef *cat_get_table(C4Catalog *cat, const char *name);
 struct AbstractTable *cat_get_table_impl(C4Catalog *cat, const char *name);
 
+void cat_add_dependency(C4Catalog *cat, const char *from, const char *to,
+                        bool strict);
+int cat_stratify(C4Catalog *cat);
+
 void cat_register_callback(C4Catalog *cat, const char *tbl_name,
                            C4TupleCallback callback, void *data);
 void table_invoke_callbacks(struct Tuple *tuple, TableDef *tbl, bool is_delete);
@@ -74,8 +99,10 @@ datum_hash_func type_get_hash_func(DataType type);
 datum_eq_func type_get_eq_func(DataType type);
 datum_cmp_func type_get_cmp_func(DataType type);
 datum_bin_in_func type_get_binary_in_func(DataType type);
+datum_bin_in_func type_get_compact_in_func(DataType type);
 datum_text_in_func type_get_text_in_func(DataType type);
 datum_bin_out_func type_get_binary_out_func(DataType type);
+datum_bin_out_func type_get_compact_out_func(DataType type);
 datum_text_out_func type_get_text_out_func(DataType type);
 
 #endif  /* CATALOG_H */
@@ -15,15 +15,41 @@ typedef unsigned char DataType;
 #define TYPE_DOUBLE  3
 #define TYPE_INT     4
 #define TYPE_STRING  5
+#define TYPE_ADDR    6
 
 typedef struct C4String
 {
     /* The number of bytes in "data"; we do NOT store a NUL terminator */
     apr_uint32_t len;
-    apr_uint16_t refcount;
+    /* Interned strings may be shared by many tuples */
+    apr_uint32_t refcount;
+    /* Hash code of "data"; only valid if "hash_valid" is set */
+    apr_uint32_t hash;
+    bool hash_valid;
+    /* Is this string in its runtime's intern table? (see util/intern.h) */
+    bool interned;
+    /* Is this a SlabString? If so, "data" is unused */
+    bool is_slab;
     char data[1];       /* Variable-sized */
 } C4String;
 
+/*
+ * A string whose bytes are stored elsewhere: in a slab of received data, or
+ * in a separate allocation once they are copied out of the slab (see
+ * util/recv_slab.h). Each slab keeps a list of its strings.
+ */
+typedef struct SlabString SlabString;
+
+struct SlabString
+{
+    C4String str;       /* Must be first */
+    char *data;
+    /* The slab that "data" points into, or NULL if it was copied out */
+    struct RecvSlab *slab;
+    SlabString *prev;
+    SlabString *next;
+};
+
 typedef union Datum
 {
     /* Pass-by-value types (unboxed) */
@@ -33,8 +59,123 @@ typedef union Datum
     double         d8;
     /* Pass-by-ref types (boxed) */
     C4String     *s;
+    /* Short strings, stored inline; see below */
+    char           str[sizeof(apr_int64_t)];
 } Datum;
 
+/*
+ * Strings of up to STRING_INLINE_MAX bytes are stored directly in the
+ * Datum, rather than in a separately-allocated C4String. Since a C4String
+ * is always at least 2-byte aligned, we can distinguish the two cases by
+ * the low-order bit of the pointer: for an inline string, the byte that
+ * holds that bit instead holds the tag bit and the string's length, and
+ * the string's bytes are stored in the rest of the Datum. A string is
+ * stored inline iff it is short enough, so each string value has a unique
+ * representation.
+ */
+#if APR_IS_BIGENDIAN
+#define STRING_TAG_BYTE         (sizeof(C4String *) - 1)
+#else
+#define STRING_TAG_BYTE         0
+#endif
+
+#define STRING_INLINE_OFFSET    (STRING_TAG_BYTE == 0 ? 1 : 0)
+#define STRING_INLINE_MAX       (STRING_TAG_BYTE == 0 ? \
+                                 sizeof(Datum) - 1 : STRING_TAG_BYTE)
+
+static inline bool
+string_is_inline(Datum d)
+{
+    return (((apr_uintptr_t) d.s) & 1) != 0;
+}
+
+static inline apr_size_t
+string_get_len(Datum *d)
+{
+    if (string_is_inline(*d))
+        return ((unsigned char) d->str[STRING_TAG_BYTE]) >> 1;
+
+    return d->s->len;
+}
+
+/*
+ * Note that for inline strings, the result points into the Datum itself,
+ * so it is only valid as long as the Datum is.
+ */
+static inline char *
+string_get_data(Datum *d)
+{
+    if (string_is_inline(*d))
+        return d->str + STRING_INLINE_OFFSET;
+    if (d->s->is_slab)
+        return ((SlabString *) d->s)->data;
+
+    return d->s->data;
+}
+
+/*
+ * A network address (e.g. a location specifier) is a transport protocol, a
+ * host and a port, packed into a Datum's integer representation: the
+ * protocol in bits 48-63, the host in bits 16-47 and the port in bits 0-15.
+ * Addresses can therefore be compared and hashed as ints. The host is
+ * either an IPv4 address or, for a "named" address, the ID of a host name
+ * in the process-wide host table (see util/host_tbl.h). The text format is
+ * "tcp:host:port"; a host name is kept as written, and only resolved when
+ * the address is connected to or compared with a local address (see
+ * addr_resolve()). Note that a named address is not equal to the address
+ * that its host name resolves to.
+ */
+#define ADDR_PROTO_TCP          1
+#define ADDR_PROTO_TCP_NAMED    2
+
+static inline Datum
+addr_make(apr_uint32_t ipv4, apr_uint16_t port)
+{
+    Datum result;
+
+    result.i8 = ((apr_int64_t) ADDR_PROTO_TCP << 48) |
+                ((apr_int64_t) ipv4 << 16) | port;
+    return result;
+}
+
+static inline Datum
+addr_make_named(apr_uint32_t host_id, apr_uint16_t port)
+{
+    Datum result;
+
+    result.i8 = ((apr_int64_t) ADDR_PROTO_TCP_NAMED << 48) |
+                ((apr_int64_t) host_id << 16) | port;
+    return result;
+}
+
+static inline bool
+addr_is_named(Datum d)
+{
+    return (d.i8 >> 48) == ADDR_PROTO_TCP_NAMED;
+}
+
+/* Returns the IPv4 address in host byte order; not valid if named */
+static inline apr_uint32_t
+addr_get_ipv4(Datum d)
+{
+    return (apr_uint32_t) (d.i8 >> 16);
+}
+
+/* Returns the ID of the host name; only valid if named */
+static inline apr_uint32_t
+addr_get_host_id(Datum d)
+{
+    return (apr_uint32_t) (d.i8 >> 16);
+}
+
+static inline apr_uint16_t
+addr_get_port(Datum d)
+{
+    return (apr_uint16_t) d.i8;
+}
+
+bool addr_resolve(Datum d, Datum *result);
+
 typedef bool (*datum_eq_func)(Datum d1, Datum d2);
 typedef int (*datum_cmp_func)(Datum d1, Datum d2);
 typedef apr_uint32_t (*datum_hash_func)(Datum d);
@@ -48,18 +189,21 @@ bool char_equal(Datum d1, Datum d2);
 bool double_equal(Datum d1, Datum d2);
 bool int_equal(Datum d1, Datum d2);
 bool string_equal(Datum d1, Datum d2);
+bool addr_equal(Datum d1, Datum d2);
 
 int bool_cmp(Datum d1, Datum d2);
 int char_cmp(Datum d1, Datum d2);
 int double_cmp(Datum d1, Datum d2);
 int int_cmp(Datum d1, Datum d2);
 int string_cmp(Datum d1, Datum d2);
+int addr_cmp(Datum d1, Datum d2);
 
 apr_uint32_t bool_hash(Datum d);
 apr_uint32_t char_hash(Datum d);
 apr_uint32_t double_hash(Datum d);
 apr_uint32_t int_hash(Datum d);
 apr_uint32_t string_hash(Datum d);
+apr_uint32_t addr_hash(Datum d);
 
 /* Binary input functions */
 Datum bool_from_buf(StrBuf *buf);
@@ -67,6 +211,8 @@ Datum char_from_buf(StrBuf *buf);
 Datum double_from_buf(StrBuf *buf);
 Datum int_from_buf(StrBuf *buf);
 Datum string_from_buf(StrBuf *buf);
+Datum addr_from_buf(StrBuf *buf);
+apr_size_t addr_get_buf_len(StrBuf *buf);
 
 /* Binary output functions */
 void bool_to_buf(Datum d, StrBuf *buf);
@@ -74,6 +220,16 @@ void char_to_buf(Datum d, StrBuf *buf);
 void double_to_buf(Datum d, StrBuf *buf);
 void int_to_buf(Datum d, StrBuf *buf);
 void string_to_buf(Datum d, StrBuf *buf);
+void addr_to_buf(Datum d, StrBuf *buf);
+
+/* Compact binary input and output functions, for network traffic */
+Datum int_from_buf_compact(StrBuf *buf);
+Datum string_from_buf_compact(StrBuf *buf);
+Datum addr_from_buf_compact(StrBuf *buf);
+void int_to_buf_compact(Datum d, StrBuf *buf);
+void string_to_buf_compact(Datum d, StrBuf *buf);
+void addr_to_buf_compact(Datum d, StrBuf *buf);
+void addr_set_compact_base(Datum *base);
 
 /* Text input functions */
 Datum bool_from_str(const char *str);
@@ -81,6 +237,7 @@ Datum char_from_str(const char *str);
 Datum double_from_str(const char *str);
 Datum int_from_str(const char *str);
 Datum string_from_str(const char *str);
+Datum addr_from_str(const char *str);
 
 /* Text output functions */
 void bool_to_str(Datum d, StrBuf *buf);
@@ -88,8 +245,10 @@ void char_to_str(Datum d, StrBuf *buf);
 void double_to_str(Datum d, StrBuf *buf);
 void int_to_str(Datum d, StrBuf *buf);
 void string_to_str(Datum d, StrBuf *buf);
+void addr_to_str(Datum d, StrBuf *buf);
 
 char *string_to_text(Datum d, apr_pool_t *pool);
+char *addr_to_text(Datum d, apr_pool_t *pool);
 
 bool datum_equal(Datum d1, Datum d2, DataType type);
 int datum_cmp(Datum d1, Datum d2, DataType type);
@@ -100,6 +259,6 @@ void pool_track_datum(apr_pool_t *pool, Datum datum, DataType type);
 void datum_to_str(Datum d, DataType type, StrBuf *buf);
 Datum datum_from_str(DataType type, const char *str);
 
-C4String *make_string(apr_size_t slen);
+Datum make_string(apr_size_t slen);
 
 #endif  /* DATUM_H */
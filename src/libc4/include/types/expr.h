@@ -3,25 +3,41 @@
 
 #include "parser/ast.h"
 #include "types/tuple.h"
+#include "util/strbuf.h"
 
+/*
+ * The schemas of the inner and outer tuples are needed to locate column
+ * values within the (packed) tuples. They are fixed for a given operator,
+ * and are set when the operator's op chain is installed.
+ */
 typedef struct ExprEvalContext
 {
     Tuple *inner;
     Tuple *outer;
+    Schema *inner_schema;
+    Schema *outer_schema;
 } ExprEvalContext;
 
 typedef struct ExprNode ExprNode;
 typedef struct ExprState ExprState;
+typedef struct ExprInstr ExprInstr;
 
 typedef Datum (*eval_expr_func)(ExprState *state);
 
+/*
+ * The executable form of an expression: the expression tree is compiled
+ * into a linear program of instructions over a register file (see expr.c).
+ */
 struct ExprState
 {
     ExprEvalContext *cxt;
     ExprNode *expr;
     eval_expr_func expr_func;
-    ExprState *lhs;
-    ExprState *rhs;
+    int ninstrs;
+    ExprInstr *instrs;
+    Datum *regs;
+    /* Register that holds the value of the expression */
+    Datum *result;
 };
 
 struct ExprNode
@@ -52,10 +68,24 @@ typedef struct ExprConst
     Datum value;
 } ExprConst;
 
+/*
+ * An expression that has been compiled ahead-of-time to native code (see
+ * planner/codegen.c). A shared library of compiled expressions exports a
+ * NULL-terminated array of these as "c4_compiled_exprs"; when an ExprState
+ * is made for an expression whose signature matches one of the loaded
+ * entries, the compiled function is used instead of the interpreter.
+ */
+typedef struct C4CompiledExpr
+{
+    const char *signature;
+    eval_expr_func func;
+} C4CompiledExpr;
+
 #define eval_expr(state)        ((state)->expr_func(state))
 
 ExprState *make_expr_state(ExprNode *expr, ExprEvalContext *cxt,
-                           apr_pool_t *pool);
+                           C4Runtime *c4, apr_pool_t *pool);
+void expr_get_signature(ExprNode *expr, StrBuf *buf);
 
 bool eval_qual_set(int nquals, ExprState **qual_ary);
 
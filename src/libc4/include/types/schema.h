@@ -6,6 +6,13 @@
 #include "util/list.h"
 #include "util/tuple_pool.h"
 
+struct Schema;
+struct Tuple;
+
+typedef apr_uint32_t (*tuple_hash_func)(struct Tuple *t, struct Schema *s);
+typedef bool (*tuple_eq_func)(struct Tuple *t1, struct Tuple *t2,
+                              struct Schema *s);
+
 typedef struct Schema
 {
     int len;
@@ -16,6 +23,26 @@ typedef struct Schema
     datum_text_in_func *text_in_funcs;
     datum_bin_out_func *bin_out_funcs;
     datum_text_out_func *text_out_funcs;
+    /* Binary I/O functions for the compact format used on the network */
+    datum_bin_in_func *compact_in_funcs;
+    datum_bin_out_func *compact_out_funcs;
+    /*
+     * Tuples of this schema are stored in packed form: each column value
+     * has the width of its type, rather than a full Datum. offsets[i] is the
+     * byte offset of column i within Tuple.data; data_size is the total
+     * size of the column values.
+     */
+    int *offsets;
+    apr_size_t data_size;
+    /*
+     * Whole-tuple hash and equality functions, specialized for the column
+     * types of the schema. For the generic case, eq_order gives the order
+     * in which to compare columns: pass-by-value columns come first, since
+     * they are cheaper to compare.
+     */
+    tuple_hash_func tuple_hash;
+    tuple_eq_func tuple_eq;
+    int *eq_order;
     /* Used to manage tuple allocations */
     TuplePool *tuple_pool;
 } Schema;
@@ -4,6 +4,7 @@
 #include "types/catalog.h"
 #include "types/datum.h"
 #include "types/schema.h"
+#include "util/stats.h"
 #include "util/strbuf.h"
 
 /*
@@ -13,15 +14,75 @@
  */
 typedef struct Tuple
 {
+    apr_uint16_t refcount;
     /*
-     * TODO: On LP64 machines, we have 6 bytes of padding we can use. One
-     * possible use for them is to cache the per-Tuple hash code.
+     * The tuple's hash code is computed on demand and then cached; since
+     * tuples are immutable once constructed, it never needs to be
+     * invalidated. On LP64 machines, these fields fit into what would
+     * otherwise be padding before "vals".
      */
-    apr_uint16_t refcount;
-    Datum vals[1];      /* Variable-length array */
+    bool hash_valid;
+    apr_uint32_t hash;
+    /*
+     * The column values, packed according to the tuple's schema (see
+     * Schema.offsets). Use tuple_get_val() and tuple_set_val() to access
+     * them.
+     */
+    char data[1] __attribute__ ((aligned (8)));     /* Variable-length */
 } Tuple;
 
-#define tuple_get_val(t, i)     ((t)->vals[(i)])
+static inline Datum
+tuple_get_val(Tuple *t, Schema *s, int i)
+{
+    char *ptr = t->data + s->offsets[i];
+    Datum d;
+
+    switch (schema_get_type(s, i))
+    {
+        case TYPE_BOOL:
+            d.b = *((bool *) ptr);
+            break;
+
+        case TYPE_CHAR:
+            d.c = *((unsigned char *) ptr);
+            break;
+
+        default:
+            d = *((Datum *) ptr);
+            break;
+    }
+
+    return d;
+}
+
+static inline void
+tuple_set_val(Tuple *t, Schema *s, int i, Datum d)
+{
+    char *ptr = t->data + s->offsets[i];
+
+    switch (schema_get_type(s, i))
+    {
+        case TYPE_BOOL:
+            *((bool *) ptr) = d.b;
+            break;
+
+        case TYPE_CHAR:
+            *((unsigned char *) ptr) = d.c;
+            break;
+
+        default:
+            *((Datum *) ptr) = d;
+            break;
+    }
+}
+
+/* Fetch the value of a column that is known to be an int */
+static inline apr_int64_t
+tuple_get_int(Tuple *t, Schema *s, int i)
+{
+    ASSERT(schema_get_type(s, i) == TYPE_INT);
+    return *((apr_int64_t *) (t->data + s->offsets[i]));
+}
 
 Tuple *tuple_make_empty(Schema *s);
 Tuple *tuple_make(Schema *s, Datum *values);
@@ -30,18 +91,50 @@ Tuple *tuple_make_from_strings(Schema *s, char **values);
 void tuple_pin(Tuple *tuple);
 void tuple_unpin(Tuple *tuple, Schema *s);
 
-bool tuple_equal(Tuple *t1, Tuple *t2, Schema *s);
-apr_uint32_t tuple_hash(Tuple *t, Schema *s);
 /* For use in hash tables */
 bool tuple_cmp_tbl(const void *k1, const void *k2, void *data);
 unsigned int tuple_hash_tbl(const void *key, void *data);
 
+/*
+ * Tuple equality and hashing are delegated to the functions that were
+ * specialized for the schema's column types when it was created. Note that
+ * the hash code depends only on the column types, so it is safe to cache it
+ * even though the same tuple may be hashed using different (but equal)
+ * schemas.
+ */
+static inline bool
+tuple_equal(Tuple *t1, Tuple *t2, Schema *s)
+{
+    if (t1 == t2)
+        return true;
+    if (t1->hash_valid && t2->hash_valid && t1->hash != t2->hash)
+        return false;
+
+    return (s->tuple_eq)(t1, t2, s);
+}
+
+static inline apr_uint32_t
+tuple_hash(Tuple *t, Schema *s)
+{
+    STATS_INCR(tuple_hash_calls);
+    if (!t->hash_valid)
+    {
+        STATS_INCR(tuple_hash_computed);
+        t->hash = (s->tuple_hash)(t, s);
+        t->hash_valid = true;
+    }
+
+    return t->hash;
+}
+
 bool tuple_is_remote(Tuple *tuple, TableDef *tbl_def, C4Runtime *c4);
 
 char *tuple_to_str(Tuple *tuple, Schema *s, apr_pool_t *pool);
 void tuple_to_str_buf(Tuple *tuple, Schema *s, StrBuf *buf);
 void tuple_to_buf(Tuple *tuple, Schema *s, StrBuf *buf);
 Tuple *tuple_from_buf(StrBuf *buf, Schema *s);
+void tuple_to_buf_compact(Tuple *tuple, Schema *s, StrBuf *buf);
+Tuple *tuple_from_buf_compact(StrBuf *buf, Schema *s);
 char *tuple_to_sql_insert_str(Tuple *tuple, Schema *s, apr_pool_t *pool);
 
 #endif  /* TUPLE_H */
@@ -2,5 +2,18 @@
 #define HASH_FUNC_H
 
 apr_uint32_t hash_any(register const unsigned char *k, register int keylen);
+apr_uint32_t hash_uint64(apr_uint64_t k);
+
+/*
+ * Combine two hash values, e.g. the hashes of successive columns of a tuple.
+ * Unlike XOR, this is not commutative, so (1,2) and (2,1) hash differently.
+ * This is the same mixing step used by boost::hash_combine().
+ */
+static inline apr_uint32_t
+hash_combine(apr_uint32_t a, apr_uint32_t b)
+{
+    a ^= b + 0x9e3779b9 + (a << 6) + (a >> 2);
+    return a;
+}
 
 #endif  /* HASH_FUNC_H */
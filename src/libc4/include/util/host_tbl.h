@@ -0,0 +1,28 @@
+#ifndef HOST_TBL_H
+#define HOST_TBL_H
+
+/*
+ * The process-wide table of host names that appear in addresses. An address
+ * whose host is written as a name, rather than as an IPv4 address, stores
+ * the name's ID in this table (see addr_make_named()). The name is resolved
+ * the first time its IPv4 address is needed, and the address is cached for
+ * the life of the process; if the name can't be resolved, we try again
+ * after a backoff. Since addresses are passed between C4 instances, the
+ * table is shared by all of them, and is protected by a lock; entries are
+ * never removed.
+ *
+ * Each runtime also has a HostCache of the names it has resolved, so that
+ * resolving a name on the runtime's thread doesn't usually take the lock.
+ * As with intern tables, the "current" cache is tracked per-thread.
+ */
+typedef struct HostCache HostCache;
+
+void host_tbl_initialize(void);
+apr_uint32_t host_tbl_intern(const char *name, apr_size_t len);
+const char *host_tbl_get_name(apr_uint32_t id);
+bool host_tbl_resolve(apr_uint32_t id, apr_uint32_t *ipv4);
+
+HostCache *host_cache_make(apr_pool_t *pool);
+void host_cache_set_current(HostCache *cache);
+
+#endif  /* HOST_TBL_H */
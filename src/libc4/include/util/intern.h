@@ -0,0 +1,26 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+/*
+ * An InternTable holds a single copy of each distinct (heap-allocated)
+ * string value in a C4 runtime, so that strings that are repeated across
+ * many tuples share storage, and so that two interned strings are equal iff
+ * they are the same C4String. Interned strings cache their hash code.
+ *
+ * The table does not hold a reference to its strings: a string is removed
+ * from the table when its refcount drops to zero. Each runtime runs in its
+ * own thread, so the "current" intern table is tracked per-thread; strings
+ * created by a thread without an intern table are not interned.
+ */
+typedef struct InternTable InternTable;
+
+InternTable *intern_table_make(apr_pool_t *pool);
+void intern_table_set_current(InternTable *tbl);
+InternTable *intern_table_get_current(void);
+
+C4String *intern_table_lookup(InternTable *tbl, const char *data,
+                              apr_size_t len, apr_uint32_t hash);
+void intern_table_add(InternTable *tbl, C4String *s);
+void intern_table_remove(InternTable *tbl, C4String *s);
+
+#endif  /* INTERN_H */
@@ -0,0 +1,52 @@
+#ifndef RECV_SLAB_H
+#define RECV_SLAB_H
+
+#include "types/datum.h"
+#include "util/strbuf.h"
+
+/*
+ * A RecvSlab holds raw bytes received from the network. Strings that are
+ * deserialized from the slab point directly at its bytes, rather than being
+ * copied into a separate allocation; each such string holds a reference to
+ * the slab, which is freed when its last reference is dropped.
+ *
+ * Since strings point into the slab's storage, the slab must not be
+ * reallocated once any string references it: when the owner wants to
+ * receive more data, it should first check whether the slab is shared, and
+ * if so only append to the slab's free space, or continue in a new slab.
+ *
+ * Once the owner has released a slab, a few long-lived strings could keep
+ * the whole slab alive. To bound this, when the strings that still
+ * reference a released slab cover less than 1/RECV_SLAB_MIN_LIVE_RATIO of
+ * its size, we copy them out of the slab and free it.
+ *
+ * Strings are deserialized via the datum_bin_in_func API, which doesn't
+ * say where the input buffer came from; hence the owner of a slab marks it
+ * as the thread's "current" slab while deserializing from it.
+ */
+typedef struct RecvSlab
+{
+    apr_uint32_t refcount;
+    /* Has the owner not yet released the slab? */
+    bool owned;
+    /* The strings that reference the slab, and their total length */
+    SlabString *strings;
+    apr_size_t live_bytes;
+    StrBuf buf;
+} RecvSlab;
+
+#define RECV_SLAB_MIN_LIVE_RATIO    4
+
+#define recv_slab_is_shared(slab)   ((slab)->refcount > 1)
+/* The number of bytes that can be appended without reallocating the slab */
+#define recv_slab_space_avail(slab) ((slab)->buf.max_len - (slab)->buf.len)
+
+RecvSlab *recv_slab_make(apr_size_t size);
+void recv_slab_release(RecvSlab *slab);
+void recv_slab_add_string(RecvSlab *slab, SlabString *ss);
+void recv_slab_remove_string(RecvSlab *slab, SlabString *ss);
+
+void recv_slab_set_current(RecvSlab *slab);
+RecvSlab *recv_slab_get_current(void);
+
+#endif  /* RECV_SLAB_H */
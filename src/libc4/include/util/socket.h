@@ -3,10 +3,13 @@
 
 #include <apr_network_io.h>
 
+#include "types/datum.h"
+
 void socket_set_non_block(apr_socket_t *sock);
 
 apr_sockaddr_t *socket_get_remote_addr(apr_socket_t *sock);
-char *socket_get_remote_loc(apr_socket_t *sock, apr_pool_t *pool);
+Datum socket_get_remote_loc(apr_socket_t *sock);
+apr_sockaddr_t *socket_addr_from_loc(Datum loc, apr_pool_t *pool);
 
 #endif  /* SOCKET_H */
 
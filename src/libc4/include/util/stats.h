@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Optional runtime statistics, enabled by building with -DC4_STATS=ON. Each
+ * C4 runtime runs in its own thread, so the counters are thread-local and
+ * hence per-runtime; they are logged when the runtime shuts down.
+ */
+#ifdef C4_STATS_ENABLED
+
+typedef struct C4Stats
+{
+    /* Number of calls to tuple_hash() */
+    apr_uint64_t tuple_hash_calls;
+    /* Number of those calls that had to compute the hash code */
+    apr_uint64_t tuple_hash_computed;
+    /* Socket send and receive system calls made for network traffic */
+    apr_uint64_t net_send_calls;
+    apr_uint64_t net_recv_calls;
+    /* Bytes written to network sockets */
+    apr_uint64_t net_bytes_sent;
+    /* Tuples sent to and received from remote runtimes */
+    apr_uint64_t net_tuples_sent;
+    apr_uint64_t net_tuples_recv;
+} C4Stats;
+
+extern __thread C4Stats c4_stats;
+
+#define STATS_INCR(field)       (c4_stats.field++)
+#define STATS_ADD(field, n)     (c4_stats.field += (n))
+
+#else
+
+#define STATS_INCR(field)       ((void) 0)
+#define STATS_ADD(field, n)     ((void) 0)
+
+#endif  /* C4_STATS_ENABLED */
+
+void stats_log(C4Runtime *c4);
+
+#endif  /* STATS_H */
@@ -30,9 +30,16 @@ typedef struct StrBuf
 
 #define sbuf_data_avail(sbuf)   ((sbuf)->len - (sbuf)->pos)
 
+/* The maximum length of a 64-bit integer in varint format */
+#define VARINT_MAX_LEN          10
+
+/* The maximum number of StrBufs that can be passed to sbuf_socket_sendv() */
+#define SBUF_SENDV_MAX          8
+
 StrBuf *sbuf_make(apr_pool_t *pool);
 void sbuf_reset(StrBuf *sbuf);
 void sbuf_reset_pos(StrBuf *sbuf);
+void sbuf_compact(StrBuf *sbuf);
 void sbuf_enlarge(StrBuf *sbuf, apr_size_t more_bytes);
 char *sbuf_dup(StrBuf *sbuf, apr_pool_t *pool);
 
@@ -42,15 +49,20 @@ void sbuf_appendf(StrBuf *sbuf, const char *fmt, ...)
 void sbuf_append_char(StrBuf *sbuf, char c);
 void sbuf_append_int16(StrBuf *sbuf, apr_uint16_t i);
 void sbuf_append_int32(StrBuf *sbuf, apr_uint32_t i);
+void sbuf_append_varint(StrBuf *sbuf, apr_uint64_t i);
 void sbuf_append_data(StrBuf *sbuf, const char *data, apr_size_t len);
 
 unsigned char sbuf_read_char(StrBuf *sbuf);
 apr_uint16_t sbuf_read_int16(StrBuf *sbuf);
 apr_uint32_t sbuf_read_int32(StrBuf *sbuf);
+apr_uint32_t sbuf_read_varint(StrBuf *sbuf);
+apr_uint64_t sbuf_read_varint64(StrBuf *sbuf);
 void sbuf_read_data(StrBuf *sbuf, char *data, apr_size_t len);
+const char *sbuf_read_ptr(StrBuf *sbuf, apr_size_t len);
 
-bool sbuf_socket_recv(StrBuf *sbuf, apr_socket_t *sock,
-                      apr_size_t len, bool *is_eof);
+apr_size_t sbuf_socket_recv_some(StrBuf *sbuf, apr_socket_t *sock,
+                                 apr_size_t max_len, bool *is_eof);
 bool sbuf_socket_send(StrBuf *sbuf, apr_socket_t *sock);
+bool sbuf_socket_sendv(StrBuf **sbufs, int nbufs, apr_socket_t *sock);
 
 #endif  /* STRBUF_H */
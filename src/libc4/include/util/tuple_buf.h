@@ -15,6 +15,8 @@ typedef struct TupleBufEntry
 {
     Tuple *tuple;
     TableDef *tbl_def;
+    /* For an update, the tuple that is replaced by "tuple"; otherwise NULL */
+    Tuple *old_tuple;
 } TupleBufEntry;
 
 typedef struct TupleBuf
@@ -27,11 +29,17 @@ typedef struct TupleBuf
 
 #define tuple_buf_is_empty(buf)     ((buf)->start == (buf)->end)
 #define tuple_buf_size(buf)         ((buf)->end - (buf)->start)
+/* The first (next to-be-shifted) entry; the buffer must not be empty */
+#define tuple_buf_head(buf)         (&(buf)->entries[(buf)->start])
 
 TupleBuf *tuple_buf_make(int size, apr_pool_t *pool);
 void tuple_buf_reset(TupleBuf *buf);
 void tuple_buf_push(TupleBuf *buf, Tuple *tuple, TableDef *tbl_def);
+void tuple_buf_push_update(TupleBuf *buf, Tuple *old_tuple, Tuple *new_tuple,
+                           TableDef *tbl_def);
 void tuple_buf_shift(TupleBuf *buf, Tuple **tuple, TableDef **tbl_def);
+void tuple_buf_shift_update(TupleBuf *buf, Tuple **old_tuple,
+                            Tuple **new_tuple, TableDef **tbl_def);
 void tuple_buf_dump(TupleBuf *buf, C4Runtime *c4);
 
 #endif  /* TUPLE_BUF_H */
@@ -0,0 +1,276 @@
+#include <apr_hash.h>
+#include <apr_network_io.h>
+#include <apr_thread_mutex.h>
+
+#include "c4-internal.h"
+#include "net/exchange.h"
+#include "net/network.h"
+#include "router.h"
+#include "util/strbuf.h"
+
+typedef struct ExchangeMsg
+{
+    struct ExchangeMsg *next;
+    char *tbl_name;
+    apr_size_t len;
+    char data[1];       /* Variable-length: serialized tuple */
+} ExchangeMsg;
+
+struct C4Exchange
+{
+    C4Runtime *c4;
+
+    /* The loc specs under which this instance is registered */
+    Datum loc_specs[2];
+
+    /* Scratch space for serializing outgoing tuples */
+    StrBuf *send_buf;
+
+    /* Inbox: protected by "lock" */
+    apr_thread_mutex_t *lock;
+    ExchangeMsg *inbox_head;
+    ExchangeMsg *inbox_tail;
+};
+
+/*
+ * Process-wide registry of C4 instances: map from loc spec (an address Datum)
+ * => C4Exchange. The
+ * registry lock must be held to access the registry, and while sending to an
+ * instance found in the registry; this ensures that the instance can't be
+ * shutdown concurrently.
+ */
+static apr_pool_t *registry_pool = NULL;
+static apr_thread_mutex_t *registry_lock = NULL;
+static apr_hash_t *registry = NULL;
+
+static apr_status_t exchange_cleanup(void *data);
+static void free_msg_list(ExchangeMsg *msg);
+
+static void
+lock_mutex(apr_thread_mutex_t *lock)
+{
+    apr_status_t s;
+
+    s = apr_thread_mutex_lock(lock);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+}
+
+static void
+unlock_mutex(apr_thread_mutex_t *lock)
+{
+    apr_status_t s;
+
+    s = apr_thread_mutex_unlock(lock);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+}
+
+/*
+ * Invoked by c4_initialize(), before any C4 instances have been created. The
+ * registry is allocated in a top-level pool, so it is released by
+ * apr_terminate().
+ */
+void
+exchange_initialize(void)
+{
+    apr_status_t s;
+
+    if (registry_pool != NULL)
+        return;
+
+    s = apr_pool_create(&registry_pool, NULL);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+
+    s = apr_thread_mutex_create(&registry_lock, APR_THREAD_MUTEX_DEFAULT,
+                                registry_pool);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+
+    registry = apr_hash_make(registry_pool);
+}
+
+/*
+ * Create the exchange for a new C4 instance, and register it in the
+ * registry. This must be called after the instance's network interface has
+ * been created, so that the exchange is shutdown before the network.
+ */
+C4Exchange *
+exchange_make(C4Runtime *c4)
+{
+    C4Exchange *xchg;
+    apr_status_t s;
+    int i;
+
+    xchg = apr_pcalloc(c4->pool, sizeof(*xchg));
+    xchg->c4 = c4;
+    xchg->send_buf = sbuf_make(c4->pool);
+    xchg->inbox_head = NULL;
+    xchg->inbox_tail = NULL;
+
+    s = apr_thread_mutex_create(&xchg->lock, APR_THREAD_MUTEX_DEFAULT,
+                                c4->pool);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+
+    /*
+     * XXX: As with the network code, a node might be addressed by many
+     * different loc specs. We register the canonical local address, and the
+     * loopback address that is commonly used by single-host programs (both
+     * "tcp:localhost:port" and "tcp:127.0.0.1:port" resolve to it).
+     */
+    xchg->loc_specs[0] = c4->local_addr;
+    xchg->loc_specs[1] = addr_make(INADDR_LOOPBACK, (apr_uint16_t) c4->port);
+
+    /* c4_initialize() should have been called */
+    ASSERT(registry != NULL);
+    lock_mutex(registry_lock);
+    for (i = 0; i < 2; i++)
+        apr_hash_set(registry, &xchg->loc_specs[i], sizeof(Datum), xchg);
+    unlock_mutex(registry_lock);
+
+    apr_pool_cleanup_register(c4->pool, xchg, exchange_cleanup,
+                              apr_pool_cleanup_null);
+
+    return xchg;
+}
+
+static apr_status_t
+exchange_cleanup(void *data)
+{
+    C4Exchange *xchg = (C4Exchange *) data;
+    int i;
+
+    lock_mutex(registry_lock);
+    for (i = 0; i < 2; i++)
+    {
+        if (apr_hash_get(registry, &xchg->loc_specs[i],
+                         sizeof(Datum)) == xchg)
+            apr_hash_set(registry, &xchg->loc_specs[i],
+                         sizeof(Datum), NULL);
+    }
+    unlock_mutex(registry_lock);
+
+    /* No other thread can reach our inbox now */
+    if (xchg->inbox_head != NULL)
+        c4_log(xchg->c4, "Discarding unreceived exchange messages");
+
+    free_msg_list(xchg->inbox_head);
+    xchg->inbox_head = NULL;
+    xchg->inbox_tail = NULL;
+
+    return APR_SUCCESS;
+}
+
+static void
+free_msg_list(ExchangeMsg *msg)
+{
+    while (msg != NULL)
+    {
+        ExchangeMsg *next = msg->next;
+
+        ol_free(msg->tbl_name);
+        ol_free(msg);
+        msg = next;
+    }
+}
+
+static ExchangeMsg *
+make_msg(C4Exchange *xchg, Tuple *tuple, TableDef *tbl_def)
+{
+    StrBuf *buf = xchg->send_buf;
+    ExchangeMsg *msg;
+
+    sbuf_reset(buf);
+    tuple_to_buf(tuple, tbl_def->schema, buf);
+
+    msg = ol_alloc(offsetof(ExchangeMsg, data) + buf->len);
+    msg->next = NULL;
+    msg->tbl_name = ol_strdup(tbl_def->name);
+    msg->len = buf->len;
+    memcpy(msg->data, buf->data, buf->len);
+
+    return msg;
+}
+
+/*
+ * If the tuple's location specifier denotes another C4 instance in this
+ * process, deliver the tuple to that instance's inbox and return true.
+ * Otherwise, return false; the caller should send the tuple via the network.
+ */
+bool
+exchange_send(C4Exchange *xchg, Tuple *tuple, TableDef *tbl_def)
+{
+    C4Exchange *dest;
+    ExchangeMsg *msg;
+    Datum loc_spec;
+
+    loc_spec = tuple_get_val(tuple, tbl_def->schema, tbl_def->ls_colno);
+    if (!addr_resolve(loc_spec, &loc_spec))
+        return false;
+
+    lock_mutex(registry_lock);
+    dest = apr_hash_get(registry, &loc_spec, sizeof(Datum));
+    if (dest == NULL)
+    {
+        unlock_mutex(registry_lock);
+        return false;
+    }
+
+    msg = make_msg(xchg, tuple, tbl_def);
+
+    lock_mutex(dest->lock);
+    if (dest->inbox_tail == NULL)
+        dest->inbox_head = msg;
+    else
+        dest->inbox_tail->next = msg;
+    dest->inbox_tail = msg;
+    unlock_mutex(dest->lock);
+
+    network_wakeup(dest->c4->net);
+    unlock_mutex(registry_lock);
+
+    return true;
+}
+
+/*
+ * Route all the tuples in this instance's inbox. Returns true if we saw any
+ * tuples, in which case the caller should compute a fixpoint.
+ */
+bool
+exchange_drain(C4Exchange *xchg)
+{
+    C4Runtime *c4 = xchg->c4;
+    ExchangeMsg *msg_list;
+    ExchangeMsg *msg;
+
+    lock_mutex(xchg->lock);
+    msg_list = xchg->inbox_head;
+    xchg->inbox_head = NULL;
+    xchg->inbox_tail = NULL;
+    unlock_mutex(xchg->lock);
+
+    if (msg_list == NULL)
+        return false;
+
+    for (msg = msg_list; msg != NULL; msg = msg->next)
+    {
+        StrBuf buf;
+        TableDef *tbl_def;
+        Tuple *tuple;
+
+        buf.data = msg->data;
+        buf.len = msg->len;
+        buf.max_len = msg->len;
+        buf.pos = 0;
+
+        tbl_def = cat_get_table(c4->cat, msg->tbl_name);
+        tuple = tuple_from_buf(&buf, tbl_def->schema);
+        router_insert_tuple(c4->router, tuple, tbl_def, false);
+        tuple_unpin(tuple, tbl_def->schema);
+    }
+
+    free_msg_list(msg_list);
+    return true;
+}
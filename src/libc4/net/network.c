@@ -6,7 +6,9 @@
 #include "net/network.h"
 #include "router.h"
 #include "util/hash.h"
+#include "util/recv_slab.h"
 #include "util/socket.h"
+#include "util/stats.h"
 #include "util/strbuf.h"
 #include "util/tuple_buf.h"
 
@@ -32,28 +34,81 @@ struct C4Network
     c4_hash_t *client_tbl;
 };
 
+/*
+ * A connection begins with a preamble from the sender: a protocol version
+ * byte, a flags byte, and the receiver's address as the sender knows it
+ * (that is, the location specifier of the tuples it will send, as written:
+ * it might be a named address, in which case the name follows it). If the
+ * NET_FLAG_COMPACT flag is set, tuples are sent in the compact binary format
+ * (see datum.c), in which an address equal to that one takes a single
+ * byte. We always send the compact format, but accept either.
+ */
+#define NET_PROTOCOL_VERSION    1
+#define NET_FLAG_COMPACT        0x01
+#define NET_PREAMBLE_MIN_LEN    (2 + sizeof(apr_int64_t))
+
+/*
+ * Tuples are then sent in frames. A frame is a 32-bit length, followed by that
+ * many bytes of messages; each message carries a single tuple. The sender
+ * packs as many pending tuples as it can into a frame, up to about
+ * NET_FRAME_MAX_BYTES, and sends the frame with a single system call.
+ *
+ * A message begins with a varint "tag": the sender's ID for the tuple's
+ * table, shifted left one bit, with the low bit set if the message also
+ * declares the table. The first message for a table on a connection declares
+ * it: the tag is followed by the varint length of the table's name, the name,
+ * the varint number of columns, and the type of each column.
+ * The receiver remembers the TableDef for each declared ID, so later messages
+ * for the table carry only the tag. The tag (and declaration) is followed by
+ * the serialized tuple. Table IDs are scoped to a single connection and
+ * direction.
+ */
+#ifndef NET_FRAME_MAX_BYTES
+#define NET_FRAME_MAX_BYTES     (64 * 1024)
+#endif
+
+/*
+ * When a client socket is readable, we read as much as it has available into
+ * the client's receive buffer, NET_RECV_CHUNK_BYTES at a time, and then
+ * process every complete frame in the buffer; the router then computes a
+ * single fixpoint over all the new tuples. To avoid starving other clients,
+ * we make at most NET_RECV_MAX_READS reads per poll. The receive buffer is a
+ * RecvSlab, so strings in received tuples can reference it directly. Once
+ * strings reference the slab, we keep appending to its free space, and only
+ * continue in a new slab of NET_RECV_SLAB_BYTES when it is full.
+ */
+#define NET_RECV_CHUNK_BYTES    (64 * 1024)
+#define NET_RECV_MAX_READS      16
+#define NET_RECV_SLAB_BYTES     (256 * 1024)
+
+#define TAG_IS_DECL(tag)        (((tag) & 1) != 0)
+#define TAG_GET_TBL_ID(tag)     ((tag) >> 1)
+
 /* XXX: Rename */
 typedef enum RecvState
 {
-    RECV_TABLE_NAME_LEN,
-    RECV_TABLE_NAME,
-    RECV_TUPLE_LEN,
-    RECV_TUPLE
+    RECV_PREAMBLE,
+    RECV_FRAME_LEN,
+    RECV_FRAME
 } RecvState;
 
 typedef enum SendState
 {
     SEND_IDLE,
-    SEND_HEADER,
-    SEND_TUPLE
+    SEND_FRAME
 } SendState;
 
 typedef struct ClientState
 {
     apr_pool_t *pool;
     C4Runtime *c4;
-    Datum loc_spec;       /* Pre-formatted for hash table lookups */
-    char *loc_spec_str;
+    Datum loc_spec;       /* Address of the remote host */
+    char *loc_spec_str;   /* Text form of loc_spec, for log messages */
+    /*
+     * The remote host's address as written in the tuples we send it (it
+     * might be named, unlike loc_spec): the base for compact addresses
+     */
+    Datum send_base_addr;
     apr_sockaddr_t *remote_addr;
 
     bool connected;
@@ -62,16 +117,23 @@ typedef struct ClientState
 
     /* Receive-side state: incoming data from client */
     RecvState recv_state;
-    StrBuf *recv_name_buf;
-    StrBuf *recv_tuple_buf;
-    apr_uint16_t tbl_name_len;
-    apr_uint32_t tuple_len;
+    RecvSlab *recv_slab;
+    apr_uint32_t frame_len;
+    bool recv_compact;          /* Does the client send compact tuples? */
+    Datum recv_base_addr;       /* Our address, according to the client */
+    /* Map from the client's table IDs => TableDef */
+    TableDef **recv_tbls;
+    apr_uint32_t recv_tbls_size;
 
     /* Send-side state: outgoing data to client */
     SendState send_state;
-    StrBuf *send_header_buf;    /* Headers for current tuple */
-    StrBuf *send_tuple_buf;     /* Current outgoing tuple */
+    bool sent_preamble;
+    StrBuf *send_header_buf;    /* Preamble, and length of current frame */
+    StrBuf *send_frame_buf;     /* Messages in current frame */
     TupleBuf *pending_tuples;   /* Future outgoing tuples */
+    /* Which tables have we declared to the client? Indexed by table ID */
+    bool *sent_decls;
+    int sent_decls_size;
 } ClientState;
 
 #define POLLSET_SIZE 64
@@ -87,17 +149,20 @@ static void accept_new_client(C4Network *net);
 static void update_client_state(const apr_pollfd_t *fd);
 static void update_recv_state(ClientState *client);
 static void update_send_state(ClientState *client);
-static void deserialize_tuple(ClientState *client);
+static apr_size_t get_preamble_len(StrBuf *buf);
+static void recv_preamble(ClientState *client);
+static void recv_table_decl(ClientState *client, apr_uint32_t tbl_id);
+static void deserialize_frame(ClientState *client);
 static ClientState *client_make(C4Network *net);
 static apr_status_t client_cleanup(void *data);
 static ClientState *get_client_for_loc_spec(C4Network *net, Tuple *tuple,
                                             TableDef *tbl_def);
-static ClientState *connect_new_client(C4Network *net, Datum loc_spec);
+static ClientState *connect_new_client(C4Network *net, Datum loc_spec,
+                                       Datum base_addr);
 static void client_try_connect(ClientState *client);
 static void update_client_interest(ClientState *client, int reqevents);
 static apr_socket_t *create_send_socket(ClientState *client,
                                         apr_sockaddr_t **remote_addr);
-static void parse_loc_spec(const char *loc_spec, char *host, int *port_p);
 
 /*
  * Create a new instance of the network interface. "port" is the local TCP
@@ -112,7 +177,7 @@ network_make(C4Runtime *c4, int port)
     net = apr_pcalloc(c4->pool, sizeof(*net));
     net->c4 = c4;
     net->pool = c4->pool;
-    net->client_tbl = c4_hash_make(net->pool, sizeof(Datum), NULL,
+    net->client_tbl = c4_hash_make(net->pool, sizeof(Datum *), NULL,
                                    client_tbl_hash, client_tbl_cmp);
     net->serv_sock = server_sock_make(port, net->pool);
 
@@ -198,27 +263,27 @@ pollfd_make(apr_pool_t *pool, apr_socket_t *sock,
     return result;
 }
 
+/*
+ * The client table is keyed by pointers to loc spec Datums, which are
+ * network addresses.
+ */
 static unsigned int
 client_tbl_hash(const char *key, int klen, __unused void *user_data)
 {
-    Datum d;
+    Datum *d = (Datum *) key;
 
-    ASSERT(klen == sizeof(Datum));
-    /* Ugly workaround: C99 does not allow casting pointer to union type */
-    d.s = (C4String *) key;
-    return string_hash(d);
+    ASSERT(klen == sizeof(Datum *));
+    return addr_hash(*d);
 }
 
 static bool
 client_tbl_cmp(const void *k1, const void *k2, int klen, __unused void *user_data)
 {
-    Datum d1;
-    Datum d2;
+    Datum *d1 = (Datum *) k1;
+    Datum *d2 = (Datum *) k2;
 
-    ASSERT(klen == sizeof(Datum));
-    d1.s = (C4String *) k1;
-    d2.s = (C4String *) k2;
-    return string_equal(d1, d2);
+    ASSERT(klen == sizeof(Datum *));
+    return addr_equal(*d1, *d2);
 }
 
 int
@@ -291,7 +356,9 @@ accept_new_client(C4Network *net)
 
     socket_set_non_block(client->sock);
     client->connected = true;
-    client->loc_spec_str = socket_get_remote_loc(client->sock, client->pool);
+    client->loc_spec = socket_get_remote_loc(client->sock);
+    client->loc_spec_str = addr_to_text(client->loc_spec, client->pool);
+    client->send_base_addr = client->loc_spec;
     client->remote_addr = socket_get_remote_addr(client->sock);
     client->pollfd = pollfd_make(client->pool, client->sock,
                                  APR_POLLIN, client);
@@ -299,14 +366,12 @@ accept_new_client(C4Network *net)
     if (s != APR_SUCCESS)
         FAIL_APR(s);
 
-    client->loc_spec = string_from_str(client->loc_spec_str);
-    pool_track_datum(client->pool, client->loc_spec, TYPE_STRING);
     /*
      * Enter the new client's loc_spec into the client_table. If
      * there's already a ClientState for the loc spec, don't try to
      * replace it.
      */
-    c4_hash_set_if_new(net->client_tbl, client->loc_spec.s, client, NULL);
+    c4_hash_set_if_new(net->client_tbl, &client->loc_spec, client, NULL);
 }
 
 static ClientState *
@@ -320,12 +385,11 @@ client_make(C4Network *net)
     client->pool = client_pool;
     client->c4 = net->c4;
     client->connected = false;
-    client->recv_state = RECV_TABLE_NAME_LEN;
-    client->recv_name_buf = sbuf_make(client->pool);
-    client->recv_tuple_buf = sbuf_make(client->pool);
+    client->recv_state = RECV_PREAMBLE;
+    client->recv_slab = recv_slab_make(NET_RECV_SLAB_BYTES);
     client->send_state = SEND_IDLE;
     client->send_header_buf = sbuf_make(client->pool);
-    client->send_tuple_buf = sbuf_make(client->pool);
+    client->send_frame_buf = sbuf_make(client->pool);
     client->pending_tuples = tuple_buf_make(64, client->pool);
 
     apr_pool_pre_cleanup_register(client->pool, client, client_cleanup);
@@ -360,7 +424,10 @@ client_cleanup(void *data)
         c4_warn_apr(client->c4, s, "Close on client socket @ %s failed",
                     client->loc_spec_str);
 
-    c4_hash_set(net->client_tbl, client->loc_spec.s, NULL);
+    c4_hash_set(net->client_tbl, &client->loc_spec, NULL);
+
+    /* Strings received from the client might still reference the slab */
+    recv_slab_release(client->recv_slab);
 
     return APR_SUCCESS;
 }
@@ -382,125 +449,355 @@ update_client_state(const apr_pollfd_t *pollfd)
 static void
 update_recv_state(ClientState *client)
 {
+    StrBuf *buf = &client->recv_slab->buf;
     bool is_eof;
-    bool saw_data;
+    int i;
 
-    switch (client->recv_state)
+    /*
+     * If strings reference the slab, it can't be reallocated: once it has
+     * no room for a full chunk, continue in a new slab, moving any partial
+     * frame to it.
+     */
+    if (recv_slab_is_shared(client->recv_slab) &&
+        recv_slab_space_avail(client->recv_slab) < NET_RECV_CHUNK_BYTES)
     {
-        case RECV_TABLE_NAME_LEN:
-            saw_data = sbuf_socket_recv(client->recv_name_buf, client->sock,
-                                        sizeof(apr_int16_t), &is_eof);
-            if (is_eof)
-                goto saw_eof;
-            if (!saw_data)
-                return;
+        RecvSlab *new_slab;
+
+        new_slab = recv_slab_make(Max(NET_RECV_SLAB_BYTES,
+                                      2 * sbuf_data_avail(buf)));
+        sbuf_append_data(&new_slab->buf, buf->data + buf->pos,
+                         sbuf_data_avail(buf));
+        recv_slab_release(client->recv_slab);
+        client->recv_slab = new_slab;
+        buf = &new_slab->buf;
+    }
 
-            client->tbl_name_len = ntohs(sbuf_read_int16(client->recv_name_buf));
-            sbuf_reset(client->recv_name_buf);
-            client->recv_state = RECV_TABLE_NAME;
+    /* Drain the socket; the slab can only grow if no strings reference it */
+    is_eof = false;
+    for (i = 0; i < NET_RECV_MAX_READS; i++)
+    {
+        apr_size_t max_read = NET_RECV_CHUNK_BYTES;
+        apr_size_t did_read;
 
-        case RECV_TABLE_NAME:
-            saw_data = sbuf_socket_recv(client->recv_name_buf, client->sock,
-                                        client->tbl_name_len, &is_eof);
-            if (is_eof)
-                goto saw_eof;
-            if (!saw_data)
-                return;
+        if (recv_slab_is_shared(client->recv_slab))
+            max_read = Min(max_read, recv_slab_space_avail(client->recv_slab));
+        if (max_read == 0)
+            break;
 
-            sbuf_append_char(client->recv_name_buf, '\0');
-            client->recv_state = RECV_TUPLE_LEN;
+        did_read = sbuf_socket_recv_some(buf, client->sock, max_read, &is_eof);
+        if (is_eof || did_read < max_read)
+            break;
+    }
 
-        case RECV_TUPLE_LEN:
-            saw_data = sbuf_socket_recv(client->recv_tuple_buf, client->sock,
-                                        sizeof(apr_int32_t), &is_eof);
-            if (is_eof)
-                goto saw_eof;
-            if (!saw_data)
-                return;
+    /* Process every complete frame; strings can reference the slab */
+    recv_slab_set_current(client->recv_slab);
+    while (true)
+    {
+        if (client->recv_state == RECV_PREAMBLE)
+        {
+            if (sbuf_data_avail(buf) < get_preamble_len(buf))
+                break;
+
+            recv_preamble(client);
+            client->recv_state = RECV_FRAME_LEN;
+        }
+
+        if (client->recv_state == RECV_FRAME_LEN)
+        {
+            if (sbuf_data_avail(buf) < sizeof(apr_uint32_t))
+                break;
+
+            client->frame_len = ntohl(sbuf_read_int32(buf));
+            client->recv_state = RECV_FRAME;
+        }
+
+        ASSERT(client->recv_state == RECV_FRAME);
+        if (sbuf_data_avail(buf) < client->frame_len)
+            break;
+
+        deserialize_frame(client);
+        client->recv_state = RECV_FRAME_LEN;
+    }
 
-            client->tuple_len = ntohl(sbuf_read_int32(client->recv_tuple_buf));
-            sbuf_reset(client->recv_tuple_buf);
-            client->recv_state = RECV_TUPLE;
+    recv_slab_set_current(NULL);
 
-        case RECV_TUPLE:
-            saw_data = sbuf_socket_recv(client->recv_tuple_buf, client->sock,
-                                        client->tuple_len, &is_eof);
-            if (is_eof)
-                goto saw_eof;
-            if (!saw_data)
-                return;
+    /*
+     * Keep any partial frame for next time. If no strings reference the
+     * slab, we can reuse its space; otherwise, we leave the slab as it is,
+     * and append to it next time.
+     */
+    if (!recv_slab_is_shared(client->recv_slab))
+        sbuf_compact(buf);
 
-            deserialize_tuple(client);
-            sbuf_reset(client->recv_name_buf);
-            sbuf_reset(client->recv_tuple_buf);
-            client->recv_state = RECV_TABLE_NAME_LEN;
-            return;
+    if (is_eof)
+    {
+        if (client->recv_state == RECV_FRAME || sbuf_data_avail(buf))
+            c4_log(client->c4, "Unexpected EOF from client @ %s",
+                   client->loc_spec_str);
 
-        default:
-            ERROR("Unrecognized client receive state: %d",
-                  (int) client->recv_state);
+        apr_pool_destroy(client->pool);
     }
+}
 
-saw_eof:
-    if (client->recv_state != RECV_TABLE_NAME_LEN ||
-        sbuf_data_avail(client->recv_name_buf))
-        c4_log(client->c4, "Unexpected EOF from client @ %s",
-               client->loc_spec_str);
+/*
+ * Return the length of the preamble at the current position of "buf", or
+ * NET_PREAMBLE_MIN_LEN if we haven't yet received enough of it to tell.
+ */
+static apr_size_t
+get_preamble_len(StrBuf *buf)
+{
+    apr_size_t addr_len;
+
+    if (sbuf_data_avail(buf) < NET_PREAMBLE_MIN_LEN)
+        return NET_PREAMBLE_MIN_LEN;
+
+    /* Skip the version and flags bytes */
+    buf->pos += 2;
+    addr_len = addr_get_buf_len(buf);
+    buf->pos -= 2;
 
-    apr_pool_destroy(client->pool);
+    return 2 + addr_len;
+}
+
+static void
+recv_preamble(ClientState *client)
+{
+    StrBuf *buf = &client->recv_slab->buf;
+    unsigned char version;
+    unsigned char flags;
+
+    version = sbuf_read_char(buf);
+    if (version != NET_PROTOCOL_VERSION)
+        ERROR("Unsupported protocol version %d from client @ %s",
+              (int) version, client->loc_spec_str);
+
+    flags = sbuf_read_char(buf);
+    client->recv_compact = (flags & NET_FLAG_COMPACT) != 0;
+    client->recv_base_addr = addr_from_buf(buf);
 }
 
 /*
- * Convert serialized tuple back into in-memory format, add to router, and
- * immediately compute a fixpoint.
+ * Process a table declaration from the client: lookup the local table with
+ * the declared name, check that its schema matches the declared column
+ * types, and remember the table under the client's ID for it.
  */
 static void
-deserialize_tuple(ClientState *client)
+recv_table_decl(ClientState *client, apr_uint32_t tbl_id)
 {
-    char *tbl_name = client->recv_name_buf->data;
-    Tuple *tuple;
+    StrBuf *buf = &client->recv_slab->buf;
+    apr_uint32_t name_len;
+    char *tbl_name;
     TableDef *tbl_def;
+    Schema *schema;
+    apr_uint32_t ncols;
+    int i;
 
-    ASSERT(client->recv_state == RECV_TUPLE);
+    name_len = sbuf_read_varint(buf);
+    tbl_name = apr_pstrmemdup(client->pool, sbuf_read_ptr(buf, name_len),
+                              name_len);
     tbl_def = cat_get_table(client->c4->cat, tbl_name);
-    tuple = tuple_from_buf(client->recv_tuple_buf, tbl_def->schema);
-    router_insert_tuple(client->c4->router, tuple, tbl_def, false);
-    tuple_unpin(tuple, tbl_def->schema);
+    schema = tbl_def->schema;
+
+    ncols = sbuf_read_varint(buf);
+    if (ncols != (apr_uint32_t) schema->len)
+        ERROR("Schema mismatch for table %s from client @ %s: "
+              "expected %d columns, got %u",
+              tbl_name, client->loc_spec_str, schema->len, ncols);
+
+    for (i = 0; i < schema->len; i++)
+    {
+        DataType type = (DataType) sbuf_read_char(buf);
+        DataType local_type = schema_get_type(schema, i);
+
+        if (type != local_type)
+            ERROR("Schema mismatch for table %s from client @ %s: "
+                  "column %d is %s, expected %s",
+                  tbl_name, client->loc_spec_str, i,
+                  get_type_name(type), get_type_name(local_type));
+    }
+
+    if (tbl_id >= client->recv_tbls_size)
+    {
+        TableDef **new_tbls;
+        apr_uint32_t new_size;
+
+        new_size = Max(client->recv_tbls_size * 2, 16);
+        while (new_size <= tbl_id)
+            new_size *= 2;
+
+        new_tbls = apr_pcalloc(client->pool, new_size * sizeof(TableDef *));
+        if (client->recv_tbls_size > 0)
+            memcpy(new_tbls, client->recv_tbls,
+                   client->recv_tbls_size * sizeof(TableDef *));
+        client->recv_tbls = new_tbls;
+        client->recv_tbls_size = new_size;
+    }
+
+    client->recv_tbls[tbl_id] = tbl_def;
 }
 
 /*
- * We use one StrBuf for the headers (table name + length info), and
- * one StrBuf for the serialized tuple itself: we need to include the
- * length of the latter in the former.
+ * Convert each tuple in the frame at the current position of the receive
+ * buffer back into in-memory format, and add them all to the router; the
+ * caller will then compute a fixpoint.
  */
 static void
-serialize_tuple(ClientState *client)
+deserialize_frame(ClientState *client)
 {
-    Tuple *tuple;
-    TableDef *tbl_def;
-    apr_size_t tbl_name_len;
-    apr_size_t tuple_len;
+    StrBuf *buf = &client->recv_slab->buf;
+    apr_size_t frame_end;
+
+    ASSERT(client->recv_state == RECV_FRAME);
+    ASSERT(sbuf_data_avail(buf) >= client->frame_len);
+    frame_end = buf->pos + client->frame_len;
+    addr_set_compact_base(&client->recv_base_addr);
+    while (buf->pos < frame_end)
+    {
+        apr_uint32_t tag;
+        apr_uint32_t tbl_id;
+        TableDef *tbl_def;
+        Tuple *tuple;
+
+        tag = sbuf_read_varint(buf);
+        tbl_id = TAG_GET_TBL_ID(tag);
+        if (TAG_IS_DECL(tag))
+            recv_table_decl(client, tbl_id);
+
+        if (tbl_id >= client->recv_tbls_size ||
+            client->recv_tbls[tbl_id] == NULL)
+            ERROR("Undeclared table ID %u from client @ %s",
+                  tbl_id, client->loc_spec_str);
+
+        tbl_def = client->recv_tbls[tbl_id];
+        if (client->recv_compact)
+            tuple = tuple_from_buf_compact(buf, tbl_def->schema);
+        else
+            tuple = tuple_from_buf(buf, tbl_def->schema);
+        router_insert_tuple(client->c4->router, tuple, tbl_def, false);
+        tuple_unpin(tuple, tbl_def->schema);
+        STATS_INCR(net_tuples_recv);
+    }
+    addr_set_compact_base(NULL);
 
-    tuple_buf_shift(client->pending_tuples, &tuple, &tbl_def);
+    if (buf->pos != frame_end)
+        ERROR("Malformed frame from client @ %s", client->loc_spec_str);
+}
 
-    tbl_name_len = strlen(tbl_def->name);
-    if (tbl_name_len > APR_UINT16_MAX)
-        FAIL();
+/*
+ * Returns true if we have not yet declared the table to the client, and
+ * records that it is now declared.
+ */
+static bool
+client_needs_decl(ClientState *client, TableDef *tbl_def)
+{
+    if (tbl_def->id >= client->sent_decls_size)
+    {
+        bool *new_decls;
+        int new_size;
+
+        new_size = Max(client->sent_decls_size * 2, 16);
+        while (new_size <= tbl_def->id)
+            new_size *= 2;
+
+        new_decls = apr_pcalloc(client->pool, new_size * sizeof(bool));
+        if (client->sent_decls_size > 0)
+            memcpy(new_decls, client->sent_decls,
+                   client->sent_decls_size * sizeof(bool));
+        client->sent_decls = new_decls;
+        client->sent_decls_size = new_size;
+    }
+
+    if (client->sent_decls[tbl_def->id])
+        return false;
+
+    client->sent_decls[tbl_def->id] = true;
+    return true;
+}
+
+/*
+ * Append a declaration of the table: the table's name, and the type of each
+ * of its columns.
+ */
+static void
+append_table_decl(StrBuf *buf, TableDef *tbl_def)
+{
+    Schema *schema = tbl_def->schema;
+    apr_size_t name_len;
+    int i;
 
-    sbuf_append_int16(client->send_header_buf, htons(tbl_name_len));
-    sbuf_append_data(client->send_header_buf, tbl_def->name,
-                     tbl_name_len);
+    name_len = strlen(tbl_def->name);
+    sbuf_append_varint(buf, name_len);
+    sbuf_append_data(buf, tbl_def->name, name_len);
+    sbuf_append_varint(buf, schema->len);
+    for (i = 0; i < schema->len; i++)
+        sbuf_append_char(buf, (char) schema_get_type(schema, i));
+}
+
+/*
+ * Append a message holding the tuple to the current frame.
+ */
+static void
+serialize_tuple(ClientState *client, Tuple *tuple, TableDef *tbl_def)
+{
+    StrBuf *buf = client->send_frame_buf;
+    apr_uint32_t tag;
 
-    tuple_to_buf(tuple, tbl_def->schema, client->send_tuple_buf);
-    tuple_unpin(tuple, tbl_def->schema);
+    tag = ((apr_uint32_t) tbl_def->id) << 1;
+    if (client_needs_decl(client, tbl_def))
+    {
+        sbuf_append_varint(buf, tag | 1);
+        append_table_decl(buf, tbl_def);
+    }
+    else
+        sbuf_append_varint(buf, tag);
 
-    tuple_len = client->send_tuple_buf->len;
-    sbuf_append_int32(client->send_header_buf, htonl(tuple_len));
+    tuple_to_buf_compact(tuple, tbl_def->schema, buf);
+}
+
+/*
+ * Pack pending tuples into a new frame until it holds NET_FRAME_MAX_BYTES or
+ * more, or we run out of tuples; a frame always holds at least one tuple. The
+ * frame's length goes in a separate StrBuf, since we only know it once the
+ * frame is complete: the two are sent together with a gather write.
+ */
+static void
+build_frame(ClientState *client)
+{
+    ASSERT(!tuple_buf_is_empty(client->pending_tuples));
+
+    if (!client->sent_preamble)
+    {
+        sbuf_append_char(client->send_header_buf, NET_PROTOCOL_VERSION);
+        sbuf_append_char(client->send_header_buf, NET_FLAG_COMPACT);
+        addr_to_buf(client->send_base_addr, client->send_header_buf);
+        client->sent_preamble = true;
+    }
+
+    addr_set_compact_base(&client->send_base_addr);
+    do
+    {
+        Tuple *tuple;
+        TableDef *tbl_def;
+
+        tuple_buf_shift(client->pending_tuples, &tuple, &tbl_def);
+        serialize_tuple(client, tuple, tbl_def);
+        tuple_unpin(tuple, tbl_def->schema);
+        STATS_INCR(net_tuples_sent);
+    } while (!tuple_buf_is_empty(client->pending_tuples) &&
+             client->send_frame_buf->len < NET_FRAME_MAX_BYTES);
+    addr_set_compact_base(NULL);
+
+    if (client->send_frame_buf->len > APR_UINT32_MAX)
+        FAIL();
+
+    sbuf_append_int32(client->send_header_buf,
+                      htonl(client->send_frame_buf->len));
 }
 
 static void
 update_send_state(ClientState *client)
 {
+    StrBuf *bufs[2];
     bool done_write;
 
     if (!client->connected)
@@ -512,25 +809,18 @@ update_send_state(ClientState *client)
     switch (client->send_state)
     {
         case SEND_IDLE:
-            serialize_tuple(client);
-            client->send_state = SEND_HEADER;
-
-        case SEND_HEADER:
-            done_write = sbuf_socket_send(client->send_header_buf,
-                                          client->sock);
-            if (!done_write)
-                return;
+            build_frame(client);
+            client->send_state = SEND_FRAME;
 
-            client->send_state = SEND_TUPLE;
-
-        case SEND_TUPLE:
-            done_write = sbuf_socket_send(client->send_tuple_buf,
-                                          client->sock);
+        case SEND_FRAME:
+            bufs[0] = client->send_header_buf;
+            bufs[1] = client->send_frame_buf;
+            done_write = sbuf_socket_sendv(bufs, 2, client->sock);
             if (!done_write)
                 return;
 
             sbuf_reset(client->send_header_buf);
-            sbuf_reset(client->send_tuple_buf);
+            sbuf_reset(client->send_frame_buf);
             client->send_state = SEND_IDLE;
             if (tuple_buf_is_empty(client->pending_tuples))
             {
@@ -554,40 +844,61 @@ network_send(C4Network *net, Tuple *tuple, TableDef *tbl_def)
     int reqevents;
 
     client = get_client_for_loc_spec(net, tuple, tbl_def);
+    if (client == NULL)
+        return;
+
     tuple_buf_push(client->pending_tuples, tuple, tbl_def);
 
     reqevents = client->pollfd->reqevents | APR_POLLOUT;
     update_client_interest(client, reqevents);
 }
 
+/*
+ * Return the client for the tuple's location specifier, connecting to it if
+ * necessary. Clients are keyed by resolved address, so that a host that is
+ * addressed both by name and by IP address gets a single connection. If the
+ * address can't be resolved, we drop the tuple and return NULL.
+ */
 static ClientState *
 get_client_for_loc_spec(C4Network *net, Tuple *tuple, TableDef *tbl_def)
 {
     ClientState *client;
+    Datum tuple_loc_spec;
     Datum loc_spec;
 
-    loc_spec = tuple_get_val(tuple, tbl_def->ls_colno);
-    client = c4_hash_get(net->client_tbl, loc_spec.s);
+    tuple_loc_spec = tuple_get_val(tuple, tbl_def->schema,
+                                   tbl_def->ls_colno);
+    if (!addr_resolve(tuple_loc_spec, &loc_spec))
+    {
+        c4_log(net->c4, "Failed to resolve address %s; dropping tuple",
+               addr_to_text(tuple_loc_spec, net->c4->tmp_pool));
+        return NULL;
+    }
+
+    client = c4_hash_get(net->client_tbl, &loc_spec);
     if (client == NULL)
     {
-        client = connect_new_client(net, loc_spec);
-        c4_hash_set(net->client_tbl, client->loc_spec.s, client);
+        /*
+         * Tuples sent to the host usually write its address the same way,
+         * so that becomes the base for compact addresses
+         */
+        client = connect_new_client(net, loc_spec, tuple_loc_spec);
+        c4_hash_set(net->client_tbl, &client->loc_spec, client);
     }
 
     return client;
 }
 
 static ClientState *
-connect_new_client(C4Network *net, Datum loc_spec)
+connect_new_client(C4Network *net, Datum loc_spec, Datum base_addr)
 {
     ClientState *client;
     apr_status_t s;
 
     client = client_make(net);
-    client->loc_spec = datum_copy(loc_spec, TYPE_STRING);
-    pool_track_datum(client->pool, client->loc_spec, TYPE_STRING);
-    client->loc_spec_str = string_to_text(client->loc_spec,
-                                          client->pool);
+    client->loc_spec = loc_spec;
+    client->loc_spec_str = addr_to_text(client->loc_spec, client->pool);
+    client->send_base_addr = base_addr;
 
     client->sock = create_send_socket(client, &client->remote_addr);
     client->pollfd = pollfd_make(client->pool, client->sock,
@@ -615,7 +926,7 @@ client_try_connect(ClientState *client)
 
     ASSERT(!client->connected);
     ASSERT(client->send_state == SEND_IDLE);
-    ASSERT(client->recv_state == RECV_TABLE_NAME_LEN);
+    ASSERT(client->recv_state == RECV_PREAMBLE);
 
     s = apr_socket_connect(client->sock, client->remote_addr);
     /* XXX: No portable APR test for EALREADY, it seems */
@@ -672,15 +983,8 @@ create_send_socket(ClientState *client, apr_sockaddr_t **remote_addr)
     apr_status_t s;
     apr_socket_t *sock;
     apr_sockaddr_t *addr;
-    char host[APRMAXHOSTLEN];
-    int port_num;
-
-    parse_loc_spec(client->loc_spec_str, host, &port_num);
-
-    s = apr_sockaddr_info_get(&addr, host, APR_INET, port_num, 0, client->pool);
-    if (s != APR_SUCCESS)
-        FAIL_APR(s);
 
+    addr = socket_addr_from_loc(client->loc_spec, client->pool);
     s = apr_socket_create(&sock, addr->family, SOCK_STREAM,
                           APR_PROTO_TCP, client->pool);
     if (s != APR_SUCCESS)
@@ -690,36 +994,3 @@ create_send_socket(ClientState *client, apr_sockaddr_t **remote_addr)
     *remote_addr = addr;
     return sock;
 }
-
-static void
-parse_loc_spec(const char *loc_spec, char *host, int *port_p)
-{
-    const char *p = loc_spec;
-    char *colon_ptr;
-    ptrdiff_t host_len;
-    long raw_port;
-    char *end_ptr;
-
-    /* We only handle TCP for now */
-    if (strncmp(p, "tcp:", 4) != 0)
-        FAIL();
-
-    p += 4;
-    colon_ptr = rindex(p, ':');
-    if (colon_ptr == NULL)
-        FAIL();
-
-    host_len = colon_ptr - p;
-    if (host_len <= 0 || host_len >= APRMAXHOSTLEN - 1)
-        FAIL();
-
-    memcpy(host, p, host_len);
-    host[host_len] = '\0';
-
-    p += host_len + 1;
-    raw_port = strtol(p, &end_ptr, 10);
-    if (p == end_ptr || raw_port <= 0 || raw_port > INT_MAX)
-        FAIL();
-
-    *port_p = (int) raw_port;
-}
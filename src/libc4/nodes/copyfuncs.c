@@ -17,7 +17,7 @@ copy_define(AstDefine *in, apr_pool_t *p)
 static AstTimer *
 copy_ast_timer(AstTimer *in, apr_pool_t *p)
 {
-    return make_ast_timer(in->name, in->period, p);
+    return make_ast_timer(in->name, in->period, in->policy, p);
 }
 
 static AstSchemaElt *
@@ -110,8 +110,17 @@ copy_project_plan(ProjectPlan *in, apr_pool_t *p)
 static ScanPlan *
 copy_scan_plan(ScanPlan *in, apr_pool_t *p)
 {
-    return make_scan_plan(in->scan_rel, in->plan.quals, in->plan.qual_exprs,
-                          in->plan.proj_list, p);
+    ScanPlan *result;
+
+    result = make_scan_plan(in->scan_rel, in->plan.quals, in->plan.qual_exprs,
+                            in->plan.proj_list, in->index_cols,
+                            in->index_exprs, p);
+    result->range_col = in->range_col;
+    result->range_lower = copy_node(in->range_lower, p);
+    result->range_lower_incl = in->range_lower_incl;
+    result->range_upper = copy_node(in->range_upper, p);
+    result->range_upper_incl = in->range_upper_incl;
+    return result;
 }
 
 static ExprOp *
@@ -28,12 +28,14 @@ make_define(const char *name, AstStorageKind storage,
 }
 
 AstTimer *
-make_ast_timer(const char *name, apr_int64_t period, apr_pool_t *p)
+make_ast_timer(const char *name, apr_int64_t period, AstTimerPolicy policy,
+               apr_pool_t *p)
 {
     AstTimer *result = apr_pcalloc(p, sizeof(*result));
     result->node.kind = AST_TIMER;
     result->name = apr_pstrdup(p, name);
     result->period = period;
+    result->policy = policy;
     return result;
 }
 
@@ -202,7 +204,8 @@ make_project_plan(List *proj_list, apr_pool_t *p)
 
 ScanPlan *
 make_scan_plan(AstJoinClause *scan_rel, List *quals, List *qual_exprs,
-               List *proj_list, apr_pool_t *p)
+               List *proj_list, List *index_cols, List *index_exprs,
+               apr_pool_t *p)
 {
     ScanPlan *result = apr_pcalloc(p, sizeof(*result));
     result->plan.node.kind = PLAN_SCAN;
@@ -211,6 +214,11 @@ make_scan_plan(AstJoinClause *scan_rel, List *quals, List *qual_exprs,
         result->plan.qual_exprs = list_copy_deep(qual_exprs, p);
     if (proj_list)
         result->plan.proj_list = list_copy_deep(proj_list, p);
+    if (index_cols)
+        result->index_cols = list_copy(index_cols, p);
+    if (index_exprs)
+        result->index_exprs = list_copy_deep(index_exprs, p);
+    result->range_col = -1;
     result->scan_rel = copy_node(scan_rel, p);
     return result;
 }
@@ -68,6 +68,9 @@ get_const_kind_str(AstConstKind c_kind)
         case AST_CONST_STRING:
             return "string";
 
+        case AST_CONST_ADDR:
+            return "addr";
+
         default:
             ERROR("Unrecognized const kind: %d", (int) c_kind);
     }
@@ -216,6 +219,8 @@ node_get_kind_str(C4Node *node)
             return "OperAgg";
         case OPER_FILTER:
             return "OperFilter";
+        case OPER_INDEX_SCAN:
+            return "OperIndexScan";
         case OPER_INSERT:
             return "OperInsert";
         case OPER_PROJECT:
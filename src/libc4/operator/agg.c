@@ -3,6 +3,7 @@
 #include "router.h"
 #include "parser/analyze.h"
 #include "nodes/copyfuncs.h"
+#include "util/hash_func.h"
 
 static bool add_new_tuple(Tuple *t, AggOperator *agg_op);
 static void agg_do_delete(Tuple *t, AggOperator *agg_op);
@@ -61,23 +62,59 @@ add_new_tuple(Tuple *t, AggOperator *agg_op)
     }
 }
 
+static Datum
+get_agg_output_val(AggGroupState *group, AggExprInfo *agg_info, int aggno)
+{
+    if (agg_info->desc->output_f)
+        return agg_info->desc->output_f(group->state_vals[aggno]);
+    else
+        return group->state_vals[aggno].d;
+}
+
+/*
+ * Does the group's current agg state yield a different output tuple than the
+ * one we emitted previously? Group columns can't change, so we only need to
+ * check the agg columns.
+ */
+static bool
+agg_output_changed(AggGroupState *group, AggOperator *agg_op)
+{
+    Schema *schema = agg_op->op.proj_schema;
+    int i;
+
+    if (group->output_tup == NULL)
+        return true;
+
+    for (i = 0; i < agg_op->num_aggs; i++)
+    {
+        AggExprInfo *agg_info = agg_op->agg_info[i];
+        int colno = agg_info->colno;
+        Datum d;
+
+        d = get_agg_output_val(group, agg_info, i);
+        if (!(schema->eq_funcs[colno])(d, tuple_get_val(group->output_tup,
+                                                        schema, colno)))
+            return true;
+    }
+
+    return false;
+}
+
 static void
 emit_agg_output(AggGroupState *group, AggOperator *agg_op)
 {
     C4Runtime *c4 = agg_op->op.chain->c4;
+    Tuple *old_tup;
     int i;
 
-    if (group->output_tup)
-    {
-        router_delete_tuple(c4->router, group->output_tup,
-                            agg_op->output_tbl);
-        tuple_unpin(group->output_tup, agg_op->op.proj_schema);
-    }
+    if (!agg_output_changed(group, agg_op))
+        return;
 
     /*
      * Note that because tuples are immutable, we can't overwrite the previous
      * output tuple in-place
      */
+    old_tup = group->output_tup;
     group->output_tup = tuple_make_empty(agg_op->op.proj_schema);
 
     /* Compute agg columns */
@@ -89,14 +126,11 @@ emit_agg_output(AggGroupState *group, AggOperator *agg_op)
         DataType type;
 
         agg_info = agg_op->agg_info[i];
-        if (agg_info->desc->output_f)
-            d = agg_info->desc->output_f(group->state_vals[i]);
-        else
-            d = group->state_vals[i].d;
-
+        d = get_agg_output_val(group, agg_info, i);
         colno = agg_info->colno;
         type = expr_get_type((C4Node *) agg_info->ast_expr);
-        group->output_tup->vals[colno] = datum_copy(d, type);
+        tuple_set_val(group->output_tup, agg_op->op.proj_schema, colno,
+                      datum_copy(d, type));
     }
 
     /* Copy over group columns: no need to recompute */
@@ -108,19 +142,83 @@ emit_agg_output(AggGroupState *group, AggOperator *agg_op)
 
         colno = agg_op->group_colnos[i];
         type = schema_get_type(agg_op->op.proj_schema, colno);
-        d = tuple_get_val(group->key, colno);
-        group->output_tup->vals[colno] = datum_copy(d, type);
+        d = tuple_get_val(group->key, agg_op->op.proj_schema, colno);
+        tuple_set_val(group->output_tup, agg_op->op.proj_schema, colno,
+                      datum_copy(d, type));
     }
 
-    router_insert_tuple(c4->router, group->output_tup,
-                        agg_op->output_tbl, true);
+    /* If the group had previous output, replace it via an update */
+    if (old_tup)
+    {
+        router_update_tuple(c4->router, old_tup, group->output_tup,
+                            agg_op->output_tbl, true);
+        tuple_unpin(old_tup, agg_op->op.proj_schema);
+    }
+    else
+        router_insert_derived_tuple(c4->router, group->output_tup,
+                                    agg_op->output_tbl);
+}
+
+/*
+ * Rather than emitting new output for a group whenever one of its input
+ * tuples changes, we mark the group as dirty; the output of all the dirty
+ * groups is emitted when the router calls agg_flush(), once the agg's
+ * inputs are quiescent.
+ */
+static void
+mark_group_dirty(AggGroupState *group, AggOperator *agg_op)
+{
+    if (group->dirty)
+        return;
+
+    if (agg_op->dirty_groups == NULL)
+        router_add_dirty_agg(agg_op->op.chain->c4->router, agg_op);
+
+    group->dirty = true;
+    group->next_dirty = agg_op->dirty_groups;
+    agg_op->dirty_groups = group;
+}
+
+static void
+init_agg_state(AggGroupState *group, Tuple *t, AggOperator *agg_op)
+{
+    int i;
+
+    for (i = 0; i < agg_op->num_aggs; i++)
+    {
+        AggExprInfo *agg_info;
+        Datum input_val;
+
+        agg_info = agg_op->agg_info[i];
+        input_val = tuple_get_val(t, agg_op->op.proj_schema,
+                                  agg_info->colno);
+        if (agg_info->desc->init_f)
+            group->state_vals[i] = agg_info->desc->init_f(input_val,
+                                                          agg_op, i);
+        else
+            group->state_vals[i].d = input_val;
+    }
+}
+
+static void
+shutdown_agg_state(AggGroupState *group, AggOperator *agg_op)
+{
+    int i;
+
+    for (i = 0; i < agg_op->num_aggs; i++)
+    {
+        AggExprInfo *agg_info;
+
+        agg_info = agg_op->agg_info[i];
+        if (agg_info->desc->shutdown_f)
+            agg_info->desc->shutdown_f(group->state_vals[i]);
+    }
 }
 
 static void
 create_agg_group(Tuple *t, AggOperator *agg_op)
 {
     AggGroupState *new_group;
-    int i;
 
     if (agg_op->free_groups != NULL)
     {
@@ -136,41 +234,23 @@ create_agg_group(Tuple *t, AggOperator *agg_op)
 
     new_group->output_tup = NULL;
     new_group->count = 1;
+    new_group->dirty = false;
+    new_group->next_dirty = NULL;
     new_group->key = t;
     tuple_pin(new_group->key);
-    for (i = 0; i < agg_op->num_aggs; i++)
-    {
-        AggExprInfo *agg_info;
-        Datum input_val;
-
-        agg_info = agg_op->agg_info[i];
-        input_val = tuple_get_val(t, agg_info->colno);
-        if (agg_info->desc->init_f)
-            new_group->state_vals[i] = agg_info->desc->init_f(input_val,
-                                                              agg_op, i);
-        else
-            new_group->state_vals[i].d = input_val;
-    }
+    init_agg_state(new_group, t, agg_op);
 
     c4_hash_set(agg_op->group_tbl, t, new_group);
-    emit_agg_output(new_group, agg_op);
+    mark_group_dirty(new_group, agg_op);
 }
 
 static void
 free_agg_group(AggGroupState *group, AggOperator *agg_op)
 {
-    int i;
-
-    for (i = 0; i < agg_op->num_aggs; i++)
-    {
-        AggExprInfo *agg_info;
-
-        agg_info = agg_op->agg_info[i];
-        if (agg_info->desc->shutdown_f)
-            agg_info->desc->shutdown_f(group->state_vals[i]);
-    }
+    shutdown_agg_state(group, agg_op);
 
-    tuple_unpin(group->output_tup, agg_op->op.proj_schema);
+    if (group->output_tup)
+        tuple_unpin(group->output_tup, agg_op->op.proj_schema);
     tuple_unpin(group->key, agg_op->op.proj_schema);
     group->next = agg_op->free_groups;
     agg_op->free_groups = group;
@@ -186,7 +266,9 @@ remove_agg_group(AggGroupState *group, AggOperator *agg_op)
     if (!found)
         ERROR("Failed to re-find group for key");
 
-    router_delete_tuple(c4->router, group->output_tup, agg_op->output_tbl);
+    if (group->output_tup)
+        router_delete_tuple(c4->router, group->output_tup,
+                            agg_op->output_tbl);
     free_agg_group(group, agg_op);
 }
 
@@ -203,7 +285,8 @@ advance_agg_group(Tuple *t, bool forward,
         agg_trans_f trans_f;
 
         agg_info = agg_op->agg_info[i];
-        input_val = tuple_get_val(t, agg_info->colno);
+        input_val = tuple_get_val(t, agg_op->op.proj_schema,
+                                  agg_info->colno);
 
         if (forward)
             trans_f = agg_info->desc->fw_trans_f;
@@ -213,9 +296,14 @@ advance_agg_group(Tuple *t, bool forward,
         group->state_vals[i] = trans_f(group->state_vals[i], input_val);
     }
 
-    emit_agg_output(group, agg_op);
+    mark_group_dirty(group, agg_op);
 }
 
+/*
+ * If the last input tuple of a group is deleted, we keep the (empty) group
+ * until the next flush, so that the group's output is unchanged if a new
+ * input tuple for the group arrives in the meantime.
+ */
 static void
 agg_do_delete(Tuple *t, AggOperator *agg_op)
 {
@@ -225,10 +313,11 @@ agg_do_delete(Tuple *t, AggOperator *agg_op)
     if (agg_group == NULL)
         return;
 
+    ASSERT(agg_group->count > 0);
     agg_group->count--;
     if (agg_group->count == 0)
     {
-        remove_agg_group(agg_group, agg_op);
+        mark_group_dirty(agg_group, agg_op);
         return;
     }
 
@@ -247,10 +336,50 @@ agg_do_insert(Tuple *t, AggOperator *agg_op)
         return;
     }
 
+    /* Group is empty but not yet removed: restart its agg state */
+    if (agg_group->count == 0)
+    {
+        shutdown_agg_state(agg_group, agg_op);
+        init_agg_state(agg_group, t, agg_op);
+        agg_group->count = 1;
+        mark_group_dirty(agg_group, agg_op);
+        return;
+    }
+
     agg_group->count++;
     advance_agg_group(t, true, agg_group, agg_op);
 }
 
+/*
+ * Emit the output of each dirty group: empty groups are removed (deleting
+ * their previous output, if any), and other groups emit a delete/insert pair
+ * iff their output value has changed since the last flush. This is invoked
+ * by the router.
+ */
+void
+agg_flush(AggOperator *agg_op)
+{
+    AggGroupState *group;
+
+    group = agg_op->dirty_groups;
+    agg_op->dirty_groups = NULL;
+
+    while (group != NULL)
+    {
+        AggGroupState *next = group->next_dirty;
+
+        group->dirty = false;
+        group->next_dirty = NULL;
+
+        if (group->count == 0)
+            remove_agg_group(group, agg_op);
+        else
+            emit_agg_output(group, agg_op);
+
+        group = next;
+    }
+}
+
 static unsigned int
 group_tbl_hash(const char *key, int klen, void *data)
 {
@@ -260,7 +389,7 @@ group_tbl_hash(const char *key, int klen, void *data)
     unsigned int result;
 
     ASSERT(klen == sizeof(Tuple *));
-    result = 37;
+    result = 0;
     for (i = 0; i < agg_op->num_group_cols; i++)
     {
         int colno;
@@ -268,9 +397,9 @@ group_tbl_hash(const char *key, int klen, void *data)
         apr_uint32_t h;
 
         colno = agg_op->group_colnos[i];
-        val = tuple_get_val(t, colno);
+        val = tuple_get_val(t, agg_op->op.proj_schema, colno);
         h = (agg_op->op.proj_schema->hash_funcs[colno])(val);
-        result ^= h;
+        result = hash_combine(result, h);
     }
 
     return result;
@@ -293,8 +422,8 @@ group_tbl_cmp(const void *k1, const void *k2, int klen, void *data)
         bool result;
 
         colno = agg_op->group_colnos[i];
-        val1 = tuple_get_val(t1, colno);
-        val2 = tuple_get_val(t2, colno);
+        val1 = tuple_get_val(t1, agg_op->op.proj_schema, colno);
+        val2 = tuple_get_val(t2, agg_op->op.proj_schema, colno);
         result = (agg_op->op.proj_schema->eq_funcs[colno])(val1, val2);
         if (!result)
             return false;
@@ -432,7 +561,9 @@ agg_op_make(AggPlan *plan, OpChain *chain)
                                            (PlanNode *) plan,
                                            NULL,
                                            chain,
-                                           agg_invoke);
+                                           agg_invoke,
+                                           NULL,
+                                           NULL);
 
     agg_op->num_aggs = count_agg_exprs(plan->head);
     agg_op->agg_info = make_agg_info(agg_op->num_aggs, plan->head->cols,
@@ -449,6 +580,8 @@ agg_op_make(AggPlan *plan, OpChain *chain)
     agg_op->tuple_set = rset_make(agg_op->op.pool, agg_op->op.proj_schema,
                                   tuple_hash_tbl, tuple_cmp_tbl);
     agg_op->free_groups = NULL;
+    agg_op->dirty_groups = NULL;
+    agg_op->next_dirty_agg = NULL;
     agg_op->output_tbl = cat_get_table(chain->c4->cat, plan->head->name);
 
     /*
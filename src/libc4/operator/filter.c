@@ -2,22 +2,64 @@
 #include "operator/filter.h"
 
 static void
-filter_invoke(Operator *op, Tuple *t)
+filter_invoke_batch(Operator *op, Tuple **batch, int nbatch)
 {
     FilterOperator *filter_op = (FilterOperator *) op;
     ExprEvalContext *exec_cxt;
+    int nout;
+    int i;
 
     exec_cxt = filter_op->op.exec_cxt;
-    exec_cxt->inner = t;
 
     /*
-     * Only route the tuple onward if it passes all the quals. Note that
+     * Only route tuples onward if they pass all the quals. Note that
      * although OPER_FILTER has a projection list, we don't actually do any
      * projection: the planner ensures that the associated projection list
-     * just preserves the input to the filter.
+     * just preserves the input to the filter. Hence the output batch just
+     * contains the caller's tuples, so we don't need to pin them.
      */
-    if (eval_qual_set(filter_op->nquals, filter_op->qual_ary))
-        op->next->invoke(op->next, t);
+    nout = 0;
+    for (i = 0; i < nbatch; i++)
+    {
+        exec_cxt->inner = batch[i];
+
+        if (eval_qual_set(filter_op->nquals, filter_op->qual_ary))
+            op->batch_buf[nout++] = batch[i];
+    }
+
+    if (nout > 0)
+        op->next->invoke_batch(op->next, op->batch_buf, nout);
+}
+
+static void
+filter_invoke(Operator *op, Tuple *t)
+{
+    filter_invoke_batch(op, &t, 1);
+}
+
+/*
+ * If both the old and new tuples pass the quals, pass the update onward;
+ * if only one of them does, pass on just that half of the update.
+ */
+static void
+filter_invoke_update(Operator *op, Tuple *old_t, Tuple *new_t)
+{
+    FilterOperator *filter_op = (FilterOperator *) op;
+    ExprEvalContext *exec_cxt = op->exec_cxt;
+    bool old_passes;
+    bool new_passes;
+
+    exec_cxt->inner = old_t;
+    old_passes = eval_qual_set(filter_op->nquals, filter_op->qual_ary);
+    exec_cxt->inner = new_t;
+    new_passes = eval_qual_set(filter_op->nquals, filter_op->qual_ary);
+
+    if (old_passes && new_passes)
+        op->next->invoke_update(op->next, old_t, new_t);
+    else if (old_passes)
+        operator_invoke_delta(op->next, old_t, true);
+    else if (new_passes)
+        operator_invoke_delta(op->next, new_t, false);
 }
 
 FilterOperator *
@@ -32,7 +74,9 @@ filter_op_make(FilterPlan *plan, Operator *next_op, OpChain *chain)
                                                  (PlanNode *) plan,
                                                  next_op,
                                                  chain,
-                                                 filter_invoke);
+                                                 filter_invoke,
+                                                 filter_invoke_batch,
+                                                 filter_invoke_update);
 
     filter_op->nquals = list_length(filter_op->op.plan->quals);
     filter_op->qual_ary = apr_palloc(filter_op->op.pool,
@@ -44,6 +88,7 @@ filter_op_make(FilterPlan *plan, Operator *next_op, OpChain *chain)
 
         filter_op->qual_ary[i++] = make_expr_state(expr,
                                                    filter_op->op.exec_cxt,
+                                                   chain->c4,
                                                    filter_op->op.pool);
     }
 
@@ -0,0 +1,238 @@
+#include "c4-internal.h"
+#include "operator/index_scan.h"
+#include "storage/mem_table.h"
+
+/*
+ * Add a new join tuple to the operator's output batch, flushing the batch if
+ * it is full. Returns the new size of the output batch.
+ */
+static int
+index_scan_emit(Operator *op, int nout)
+{
+    op->batch_buf[nout++] = operator_do_project(op);
+    if (nout == OP_BATCH_SIZE)
+    {
+        operator_flush_batch(op, nout);
+        nout = 0;
+    }
+
+    return nout;
+}
+
+/*
+ * Check a candidate tuple from the index against the scan's quals, adding a
+ * join tuple to the output batch if it matches. Returns false if the scan of
+ * the index is complete; that is, if this is an anti-scan and we found a
+ * matching tuple.
+ */
+static bool
+index_scan_check(IndexScanOperator *scan_op, Tuple *scan_tuple, int *nout)
+{
+    scan_op->op.exec_cxt->outer = scan_tuple;
+
+    if (!eval_qual_set(scan_op->nquals, scan_op->qual_ary))
+        return true;
+
+    /* If this is NOT and we see a matching tuple, we're done */
+    if (scan_op->anti_scan)
+        return false;
+
+    *nout = index_scan_emit(&scan_op->op, *nout);
+    return true;
+}
+
+/*
+ * Probe the index for the current input tuple. Returns true if at least one
+ * tuple in the index satisfied the quals (only tracked for anti-scans).
+ */
+static bool
+index_scan_probe(IndexScanOperator *scan_op, int *nout)
+{
+    /* Key and bound exprs only reference the input tuple */
+    if (scan_op->hash_index != NULL)
+    {
+        HashIndexEntry *entry;
+        int i;
+
+        for (i = 0; i < scan_op->nkeys; i++)
+            scan_op->key_vals[i] = eval_expr(scan_op->key_ary[i]);
+
+        entry = hash_index_probe(scan_op->hash_index, scan_op->key_vals);
+        for (; entry != NULL; entry = entry->next)
+        {
+            if (!index_scan_check(scan_op, entry->tuple, nout))
+                return true;
+        }
+    }
+    else
+    {
+        /* Initialized to keep the compiler from warning */
+        Datum lower = { .i8 = 0 };
+        Datum upper = { .i8 = 0 };
+        Tuple *scan_tuple;
+
+        if (scan_op->lower_expr != NULL)
+            lower = eval_expr(scan_op->lower_expr);
+        if (scan_op->upper_expr != NULL)
+            upper = eval_expr(scan_op->upper_expr);
+
+        ordered_index_scan_reset(scan_op->ordered_index, scan_op->cursor,
+                                 scan_op->lower_expr ? &lower : NULL,
+                                 scan_op->lower_incl,
+                                 scan_op->upper_expr ? &upper : NULL,
+                                 scan_op->upper_incl);
+        while ((scan_tuple = ordered_index_scan_next(scan_op->ordered_index,
+                                                     scan_op->cursor)) != NULL)
+        {
+            if (!index_scan_check(scan_op, scan_tuple, nout))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+index_scan_invoke_batch(Operator *op, Tuple **batch, int nbatch)
+{
+    IndexScanOperator *scan_op = (IndexScanOperator *) op;
+    ExprEvalContext *exec_cxt;
+    int nout;
+    int i;
+
+    exec_cxt = scan_op->op.exec_cxt;
+    nout = 0;
+
+    for (i = 0; i < nbatch; i++)
+    {
+        bool found_match;
+
+        exec_cxt->inner = batch[i];
+        exec_cxt->outer = NULL;
+
+        found_match = index_scan_probe(scan_op, &nout);
+
+        /* If this is NOT and no matches, emit an output tuple */
+        if (scan_op->anti_scan && !found_match)
+        {
+            exec_cxt->outer = NULL;
+            nout = index_scan_emit(op, nout);
+        }
+    }
+
+    operator_flush_batch(op, nout);
+}
+
+static void
+index_scan_invoke(Operator *op, Tuple *t)
+{
+    index_scan_invoke_batch(op, &t, 1);
+}
+
+static ExprState **
+make_expr_ary(List *exprs, ExprEvalContext *cxt, C4Runtime *c4,
+              apr_pool_t *pool)
+{
+    ExprState **result;
+    ListCell *lc;
+    int i;
+
+    result = apr_palloc(pool, sizeof(*result) * list_length(exprs));
+    i = 0;
+    foreach (lc, exprs)
+    {
+        ExprNode *expr = (ExprNode *) lc_ptr(lc);
+
+        result[i++] = make_expr_state(expr, cxt, c4, pool);
+    }
+
+    return result;
+}
+
+static void
+setup_hash_probe(IndexScanOperator *scan_op, ScanPlan *plan, MemTable *table)
+{
+    apr_pool_t *pool = scan_op->op.pool;
+    int *key_colnos;
+    ListCell *lc;
+    int i;
+
+    scan_op->nkeys = list_length(plan->index_cols);
+    ASSERT(scan_op->nkeys == list_length(plan->index_exprs));
+    scan_op->key_ary = make_expr_ary(plan->index_exprs,
+                                     scan_op->op.exec_cxt,
+                                     scan_op->op.chain->c4, pool);
+    scan_op->key_vals = apr_palloc(pool,
+                                   sizeof(*scan_op->key_vals) * scan_op->nkeys);
+
+    key_colnos = apr_palloc(pool, sizeof(*key_colnos) * scan_op->nkeys);
+    i = 0;
+    foreach (lc, plan->index_cols)
+    {
+        key_colnos[i++] = lc_int(lc);
+    }
+
+    scan_op->hash_index = mem_table_add_hash_index(table, scan_op->nkeys,
+                                                   key_colnos);
+}
+
+static void
+setup_range_scan(IndexScanOperator *scan_op, ScanPlan *plan, MemTable *table)
+{
+    apr_pool_t *pool = scan_op->op.pool;
+
+    ASSERT(plan->range_col != -1);
+    if (plan->range_lower != NULL)
+        scan_op->lower_expr = make_expr_state(plan->range_lower,
+                                              scan_op->op.exec_cxt,
+                                              scan_op->op.chain->c4, pool);
+    scan_op->lower_incl = plan->range_lower_incl;
+    if (plan->range_upper != NULL)
+        scan_op->upper_expr = make_expr_state(plan->range_upper,
+                                              scan_op->op.exec_cxt,
+                                              scan_op->op.chain->c4, pool);
+    scan_op->upper_incl = plan->range_upper_incl;
+
+    scan_op->cursor = apr_pcalloc(pool, sizeof(*scan_op->cursor));
+    scan_op->cursor->pool = pool;
+    scan_op->ordered_index = mem_table_add_ordered_index(table,
+                                                         plan->range_col);
+}
+
+IndexScanOperator *
+index_scan_op_make(ScanPlan *plan, Operator *next_op, OpChain *chain)
+{
+    IndexScanOperator *scan_op;
+    AbstractTable *table;
+
+    scan_op = (IndexScanOperator *) operator_make(OPER_INDEX_SCAN,
+                                                  sizeof(*scan_op),
+                                                  (PlanNode *) plan,
+                                                  next_op,
+                                                  chain,
+                                                  index_scan_invoke,
+                                                  index_scan_invoke_batch,
+                                                  NULL);
+
+    table = cat_get_table_impl(chain->c4->cat, plan->scan_rel->ref->name);
+    if (table->def->storage != AST_STORAGE_MEMORY)
+        ERROR("Index scans are only supported for memory tables");
+
+    scan_op->anti_scan = plan->scan_rel->not;
+    scan_op->op.exec_cxt->outer_schema = table->def->schema;
+    scan_op->nquals = list_length(scan_op->op.plan->quals);
+    scan_op->qual_ary = make_expr_ary(scan_op->op.plan->qual_exprs,
+                                      scan_op->op.exec_cxt, chain->c4,
+                                      scan_op->op.pool);
+
+    /* Use the operator's copy of the plan, not the caller's */
+    plan = (ScanPlan *) scan_op->op.plan;
+
+    /* Prefer a hash probe over a range scan */
+    if (!list_is_empty(plan->index_cols))
+        setup_hash_probe(scan_op, plan, (MemTable *) table);
+    else
+        setup_range_scan(scan_op, plan, (MemTable *) table);
+
+    return scan_op;
+}
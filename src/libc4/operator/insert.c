@@ -11,7 +11,36 @@ insert_invoke(Operator *op, Tuple *t)
     if (router_is_deleting(c4->router))
         router_delete_tuple(c4->router, t, insert_op->tbl_def);
     else
-        router_insert_tuple(c4->router, t, insert_op->tbl_def, true);
+        router_insert_derived_tuple(c4->router, t, insert_op->tbl_def);
+}
+
+static void
+insert_invoke_batch(Operator *op, Tuple **batch, int nbatch)
+{
+    C4Runtime *c4 = op->chain->c4;
+    InsertOperator *insert_op = (InsertOperator *) op;
+    int i;
+
+    if (router_is_deleting(c4->router))
+    {
+        for (i = 0; i < nbatch; i++)
+            router_delete_tuple(c4->router, batch[i], insert_op->tbl_def);
+    }
+    else
+    {
+        for (i = 0; i < nbatch; i++)
+            router_insert_derived_tuple(c4->router, batch[i],
+                                        insert_op->tbl_def);
+    }
+}
+
+static void
+insert_invoke_update(Operator *op, Tuple *old_t, Tuple *new_t)
+{
+    C4Runtime *c4 = op->chain->c4;
+    InsertOperator *insert_op = (InsertOperator *) op;
+
+    router_update_tuple(c4->router, old_t, new_t, insert_op->tbl_def, true);
 }
 
 InsertOperator *
@@ -26,7 +55,9 @@ insert_op_make(InsertPlan *plan, OpChain *chain)
                                                  (PlanNode *) plan,
                                                  NULL,
                                                  chain,
-                                                 insert_invoke);
+                                                 insert_invoke,
+                                                 insert_invoke_batch,
+                                                 insert_invoke_update);
 
     insert_op->tbl_def = cat_get_table(chain->c4->cat, plan->head->name);
 
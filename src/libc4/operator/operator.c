@@ -1,11 +1,53 @@
 #include "c4-internal.h"
 #include "nodes/copyfuncs.h"
 #include "operator/operator.h"
+#include "router.h"
+
+/*
+ * Default batch invocation method: invoke the operator on each tuple of the
+ * batch in turn.
+ */
+static void
+operator_invoke_batch(Operator *op, Tuple **batch, int nbatch)
+{
+    int i;
+
+    for (i = 0; i < nbatch; i++)
+        op->invoke(op, batch[i]);
+}
+
+/*
+ * Default update invocation method: invoke the operator on a deletion of the
+ * old tuple, followed by an insertion of the new tuple.
+ */
+static void
+operator_invoke_update(Operator *op, Tuple *old_t, Tuple *new_t)
+{
+    operator_invoke_delta(op, old_t, true);
+    operator_invoke_delta(op, new_t, false);
+}
+
+/*
+ * Invoke the operator on a single insertion or deletion, while we're in the
+ * midst of routing an update down a (non-anti) op chain.
+ */
+void
+operator_invoke_delta(Operator *op, Tuple *t, bool is_delete)
+{
+    C4Router *router = op->chain->c4->router;
+
+    ASSERT(!op->chain->anti_chain);
+    router_set_deleting(router, is_delete);
+    op->invoke(op, t);
+    router_set_deleting(router, false);
+}
 
 Operator *
 operator_make(C4NodeKind kind, apr_size_t sz, PlanNode *plan,
               Operator *next_op, OpChain *chain,
-              op_invoke_func invoke_f)
+              op_invoke_func invoke_f,
+              op_invoke_batch_func invoke_batch_f,
+              op_invoke_update_func invoke_update_f)
 {
     apr_pool_t *pool = chain->pool;
     Operator *op;
@@ -20,6 +62,16 @@ operator_make(C4NodeKind kind, apr_size_t sz, PlanNode *plan,
     op->chain = chain;
     op->exec_cxt = apr_pcalloc(pool, sizeof(*op->exec_cxt));
     op->invoke = invoke_f;
+    if (invoke_batch_f != NULL)
+        op->invoke_batch = invoke_batch_f;
+    else
+        op->invoke_batch = operator_invoke_batch;
+    if (invoke_update_f != NULL)
+        op->invoke_update = invoke_update_f;
+    else
+        op->invoke_update = operator_invoke_update;
+    if (next_op != NULL)
+        op->batch_buf = apr_palloc(pool, sizeof(Tuple *) * OP_BATCH_SIZE);
 
     op->nproj = list_length(op->plan->proj_list);
     op->proj_ary = apr_palloc(pool, sizeof(ExprState *) * op->nproj);
@@ -29,7 +81,8 @@ operator_make(C4NodeKind kind, apr_size_t sz, PlanNode *plan,
     {
         ExprNode *expr = (ExprNode *) lc_ptr(lc);
 
-        op->proj_ary[i++] = make_expr_state(expr, op->exec_cxt, pool);
+        op->proj_ary[i++] = make_expr_state(expr, op->exec_cxt, chain->c4,
+                                            pool);
     }
 
     op->proj_schema = schema_make_from_exprs(op->nproj, op->proj_ary,
@@ -51,12 +104,33 @@ operator_do_project(Operator *op)
         Datum result;
 
         result = eval_expr(proj_state);
-        proj_tuple->vals[i] = datum_copy(result, proj_state->expr->type);
+        tuple_set_val(proj_tuple, op->proj_schema, i,
+                      datum_copy(result, proj_state->expr->type));
     }
 
     return proj_tuple;
 }
 
+/*
+ * Pass the first "nbatch" tuples in the operator's output batch to the next
+ * operator in the chain, and then release our pins on them. This should only
+ * be used when the tuples in the batch were created by this operator (e.g.
+ * via operator_do_project()).
+ */
+void
+operator_flush_batch(Operator *op, int nbatch)
+{
+    int i;
+
+    if (nbatch == 0)
+        return;
+
+    op->next->invoke_batch(op->next, op->batch_buf, nbatch);
+
+    for (i = 0; i < nbatch; i++)
+        tuple_unpin(op->batch_buf[i], op->proj_schema);
+}
+
 OpChainList *
 opchain_list_make(apr_pool_t *pool)
 {
@@ -65,6 +139,7 @@ opchain_list_make(apr_pool_t *pool)
     result = apr_palloc(pool, sizeof(*result));
     result->length = 0;
     result->head = NULL;
+    result->self_join = false;
 
     return result;
 }
@@ -77,4 +152,6 @@ opchain_list_add(OpChainList *list, OpChain *op_chain)
     op_chain->next = list->head;
     list->head = op_chain;
     list->length++;
+    if (op_chain->self_join)
+        list->self_join = true;
 }
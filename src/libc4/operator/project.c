@@ -2,17 +2,49 @@
 #include "operator/project.h"
 
 static void
-project_invoke(Operator *op, Tuple *t)
+project_invoke_batch(Operator *op, Tuple **batch, int nbatch)
 {
     ExprEvalContext *exec_cxt;
-    Tuple *proj_tuple;
+    int i;
 
     exec_cxt = op->exec_cxt;
-    exec_cxt->inner = t;
 
-    proj_tuple = operator_do_project(op);
-    op->next->invoke(op->next, proj_tuple);
-    tuple_unpin(proj_tuple, op->proj_schema);
+    for (i = 0; i < nbatch; i++)
+    {
+        exec_cxt->inner = batch[i];
+        op->batch_buf[i] = operator_do_project(op);
+    }
+
+    operator_flush_batch(op, nbatch);
+}
+
+static void
+project_invoke(Operator *op, Tuple *t)
+{
+    project_invoke_batch(op, &t, 1);
+}
+
+/*
+ * If the update doesn't change any of the projected columns, it has no
+ * effect on the rest of the op chain.
+ */
+static void
+project_invoke_update(Operator *op, Tuple *old_t, Tuple *new_t)
+{
+    ExprEvalContext *exec_cxt = op->exec_cxt;
+    Tuple *old_proj;
+    Tuple *new_proj;
+
+    exec_cxt->inner = old_t;
+    old_proj = operator_do_project(op);
+    exec_cxt->inner = new_t;
+    new_proj = operator_do_project(op);
+
+    if (!tuple_equal(old_proj, new_proj, op->proj_schema))
+        op->next->invoke_update(op->next, old_proj, new_proj);
+
+    tuple_unpin(old_proj, op->proj_schema);
+    tuple_unpin(new_proj, op->proj_schema);
 }
 
 ProjectOperator *
@@ -27,7 +59,9 @@ project_op_make(ProjectPlan *plan, Operator *next_op, OpChain *chain)
                                                 (PlanNode *) plan,
                                                 next_op,
                                                 chain,
-                                                project_invoke);
+                                                project_invoke,
+                                                project_invoke_batch,
+                                                project_invoke_update);
 
     return proj_op;
 }
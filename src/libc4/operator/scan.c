@@ -1,16 +1,222 @@
 #include "c4-internal.h"
 #include "operator/scan.h"
 #include "operator/scancursor.h"
+#include "util/hash_func.h"
 
-static void
-scan_invoke(Operator *op, Tuple *t)
+/*
+ * Add a new join tuple to the operator's output batch, flushing the batch if
+ * it is full. Returns the new size of the output batch.
+ */
+static int
+scan_emit(Operator *op, int nout)
+{
+    op->batch_buf[nout++] = operator_do_project(op);
+    if (nout == OP_BATCH_SIZE)
+    {
+        operator_flush_batch(op, nout);
+        nout = 0;
+    }
+
+    return nout;
+}
+
+/*
+ * Emit an output tuple for each entry of the batch that didn't match any
+ * tuple in the scan relation. Only used for anti-scans.
+ */
+static int
+scan_emit_unmatched(ScanOperator *scan_op, int nbatch, int nout)
+{
+    ExprEvalContext *exec_cxt = scan_op->op.exec_cxt;
+    int i;
+
+    exec_cxt->outer = NULL;
+    for (i = 0; i < nbatch; i++)
+    {
+        ScanBatchEntry *entry = &scan_op->batch_entries[i];
+
+        if (entry->matched)
+            continue;
+
+        exec_cxt->inner = entry->tuple;
+        nout = scan_emit(&scan_op->op, nout);
+    }
+
+    return nout;
+}
+
+static apr_uint32_t
+scan_key_hash(ScanOperator *scan_op, Datum *key)
+{
+    Schema *schema = scan_op->table->def->schema;
+    apr_uint32_t result;
+    int i;
+
+    result = 0;
+    for (i = 0; i < scan_op->nkeys; i++)
+    {
+        int colno = scan_op->key_colnos[i];
+
+        result = hash_combine(result, (schema->hash_funcs[colno])(key[i]));
+    }
+
+    return result;
+}
+
+static bool
+scan_key_matches(ScanOperator *scan_op, Datum *key, Tuple *scan_tuple)
+{
+    Schema *schema = scan_op->table->def->schema;
+    int i;
+
+    for (i = 0; i < scan_op->nkeys; i++)
+    {
+        int colno = scan_op->key_colnos[i];
+
+        if (!(schema->eq_funcs[colno])(key[i],
+                                       tuple_get_val(scan_tuple, schema,
+                                                     colno)))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Join a batch of input tuples with the scan relation by building a
+ * transient hash table over the batch on the join keys, and then probing it
+ * with each tuple of the scan relation. Hence we scan the relation once per
+ * batch, rather than once per input tuple.
+ */
+static int
+scan_hash_join_batch(ScanOperator *scan_op, Tuple **batch, int nbatch,
+                     int nout)
 {
-    ScanOperator *scan_op = (ScanOperator *) op;
     AbstractTable *tbl = scan_op->table;
-    ExprEvalContext *exec_cxt;
+    ExprEvalContext *exec_cxt = scan_op->op.exec_cxt;
+    Datum *scan_key;
+    Tuple *scan_tuple;
+    int i;
+
+    memset(scan_op->batch_buckets, 0,
+           sizeof(*scan_op->batch_buckets) * SCAN_BATCH_NBUCKETS);
+
+    /* Build phase: key exprs only reference the input tuple */
+    for (i = 0; i < nbatch; i++)
+    {
+        ScanBatchEntry *entry = &scan_op->batch_entries[i];
+        int bucketno;
+        int j;
+
+        exec_cxt->inner = batch[i];
+        exec_cxt->outer = NULL;
+        for (j = 0; j < scan_op->nkeys; j++)
+            entry->key[j] = eval_expr(scan_op->key_ary[j]);
+
+        entry->tuple = batch[i];
+        entry->matched = false;
+        entry->hash = scan_key_hash(scan_op, entry->key);
+        bucketno = entry->hash & (SCAN_BATCH_NBUCKETS - 1);
+        entry->next = scan_op->batch_buckets[bucketno];
+        scan_op->batch_buckets[bucketno] = entry;
+    }
+
+    /* Probe phase */
+    scan_key = scan_op->batch_entries[nbatch].key;
+    tbl->scan_reset(tbl, scan_op->cursor);
+    while ((scan_tuple = tbl->scan_next(tbl, scan_op->cursor)) != NULL)
+    {
+        ScanBatchEntry *entry;
+        apr_uint32_t hash;
+
+        for (i = 0; i < scan_op->nkeys; i++)
+            scan_key[i] = tuple_get_val(scan_tuple, tbl->def->schema,
+                                        scan_op->key_colnos[i]);
+
+        hash = scan_key_hash(scan_op, scan_key);
+        entry = scan_op->batch_buckets[hash & (SCAN_BATCH_NBUCKETS - 1)];
+        for (; entry != NULL; entry = entry->next)
+        {
+            if (entry->hash != hash || entry->matched ||
+                !scan_key_matches(scan_op, entry->key, scan_tuple))
+                continue;
+
+            exec_cxt->inner = entry->tuple;
+            exec_cxt->outer = scan_tuple;
+            if (!eval_qual_set(scan_op->nquals, scan_op->qual_ary))
+                continue;
+
+            /* For NOT, remember the match; we're done with this input */
+            if (scan_op->anti_scan)
+                entry->matched = true;
+            else
+                nout = scan_emit(&scan_op->op, nout);
+        }
+    }
+
+    if (scan_op->anti_scan)
+        nout = scan_emit_unmatched(scan_op, nbatch, nout);
+
+    return nout;
+}
+
+/*
+ * Join a batch of input tuples with the scan relation when there are no
+ * equality quals: we still only scan the relation once, comparing each tuple
+ * of the relation with every input tuple in the batch.
+ */
+static int
+scan_nestloop_batch(ScanOperator *scan_op, Tuple **batch, int nbatch,
+                    int nout)
+{
+    AbstractTable *tbl = scan_op->table;
+    ExprEvalContext *exec_cxt = scan_op->op.exec_cxt;
+    Tuple *scan_tuple;
+    int i;
+
+    for (i = 0; i < nbatch; i++)
+    {
+        scan_op->batch_entries[i].tuple = batch[i];
+        scan_op->batch_entries[i].matched = false;
+    }
+
+    tbl->scan_reset(tbl, scan_op->cursor);
+    while ((scan_tuple = tbl->scan_next(tbl, scan_op->cursor)) != NULL)
+    {
+        exec_cxt->outer = scan_tuple;
+
+        for (i = 0; i < nbatch; i++)
+        {
+            ScanBatchEntry *entry = &scan_op->batch_entries[i];
+
+            if (entry->matched)
+                continue;
+
+            exec_cxt->inner = entry->tuple;
+            if (!eval_qual_set(scan_op->nquals, scan_op->qual_ary))
+                continue;
+
+            /* For NOT, remember the match; we're done with this input */
+            if (scan_op->anti_scan)
+                entry->matched = true;
+            else
+                nout = scan_emit(&scan_op->op, nout);
+        }
+    }
+
+    if (scan_op->anti_scan)
+        nout = scan_emit_unmatched(scan_op, nbatch, nout);
+
+    return nout;
+}
+
+static int
+scan_one(ScanOperator *scan_op, Tuple *t, int nout)
+{
+    AbstractTable *tbl = scan_op->table;
+    ExprEvalContext *exec_cxt = scan_op->op.exec_cxt;
     Tuple *scan_tuple;
 
-    exec_cxt = scan_op->op.exec_cxt;
     exec_cxt->inner = t;
 
     tbl->scan_reset(tbl, scan_op->cursor);
@@ -20,26 +226,86 @@ scan_invoke(Operator *op, Tuple *t)
 
         if (eval_qual_set(scan_op->nquals, scan_op->qual_ary))
         {
-            Tuple *join_tuple;
-
             /* If this is NOT and we see a matching tuple, we're done */
             if (scan_op->anti_scan)
-                return;
+                return nout;
 
-            join_tuple = operator_do_project(op);
-            op->next->invoke(op->next, join_tuple);
+            nout = scan_emit(&scan_op->op, nout);
         }
     }
 
     /* If this is NOT and no matches, emit an output tuple */
     if (scan_op->anti_scan)
     {
-        Tuple *join_tuple;
-
         exec_cxt->outer = NULL;
-        join_tuple = operator_do_project(op);
-        op->next->invoke(op->next, join_tuple);
+        nout = scan_emit(&scan_op->op, nout);
+    }
+
+    return nout;
+}
+
+static void
+scan_invoke_batch(Operator *op, Tuple **batch, int nbatch)
+{
+    ScanOperator *scan_op = (ScanOperator *) op;
+    int nout;
+
+    if (nbatch == 1)
+        nout = scan_one(scan_op, batch[0], 0);
+    else if (scan_op->nkeys > 0)
+        nout = scan_hash_join_batch(scan_op, batch, nbatch, 0);
+    else
+        nout = scan_nestloop_batch(scan_op, batch, nbatch, 0);
+
+    operator_flush_batch(op, nout);
+}
+
+static void
+scan_invoke(Operator *op, Tuple *t)
+{
+    scan_invoke_batch(op, &t, 1);
+}
+
+static void
+setup_batch_state(ScanOperator *scan_op, ScanPlan *plan)
+{
+    apr_pool_t *pool = scan_op->op.pool;
+    ListCell *lc;
+    int i;
+
+    scan_op->nkeys = list_length(plan->index_cols);
+    ASSERT(scan_op->nkeys == list_length(plan->index_exprs));
+    scan_op->key_colnos = apr_palloc(pool,
+                                     sizeof(*scan_op->key_colnos) * scan_op->nkeys);
+    scan_op->key_ary = apr_palloc(pool,
+                                  sizeof(*scan_op->key_ary) * scan_op->nkeys);
+
+    i = 0;
+    foreach (lc, plan->index_cols)
+    {
+        scan_op->key_colnos[i++] = lc_int(lc);
     }
+
+    i = 0;
+    foreach (lc, plan->index_exprs)
+    {
+        ExprNode *expr = (ExprNode *) lc_ptr(lc);
+
+        scan_op->key_ary[i++] = make_expr_state(expr, scan_op->op.exec_cxt,
+                                                scan_op->op.chain->c4, pool);
+    }
+
+    /* One extra entry, used for the key of the current scan tuple */
+    scan_op->batch_entries = apr_palloc(pool,
+                                        sizeof(*scan_op->batch_entries) *
+                                        (OP_BATCH_SIZE + 1));
+    for (i = 0; i < OP_BATCH_SIZE + 1; i++)
+        scan_op->batch_entries[i].key = apr_palloc(pool,
+                                                   sizeof(Datum) * scan_op->nkeys);
+
+    scan_op->batch_buckets = apr_palloc(pool,
+                                        sizeof(*scan_op->batch_buckets) *
+                                        SCAN_BATCH_NBUCKETS);
 }
 
 ScanOperator *
@@ -55,12 +321,15 @@ scan_op_make(ScanPlan *plan, Operator *next_op, OpChain *chain)
                                              (PlanNode *) plan,
                                              next_op,
                                              chain,
-                                             scan_invoke);
+                                             scan_invoke,
+                                             scan_invoke_batch,
+                                             NULL);
 
     tbl_name = plan->scan_rel->ref->name;
     scan_op->table = cat_get_table_impl(chain->c4->cat, tbl_name);
     scan_op->cursor = scan_op->table->scan_make(scan_op->table, scan_op->op.pool);
     scan_op->anti_scan = plan->scan_rel->not;
+    scan_op->op.exec_cxt->outer_schema = scan_op->table->def->schema;
 
     scan_op->nquals = list_length(scan_op->op.plan->quals);
     scan_op->qual_ary = apr_palloc(scan_op->op.pool,
@@ -72,8 +341,12 @@ scan_op_make(ScanPlan *plan, Operator *next_op, OpChain *chain)
 
         scan_op->qual_ary[i++] = make_expr_state(expr,
                                                  scan_op->op.exec_cxt,
+                                                 chain->c4,
                                                  scan_op->op.pool);
     }
 
+    /* Use the operator's copy of the plan, not the caller's */
+    setup_batch_state(scan_op, (ScanPlan *) scan_op->op.plan);
+
     return scan_op;
 }
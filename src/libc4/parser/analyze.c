@@ -51,6 +51,7 @@ static void analyze_op_expr(AstOpExpr *op_expr, ExprLocation loc,
 static void analyze_var_expr(AstVarExpr *var_expr, ExprLocation loc,
                              AnalyzeState *state);
 static void analyze_const_expr(AstConstExpr *c_expr, AnalyzeState *state);
+static void coerce_const_expr(C4Node *expr, DataType target_type);
 static void analyze_agg_expr(AstAggExpr *a_expr, ExprLocation loc, AnalyzeState *state);
 static void analyze_rule_head(AstRule *rule, AnalyzeState *state);
 static void analyze_rule_location(AstRule *rule, AnalyzeState *state);
@@ -114,8 +115,8 @@ analyze_define(AstDefine *def, AnalyzeState *state)
 
             seen_loc_spec = true;
             type = get_type_id(elt->type_name);
-            if (type != TYPE_STRING)
-                ERROR("Location specifiers must be of type string");
+            if (type != TYPE_ADDR)
+                ERROR("Location specifiers must be of type addr");
         }
     }
 }
@@ -133,9 +134,15 @@ analyze_timer(AstTimer *timer, AnalyzeState *state)
     if (timer->period > (APR_INT64_MAX / 1000))
         ERROR("Period of timer %s is too large", timer->name);
 
-    /* Add an AstDefine for the timer table to the AST */
+    /*
+     * Add an AstDefine for the timer table to the AST. The first column is
+     * the deadline at which the timer fired; coalescing timers also record
+     * the number of elapsed periods.
+     */
     schema = list_make(state->pool);
     list_append(schema, make_schema_elt("int", false, state->pool));
+    if (timer->policy == AST_TIMER_COALESCE)
+        list_append(schema, make_schema_elt("int", false, state->pool));
 
     def = make_define(timer->name, AST_STORAGE_MEMORY, schema, state->pool);
     list_append(state->program->defines, def);
@@ -650,6 +657,11 @@ analyze_op_expr(AstOpExpr *op_expr, ExprLocation loc, AnalyzeState *state)
     }
 
     analyze_expr(op_expr->rhs, loc, state);
+
+    /* Allow addresses to be compared with string literals */
+    coerce_const_expr(op_expr->lhs, expr_get_type(op_expr->rhs));
+    coerce_const_expr(op_expr->rhs, lhs_type);
+    lhs_type = expr_get_type(op_expr->lhs);
     rhs_type = expr_get_type(op_expr->rhs);
 
     /* XXX: type compatibility check is far too strict */
@@ -724,6 +736,25 @@ analyze_const_expr(AstConstExpr *c_expr, AnalyzeState *state)
     ;
 }
 
+/*
+ * Network addresses are written as string literals, so a string constant
+ * that is used where an address is expected becomes an address constant.
+ * The planner parses the string when it evaluates the constant; host names
+ * are not resolved until they are needed.
+ */
+static void
+coerce_const_expr(C4Node *expr, DataType target_type)
+{
+    AstConstExpr *c_expr;
+
+    if (expr->kind != AST_CONST_EXPR || target_type != TYPE_ADDR)
+        return;
+
+    c_expr = (AstConstExpr *) expr;
+    if (c_expr->const_kind == AST_CONST_STRING)
+        c_expr->const_kind = AST_CONST_ADDR;
+}
+
 static void
 analyze_agg_expr(AstAggExpr *a_expr, ExprLocation loc, AnalyzeState *state)
 {
@@ -797,8 +828,9 @@ analyze_table_ref(AstTableRef *ref, ExprLocation loc, AnalyzeState *state)
         DataType schema_type;
 
         analyze_expr(expr, loc, state);
-        expr_type = expr_get_type(expr);
         schema_type = table_get_col_type(ref->name, colno, state);
+        coerce_const_expr(expr, schema_type);
+        expr_type = expr_get_type(expr);
 
         /* XXX: type compatibility check is far too strict */
         if (schema_type != expr_type)
@@ -1127,6 +1159,9 @@ const_expr_get_type(AstConstExpr *c_expr)
         case AST_CONST_STRING:
             return TYPE_STRING;
 
+        case AST_CONST_ADDR:
+            return TYPE_ADDR;
+
         default:
             ERROR("Unexpected const kind: %d", (int) c_expr->const_kind);
     }
@@ -13,6 +13,7 @@ static void split_program_clauses(List *clauses, List **defines, List **timers,
                                   List **facts, List **rules, apr_pool_t *pool);
 static void split_rule_body(List *body, List **joins,
                             List **quals, apr_pool_t *pool);
+static AstTimerPolicy parse_timer_policy(const char *name);
 %}
 
 %union
@@ -90,8 +91,12 @@ define:
 }
 ;
 
-timer: TIMER '(' TBL_IDENT ',' iconst_ival ')' {
-    $$ = make_ast_timer($3, $5, context->pool);
+timer:
+  TIMER '(' TBL_IDENT ',' iconst_ival ')' {
+    $$ = make_ast_timer($3, $5, AST_TIMER_FIRE_ALL, context->pool);
+}
+| TIMER '(' TBL_IDENT ',' iconst_ival ',' TBL_IDENT ')' {
+    $$ = make_ast_timer($3, $5, parse_timer_policy($7), context->pool);
 }
 ;
 
@@ -254,6 +259,20 @@ yyerror(C4Parser *context, void *scanner, const char *message)
     return 0;   /* return value ignored */
 }
 
+static AstTimerPolicy
+parse_timer_policy(const char *name)
+{
+    if (strcmp(name, "all") == 0)
+        return AST_TIMER_FIRE_ALL;
+    if (strcmp(name, "skip") == 0)
+        return AST_TIMER_SKIP;
+    if (strcmp(name, "coalesce") == 0)
+        return AST_TIMER_COALESCE;
+
+    ERROR("Unrecognized timer policy: %s", name);
+    return AST_TIMER_FIRE_ALL;  /* keep compiler quiet */
+}
+
 static void
 split_program_clauses(List *clauses, List **defines, List **timers,
                       List **facts, List **rules, apr_pool_t *pool)
@@ -0,0 +1,512 @@
+/*
+ * Ahead-of-time compilation of the expressions in a program's op chains.
+ * codegen_program() emits a C source file that contains a native function
+ * for each qualifier, projection and index key expression in the program,
+ * with the types of the expression inlined. The file is compiled into a
+ * shared library against the libc4 headers, e.g.
+ *
+ *    cc -shared -fPIC -I src/libc4/include $(apr-1-config --includes) \
+ *       prog_exprs.c -o prog_exprs.so
+ *
+ * and loaded into a runtime with codegen_load_library(). After that, when
+ * an operator makes an ExprState for an expression that has a compiled
+ * version (matched via its signature; see expr_get_signature()), the
+ * compiled function is used instead of the expression interpreter.
+ *
+ * Expressions whose result can't be computed without the runtime's help
+ * (string concatenation, string constants) are left to the interpreter,
+ * as are bare variables and constants, which the interpreter already
+ * evaluates without dispatch.
+ */
+#include <apr_dso.h>
+#include <math.h>
+
+#include "c4-internal.h"
+#include "planner/codegen.h"
+#include "types/catalog.h"
+#include "types/expr.h"
+
+typedef struct CodegenState
+{
+    apr_pool_t *pool;
+    /* Function definitions */
+    StrBuf *buf;
+    /* Entries of the c4_compiled_exprs array */
+    StrBuf *tbl_buf;
+    /* Signatures of the expressions we have already emitted */
+    apr_hash_t *seen;
+    int nexprs;
+} CodegenState;
+
+static const char *
+get_datum_field(DataType type)
+{
+    switch (type)
+    {
+        case TYPE_BOOL:
+            return "b";
+        case TYPE_CHAR:
+            return "c";
+        case TYPE_DOUBLE:
+            return "d8";
+        case TYPE_INT:
+        case TYPE_ADDR:
+            return "i8";
+        case TYPE_STRING:
+            return "s";
+
+        default:
+            ERROR("Unexpected type id: %d", type);
+    }
+}
+
+static const char *
+get_type_macro(DataType type)
+{
+    switch (type)
+    {
+        case TYPE_BOOL:
+            return "TYPE_BOOL";
+        case TYPE_CHAR:
+            return "TYPE_CHAR";
+        case TYPE_DOUBLE:
+            return "TYPE_DOUBLE";
+        case TYPE_INT:
+            return "TYPE_INT";
+        case TYPE_STRING:
+            return "TYPE_STRING";
+        case TYPE_ADDR:
+            return "TYPE_ADDR";
+
+        default:
+            ERROR("Unexpected type id: %d", type);
+    }
+}
+
+static bool
+is_comparison(AstOperKind op_kind)
+{
+    switch (op_kind)
+    {
+        case AST_OP_LT:
+        case AST_OP_LTE:
+        case AST_OP_GT:
+        case AST_OP_GTE:
+        case AST_OP_EQ:
+        case AST_OP_NEQ:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Can we emit native code for the expression? This must agree with the
+ * interpreter's choice of instruction for each operator (see expr.c).
+ */
+static bool
+expr_is_supported(ExprNode *expr)
+{
+    switch (expr->node.kind)
+    {
+        case EXPR_OP:
+            {
+                ExprOp *op_expr = (ExprOp *) expr;
+                DataType lhs_type = op_expr->lhs->type;
+
+                if (is_comparison(op_expr->op_kind))
+                {
+                    /*
+                     * We can only fetch strings from variables; see
+                     * gen_comparison()
+                     */
+                    if (lhs_type == TYPE_STRING)
+                        return (op_expr->lhs->node.kind == EXPR_VAR &&
+                                op_expr->rhs->node.kind == EXPR_VAR);
+
+                    return (expr_is_supported(op_expr->lhs) &&
+                            expr_is_supported(op_expr->rhs));
+                }
+
+                if (op_expr->op_kind == AST_OP_UMINUS)
+                    return (lhs_type == TYPE_INT &&
+                            expr_is_supported(op_expr->lhs));
+
+                if (lhs_type != op_expr->rhs->type)
+                    return false;
+                if (lhs_type == TYPE_DOUBLE &&
+                    (op_expr->op_kind == AST_OP_DIVIDE ||
+                     op_expr->op_kind == AST_OP_MODULUS))
+                    return false;
+                if (lhs_type != TYPE_INT && lhs_type != TYPE_DOUBLE)
+                    return false;
+
+                return (expr_is_supported(op_expr->lhs) &&
+                        expr_is_supported(op_expr->rhs));
+            }
+
+        case EXPR_VAR:
+            return (expr->type != TYPE_STRING);
+
+        case EXPR_CONST:
+            {
+                ExprConst *c_expr = (ExprConst *) expr;
+
+                if (expr->type == TYPE_DOUBLE)
+                    return isfinite(c_expr->value.d8);
+                /* Host IDs are local to the process (see util/host_tbl.h) */
+                if (expr->type == TYPE_ADDR)
+                    return !addr_is_named(c_expr->value);
+
+                return (expr->type != TYPE_STRING);
+            }
+
+        default:
+            return false;
+    }
+}
+
+static const char *
+get_c_operator(AstOperKind op_kind)
+{
+    switch (op_kind)
+    {
+        case AST_OP_PLUS:
+            return "+";
+        case AST_OP_MINUS:
+            return "-";
+        case AST_OP_TIMES:
+            return "*";
+        case AST_OP_DIVIDE:
+            return "/";
+        case AST_OP_MODULUS:
+            return "%";
+        case AST_OP_LT:
+            return "<";
+        case AST_OP_LTE:
+            return "<=";
+        case AST_OP_GT:
+            return ">";
+        case AST_OP_GTE:
+            return ">=";
+        case AST_OP_EQ:
+            return "==";
+        case AST_OP_NEQ:
+            return "!=";
+
+        default:
+            ERROR("Unexpected op kind: %d", (int) op_kind);
+    }
+}
+
+static void
+gen_var_datum(ExprVar *var, StrBuf *buf)
+{
+    const char *side = var->is_outer ? "outer" : "inner";
+
+    sbuf_appendf(buf, "tuple_get_val(state->cxt->%s, "
+                 "state->cxt->%s_schema, %d)", side, side, var->attno);
+}
+
+static void gen_value(ExprNode *expr, StrBuf *buf);
+
+/*
+ * Append a C expression that computes "expr" as a Datum.
+ */
+static void
+gen_datum(ExprNode *expr, StrBuf *buf)
+{
+    if (expr->node.kind == EXPR_VAR)
+    {
+        gen_var_datum((ExprVar *) expr, buf);
+        return;
+    }
+
+    sbuf_appendf(buf, "((Datum) { .%s = ", get_datum_field(expr->type));
+    gen_value(expr, buf);
+    sbuf_append(buf, " })");
+}
+
+/*
+ * Only ints are compared with C operators. Like the interpreter, we compare
+ * other types with datum_cmp() and datum_equal(), which don't order NaN the
+ * same way as the C operators on doubles.
+ */
+static void
+gen_comparison(ExprOp *op_expr, StrBuf *buf)
+{
+    const char *type_name = get_type_macro(op_expr->lhs->type);
+
+    switch (op_expr->op_kind)
+    {
+        case AST_OP_EQ:
+        case AST_OP_NEQ:
+            sbuf_append(buf, (op_expr->op_kind == AST_OP_EQ) ?
+                        "(datum_equal(" : "(!datum_equal(");
+            gen_datum(op_expr->lhs, buf);
+            sbuf_append(buf, ", ");
+            gen_datum(op_expr->rhs, buf);
+            sbuf_appendf(buf, ", %s))", type_name);
+            break;
+
+        default:
+            sbuf_append(buf, "(datum_cmp(");
+            gen_datum(op_expr->lhs, buf);
+            sbuf_append(buf, ", ");
+            gen_datum(op_expr->rhs, buf);
+            sbuf_appendf(buf, ", %s) %s 0)", type_name,
+                         get_c_operator(op_expr->op_kind));
+            break;
+    }
+}
+
+/*
+ * Append a C expression that computes the (unboxed) value of "expr".
+ */
+static void
+gen_value(ExprNode *expr, StrBuf *buf)
+{
+    switch (expr->node.kind)
+    {
+        case EXPR_OP:
+            {
+                ExprOp *op_expr = (ExprOp *) expr;
+
+                if (op_expr->op_kind == AST_OP_UMINUS)
+                {
+                    sbuf_append(buf, "(-");
+                    gen_value(op_expr->lhs, buf);
+                    sbuf_append_char(buf, ')');
+                }
+                else if (is_comparison(op_expr->op_kind) &&
+                         op_expr->lhs->type != TYPE_INT)
+                {
+                    gen_comparison(op_expr, buf);
+                }
+                else
+                {
+                    sbuf_append_char(buf, '(');
+                    gen_value(op_expr->lhs, buf);
+                    sbuf_appendf(buf, " %s ",
+                                 get_c_operator(op_expr->op_kind));
+                    gen_value(op_expr->rhs, buf);
+                    sbuf_append_char(buf, ')');
+                }
+            }
+            break;
+
+        case EXPR_VAR:
+            gen_var_datum((ExprVar *) expr, buf);
+            sbuf_appendf(buf, ".%s", get_datum_field(expr->type));
+            break;
+
+        case EXPR_CONST:
+            {
+                Datum value = ((ExprConst *) expr)->value;
+
+                switch (expr->type)
+                {
+                    case TYPE_BOOL:
+                        sbuf_append(buf, value.b ? "true" : "false");
+                        break;
+                    case TYPE_CHAR:
+                        sbuf_appendf(buf, "((unsigned char) %d)",
+                                     (int) value.c);
+                        break;
+                    case TYPE_DOUBLE:
+                        sbuf_appendf(buf, "((double) %.17g)", value.d8);
+                        break;
+                    case TYPE_INT:
+                    case TYPE_ADDR:
+                        if (value.i8 == APR_INT64_MIN)
+                            sbuf_append(buf, "INT64_MIN");
+                        else
+                            sbuf_appendf(buf, "INT64_C(%" APR_INT64_T_FMT ")",
+                                         value.i8);
+                        break;
+
+                    default:
+                        ERROR("Unexpected type id: %d", expr->type);
+                }
+            }
+            break;
+
+        default:
+            ERROR("Unexpected node kind: %d", (int) expr->node.kind);
+    }
+}
+
+static void
+append_c_string(StrBuf *buf, const char *str)
+{
+    const unsigned char *p;
+
+    sbuf_append_char(buf, '"');
+    for (p = (const unsigned char *) str; *p != '\0'; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            sbuf_appendf(buf, "\\%c", *p);
+        else if (*p < 0x20 || *p >= 0x7f)
+            sbuf_appendf(buf, "\\%03o", (unsigned int) *p);
+        else
+            sbuf_append_char(buf, (char) *p);
+    }
+    sbuf_append_char(buf, '"');
+}
+
+static void
+gen_expr(ExprNode *expr, CodegenState *state)
+{
+    StrBuf *sig_buf;
+    char *sig;
+    int expr_id;
+
+    if (expr == NULL)
+        return;
+    if (expr->node.kind != EXPR_OP || !expr_is_supported(expr))
+        return;
+
+    sig_buf = sbuf_make(state->pool);
+    expr_get_signature(expr, sig_buf);
+    sbuf_append_char(sig_buf, '\0');
+    sig = sig_buf->data;
+
+    if (apr_hash_get(state->seen, sig, APR_HASH_KEY_STRING) != NULL)
+        return;
+    apr_hash_set(state->seen, sig, APR_HASH_KEY_STRING, sig);
+
+    expr_id = state->nexprs++;
+    sbuf_appendf(state->buf,
+                 "static Datum\n"
+                 "c4c_expr_%d(ExprState *state)\n"
+                 "{\n"
+                 "    Datum result;\n"
+                 "\n"
+                 "    result.%s = ",
+                 expr_id, get_datum_field(expr->type));
+    gen_value(expr, state->buf);
+    sbuf_append(state->buf, ";\n"
+                "    return result;\n"
+                "}\n"
+                "\n");
+
+    sbuf_append(state->tbl_buf, "    { ");
+    append_c_string(state->tbl_buf, sig);
+    sbuf_appendf(state->tbl_buf, ", c4c_expr_%d },\n", expr_id);
+}
+
+static void
+gen_expr_list(List *exprs, CodegenState *state)
+{
+    ListCell *lc;
+
+    foreach (lc, exprs)
+    {
+        gen_expr((ExprNode *) lc_ptr(lc), state);
+    }
+}
+
+static void
+gen_plan_node(PlanNode *plan, CodegenState *state)
+{
+    gen_expr_list(plan->qual_exprs, state);
+    gen_expr_list(plan->proj_list, state);
+
+    if (plan->node.kind == PLAN_SCAN)
+    {
+        ScanPlan *scan_plan = (ScanPlan *) plan;
+
+        gen_expr_list(scan_plan->index_exprs, state);
+        gen_expr(scan_plan->range_lower, state);
+        gen_expr(scan_plan->range_upper, state);
+    }
+}
+
+/*
+ * Append a C source file that defines the compiled expressions for the
+ * given program to "buf".
+ */
+void
+codegen_program(ProgramPlan *plan, StrBuf *buf, apr_pool_t *pool)
+{
+    CodegenState state;
+    ListCell *lc1;
+
+    state.pool = pool;
+    state.buf = buf;
+    state.tbl_buf = sbuf_make(pool);
+    state.seen = apr_hash_make(pool);
+    state.nexprs = 0;
+
+    sbuf_append(buf,
+                "/* Generated by c4c: compiled C4 expressions. Do not edit. */\n"
+                "#include <stdint.h>\n"
+                "\n"
+                "#include \"c4-internal.h\"\n"
+                "#include \"types/expr.h\"\n"
+                "\n");
+
+    foreach (lc1, plan->rules)
+    {
+        RulePlan *rplan = (RulePlan *) lc_ptr(lc1);
+        ListCell *lc2;
+
+        foreach (lc2, rplan->chains)
+        {
+            OpChainPlan *chain_plan = (OpChainPlan *) lc_ptr(lc2);
+            ListCell *lc3;
+
+            foreach (lc3, chain_plan->chain)
+            {
+                gen_plan_node((PlanNode *) lc_ptr(lc3), &state);
+            }
+        }
+    }
+
+    sbuf_append(state.tbl_buf, "    { NULL, NULL }\n");
+    sbuf_append_char(state.tbl_buf, '\0');
+    sbuf_appendf(buf,
+                 "const C4CompiledExpr c4_compiled_exprs[] =\n"
+                 "{\n"
+                 "%s"
+                 "};\n",
+                 state.tbl_buf->data);
+}
+
+/*
+ * Load a shared library built from the output of codegen_program(), and
+ * make its compiled expressions available to subsequently installed
+ * programs. The library is unloaded when the runtime is shutdown.
+ */
+void
+codegen_load_library(C4Runtime *c4, const char *path)
+{
+    apr_dso_handle_t *dso;
+    apr_dso_handle_sym_t sym;
+    C4CompiledExpr *compiled;
+    char errbuf[512];
+    apr_status_t s;
+    int count;
+
+    s = apr_dso_load(&dso, path, c4->pool);
+    if (s != APR_SUCCESS)
+        ERROR("Failed to load library \"%s\": %s",
+              path, apr_dso_error(dso, errbuf, sizeof(errbuf)));
+
+    s = apr_dso_sym(&sym, dso, "c4_compiled_exprs");
+    if (s != APR_SUCCESS)
+        ERROR("Failed to find compiled expressions in \"%s\": %s",
+              path, apr_dso_error(dso, errbuf, sizeof(errbuf)));
+
+    count = 0;
+    for (compiled = (C4CompiledExpr *) sym;
+         compiled->signature != NULL; compiled++)
+    {
+        apr_hash_set(c4->compiled_exprs, compiled->signature,
+                     APR_HASH_KEY_STRING, compiled);
+        count++;
+    }
+
+    c4_log(c4, "Loaded %d compiled expressions from \"%s\"", count, path);
+}
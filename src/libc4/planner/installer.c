@@ -2,6 +2,7 @@
 #include "nodes/copyfuncs.h"
 #include "operator/agg.h"
 #include "operator/filter.h"
+#include "operator/index_scan.h"
 #include "operator/insert.h"
 #include "operator/project.h"
 #include "operator/scan.h"
@@ -40,7 +41,8 @@ plan_install_timers(ProgramPlan *plan, InstallState *istate)
     {
         AstTimer *timer = (AstTimer *) lc_ptr(lc);
 
-        timer_add_alarm(istate->c4->timer, timer->name, timer->period);
+        timer_add_alarm(istate->c4->timer, timer->name, timer->period,
+                        timer->policy);
     }
 }
 
@@ -66,7 +68,165 @@ print_op_chain(OpChainPlan *chain_plan)
     printf("]\n");
 }
 
+/*
+ * If the planner found quals that can be used to probe an index on the scan
+ * relation, and the scan relation supports indexes, use an index scan;
+ * otherwise, fallback to examining every tuple in the scan relation.
+ */
+static Operator *
+make_scan_op(ScanPlan *plan, Operator *next_op, OpChain *chain)
+{
+    TableDef *tbl_def;
+    bool use_index;
+
+    tbl_def = cat_get_table(chain->c4->cat, plan->scan_rel->ref->name);
+    use_index = (plan->range_col != -1 ||
+                 (plan->index_cols != NULL &&
+                  !list_is_empty(plan->index_cols)));
+
+    if (use_index && tbl_def->storage == AST_STORAGE_MEMORY)
+        return (Operator *) index_scan_op_make(plan, next_op, chain);
+
+    return (Operator *) scan_op_make(plan, next_op, chain);
+}
+
+/*
+ * Does the op chain scan its own delta table?
+ */
+static bool
+chain_has_self_join(OpChainPlan *chain_plan)
+{
+    char *delta_name = chain_plan->delta_tbl->ref->name;
+    ListCell *lc;
+
+    foreach (lc, chain_plan->chain)
+    {
+        PlanNode *plan = (PlanNode *) lc_ptr(lc);
+
+        if (plan->node.kind == PLAN_SCAN &&
+            strcmp(((ScanPlan *) plan)->scan_rel->ref->name, delta_name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Record the rule dependencies implied by an op chain. The head of the rule
+ * depends on the delta table, and on every table that the chain scans; the
+ * dependency is strict if the table is negated, or if the rule computes an
+ * aggregate.
+ */
+static void
+add_chain_deps(OpChainPlan *chain_plan, RulePlan *rplan,
+               InstallState *istate)
+{
+    C4Catalog *cat = istate->c4->cat;
+    char *head_name = chain_plan->head->name;
+    bool has_agg = (rplan->agg_plan != NULL);
+    ListCell *lc;
+
+    cat_add_dependency(cat, chain_plan->delta_tbl->ref->name, head_name,
+                       has_agg || chain_plan->delta_tbl->not);
+
+    foreach (lc, chain_plan->chain)
+    {
+        PlanNode *plan = (PlanNode *) lc_ptr(lc);
+        ScanPlan *scan_plan;
+
+        if (plan->node.kind != PLAN_SCAN)
+            continue;
+
+        scan_plan = (ScanPlan *) plan;
+        cat_add_dependency(cat, scan_plan->scan_rel->ref->name, head_name,
+                           has_agg || scan_plan->scan_rel->not);
+    }
+}
+
+/*
+ * Record the schema of each operator's input tuples, which is needed to
+ * evaluate expressions over them: the first operator's input comes from the
+ * delta table, and each subsequent operator's input is the output of the
+ * operator before it. Since we build the chain in reverse, this can only be
+ * done once the whole chain has been built. Note that an agg operator may be
+ * shared by several op chains.
+ */
 static void
+set_input_schemas(OpChain *op_chain)
+{
+    Schema *input_schema;
+    Operator *op;
+
+    input_schema = op_chain->delta_tbl->schema;
+    for (op = op_chain->chain_start; op != NULL; op = op->next)
+    {
+        if (op->exec_cxt->inner_schema == NULL)
+            op->exec_cxt->inner_schema = input_schema;
+        else
+            ASSERT(schema_equal(op->exec_cxt->inner_schema, input_schema));
+
+        input_schema = op->proj_schema;
+    }
+}
+
+/*
+ * Find the columns of the op chain's delta table that are bound to a head
+ * column by a variable: any derivation of a head tuple via this op chain
+ * must start from a delta tuple whose values in those columns equal the
+ * head tuple's. Note that every column of a join clause is a variable once
+ * analysis is complete.
+ */
+static void
+set_rederive_keys(OpChain *op_chain, OpChainPlan *chain_plan)
+{
+    List *head_cols = chain_plan->head->cols;
+    List *delta_cols = chain_plan->delta_tbl->ref->cols;
+    ListCell *lc;
+    int head_colno;
+
+    op_chain->nrederive_keys = 0;
+    op_chain->rederive_delta_cols = apr_palloc(op_chain->pool,
+                                               sizeof(int) *
+                                               list_length(head_cols));
+    op_chain->rederive_head_cols = apr_palloc(op_chain->pool,
+                                              sizeof(int) *
+                                              list_length(head_cols));
+
+    head_colno = 0;
+    foreach (lc, head_cols)
+    {
+        C4Node *head_expr = (C4Node *) lc_ptr(lc);
+        ListCell *lc2;
+        int delta_colno;
+
+        if (head_expr->kind != AST_VAR_EXPR)
+        {
+            head_colno++;
+            continue;
+        }
+
+        delta_colno = 0;
+        foreach (lc2, delta_cols)
+        {
+            AstVarExpr *var = (AstVarExpr *) lc_ptr(lc2);
+
+            ASSERT(var->node.kind == AST_VAR_EXPR);
+            if (strcmp(var->name, ((AstVarExpr *) head_expr)->name) == 0)
+            {
+                int i = op_chain->nrederive_keys++;
+
+                op_chain->rederive_delta_cols[i] = delta_colno;
+                op_chain->rederive_head_cols[i] = head_colno;
+                break;
+            }
+            delta_colno++;
+        }
+
+        head_colno++;
+    }
+}
+
+static OpChain *
 install_op_chain(OpChainPlan *chain_plan, InstallState *istate)
 {
     List *chain_rev;
@@ -87,9 +247,15 @@ install_op_chain(OpChainPlan *chain_plan, InstallState *istate)
     op_chain->delta_tbl = cat_get_table(op_chain->c4->cat,
                                         chain_plan->delta_tbl->ref->name);
     op_chain->head = copy_node(chain_plan->head, chain_pool);
+    op_chain->head_tbl = cat_get_table(op_chain->c4->cat,
+                                       chain_plan->head->name);
     op_chain->anti_chain = chain_plan->delta_tbl->not;
+    op_chain->self_join = chain_has_self_join(chain_plan);
     op_chain->length = list_length(chain_plan->chain);
+    op_chain->rederive = false;
+    op_chain->rederive_index = NULL;
     op_chain->next = NULL;
+    set_rederive_keys(op_chain, chain_plan);
 
     /*
      * We build the operator chain in reverse, so that each operator knows
@@ -137,8 +303,7 @@ install_op_chain(OpChainPlan *chain_plan, InstallState *istate)
                 break;
 
             case PLAN_SCAN:
-                op = (Operator *) scan_op_make((ScanPlan *) plan,
-                                               prev_op, op_chain);
+                op = make_scan_op((ScanPlan *) plan, prev_op, op_chain);
                 break;
 
             default:
@@ -149,11 +314,14 @@ install_op_chain(OpChainPlan *chain_plan, InstallState *istate)
         prev_op = op;
     }
     op_chain->chain_start = prev_op;
+    set_input_schemas(op_chain);
 
     router_add_op_chain(istate->c4->router, op_chain);
 #if 0
     printf("================\n");
 #endif
+
+    return op_chain;
 }
 
 static void
@@ -164,17 +332,37 @@ plan_install_rules(ProgramPlan *plan, InstallState *istate)
     foreach (lc, plan->rules)
     {
         RulePlan *rplan = (RulePlan *) lc_ptr(lc);
+        OpChain *rederive_chain;
         ListCell *lc2;
 
+        rederive_chain = NULL;
         foreach (lc2, rplan->chains)
         {
             OpChainPlan *chain_plan = (OpChainPlan *) lc_ptr(lc2);
-
-            install_op_chain(chain_plan, istate);
+            OpChain *op_chain;
+
+            op_chain = install_op_chain(chain_plan, istate);
+            add_chain_deps(chain_plan, rplan, istate);
+
+            /*
+             * To rederive a rule's head tuples, we only need to invoke one
+             * of its op chains: pick the one whose delta table is most
+             * tightly constrained by the head. Aggregate rules are never
+             * rederived (see router.c).
+             */
+            if (rplan->agg_plan != NULL || op_chain->anti_chain)
+                continue;
+            if (rederive_chain == NULL ||
+                op_chain->nrederive_keys > rederive_chain->nrederive_keys)
+                rederive_chain = op_chain;
         }
 
+        if (rederive_chain != NULL)
+            rederive_chain->rederive = true;
         istate->current_agg = NULL;
     }
+
+    router_set_nstrata(istate->c4->router, cat_stratify(istate->c4->cat));
 }
 
 static Tuple *
@@ -409,6 +409,185 @@ add_qual_expr(AstQualifier *qual, PlanNode *plan, AstJoinClause *outer_rel,
     }
 }
 
+static bool
+expr_has_outer_var(ExprNode *expr)
+{
+    switch (expr->node.kind)
+    {
+        case EXPR_VAR:
+            return ((ExprVar *) expr)->is_outer;
+
+        case EXPR_CONST:
+            return false;
+
+        case EXPR_OP:
+            {
+                ExprOp *op = (ExprOp *) expr;
+
+                if (expr_has_outer_var(op->lhs))
+                    return true;
+                if (op->rhs != NULL && expr_has_outer_var(op->rhs))
+                    return true;
+
+                return false;
+            }
+
+        default:
+            ERROR("Unexpected expr node kind: %d", (int) expr->node.kind);
+            return false;       /* Keep compiler quiet */
+    }
+}
+
+static bool
+is_outer_var(ExprNode *expr)
+{
+    return (expr->node.kind == EXPR_VAR && ((ExprVar *) expr)->is_outer);
+}
+
+/*
+ * Is the qual a comparison between a variable of the scan relation and an
+ * expression that doesn't reference the scan relation? If so, return the
+ * comparison's operator, rewritten if necessary so that the comparison is of
+ * the form "outer_var OP key_expr".
+ */
+static bool
+split_index_qual(ExprNode *expr, AstOperKind *op_kind,
+                 ExprVar **outer_var, ExprNode **key_expr)
+{
+    ExprOp *op_expr;
+
+    if (expr->node.kind != EXPR_OP)
+        return false;
+
+    op_expr = (ExprOp *) expr;
+    switch (op_expr->op_kind)
+    {
+        case AST_OP_EQ:
+        case AST_OP_LT:
+        case AST_OP_LTE:
+        case AST_OP_GT:
+        case AST_OP_GTE:
+            break;
+
+        default:
+            return false;
+    }
+
+    if (is_outer_var(op_expr->lhs) && !expr_has_outer_var(op_expr->rhs))
+    {
+        *op_kind = op_expr->op_kind;
+        *outer_var = (ExprVar *) op_expr->lhs;
+        *key_expr = op_expr->rhs;
+        return true;
+    }
+
+    if (is_outer_var(op_expr->rhs) && !expr_has_outer_var(op_expr->lhs))
+    {
+        *outer_var = (ExprVar *) op_expr->rhs;
+        *key_expr = op_expr->lhs;
+
+        /* "key_expr OP outer_var" => "outer_var OP' key_expr" */
+        switch (op_expr->op_kind)
+        {
+            case AST_OP_LT:
+                *op_kind = AST_OP_GT;
+                break;
+            case AST_OP_LTE:
+                *op_kind = AST_OP_GTE;
+                break;
+            case AST_OP_GT:
+                *op_kind = AST_OP_LT;
+                break;
+            case AST_OP_GTE:
+                *op_kind = AST_OP_LTE;
+                break;
+            default:
+                *op_kind = op_expr->op_kind;
+                break;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static void
+add_range_bound(ScanPlan *plan, AstOperKind op_kind, ExprVar *outer_var,
+                ExprNode *key_expr)
+{
+    /* Only one column of the scan relation is used for the range scan */
+    if (plan->range_col != -1 && plan->range_col != outer_var->attno)
+        return;
+
+    switch (op_kind)
+    {
+        case AST_OP_GT:
+        case AST_OP_GTE:
+            if (plan->range_lower != NULL)
+                return;
+            plan->range_lower = key_expr;
+            plan->range_lower_incl = (op_kind == AST_OP_GTE);
+            break;
+
+        case AST_OP_LT:
+        case AST_OP_LTE:
+            if (plan->range_upper != NULL)
+                return;
+            plan->range_upper = key_expr;
+            plan->range_upper_incl = (op_kind == AST_OP_LTE);
+            break;
+
+        default:
+            ERROR("Unexpected range operator: %d", (int) op_kind);
+    }
+
+    plan->range_col = outer_var->attno;
+}
+
+/*
+ * Look for quals that compare a variable of the scan relation with an
+ * expression that doesn't reference the scan relation. An equality qual
+ * "outer_var == expr" can be satisfied by probing a hash index on the scan
+ * relation for the value of "expr"; range quals ("outer_var < expr" and so
+ * on) can be satisfied by a bounded scan of an ordered index. Either way,
+ * we avoid examining every tuple in the scan relation. Note that we leave
+ * the quals in the scan's qual list: the scan operator evaluates them on
+ * every candidate tuple regardless.
+ */
+static void
+find_index_quals(ScanPlan *plan, PlannerState *state)
+{
+    ListCell *lc;
+
+    plan->index_cols = list_make(state->plan_pool);
+    plan->index_exprs = list_make(state->plan_pool);
+
+    foreach (lc, plan->plan.qual_exprs)
+    {
+        ExprNode *expr = (ExprNode *) lc_ptr(lc);
+        AstOperKind op_kind;
+        ExprVar *outer_var;
+        ExprNode *key_expr;
+
+        if (!split_index_qual(expr, &op_kind, &outer_var, &key_expr))
+            continue;
+
+        if (op_kind != AST_OP_EQ)
+        {
+            add_range_bound(plan, op_kind, outer_var, key_expr);
+            continue;
+        }
+
+        /* One probe value per index column is enough */
+        if (list_member_int(plan->index_cols, outer_var->attno))
+            continue;
+
+        list_append_int(plan->index_cols, outer_var->attno);
+        list_append(plan->index_exprs, key_expr);
+    }
+}
+
 static void
 fix_op_exprs(PlanNode *plan, ListCell *chain_rest,
              OpChainPlan *chain_plan, PlannerState *state)
@@ -443,6 +622,9 @@ fix_op_exprs(PlanNode *plan, ListCell *chain_rest,
         add_qual_expr(qual, plan, outer_rel, chain_plan, state);
     }
 
+    if (plan->node.kind == PLAN_SCAN)
+        find_index_quals((ScanPlan *) plan, state);
+
     new_plist = make_proj_list(plan, chain_rest, outer_rel, chain_plan, state);
     ASSERT(plan->proj_list == NULL);
     plan->proj_list = new_plist;
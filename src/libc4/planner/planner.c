@@ -193,7 +193,8 @@ add_scan_op(AstJoinClause *ast_join, List *quals,
 {
     ScanPlan *splan;
 
-    splan = make_scan_plan(ast_join, quals, NULL, NULL, state->plan_pool);
+    splan = make_scan_plan(ast_join, quals, NULL, NULL, NULL, NULL,
+                           state->plan_pool);
     list_append(chain_plan->chain, splan);
 }
 
@@ -440,6 +441,37 @@ print_plan_info(PlanNode *plan, apr_pool_t *p)
                              splan->scan_rel->not ? "true" : "false");
                 list_to_str(splan->scan_rel->ref->cols, sbuf);
                 sbuf_append(sbuf, "\n");
+
+                if (splan->index_cols != NULL &&
+                    !list_is_empty(splan->index_cols))
+                {
+                    ListCell *lc;
+
+                    sbuf_append(sbuf, "  INDEX COLS: [");
+                    foreach (lc, splan->index_cols)
+                    {
+                        sbuf_appendf(sbuf, "%d", lc_int(lc));
+                        if (lc != list_tail(splan->index_cols))
+                            sbuf_append(sbuf, ", ");
+                    }
+                    sbuf_append(sbuf, "] ; INDEX EXPRS: [");
+                    list_to_str(splan->index_exprs, sbuf);
+                    sbuf_append(sbuf, "]\n");
+                }
+
+                if (splan->range_col != -1)
+                {
+                    sbuf_appendf(sbuf, "  RANGE COL: %d ; LOWER: %s",
+                                 splan->range_col,
+                                 splan->range_lower_incl ? "[" : "(");
+                    if (splan->range_lower)
+                        node_to_str((C4Node *) splan->range_lower, sbuf);
+                    sbuf_append(sbuf, " ; UPPER: ");
+                    if (splan->range_upper)
+                        node_to_str((C4Node *) splan->range_upper, sbuf);
+                    sbuf_appendf(sbuf, "%s\n",
+                                 splan->range_upper_incl ? "]" : ")");
+                }
             }
             break;
 
@@ -3,22 +3,42 @@
 #include <apr_thread_cond.h>
 
 #include "c4-internal.h"
+#include "net/exchange.h"
 #include "net/network.h"
+#include "operator/agg.h"
 #include "operator/operator.h"
+#include "operator/scancursor.h"
 #include "parser/parser.h"
+#include "planner/codegen.h"
 #include "planner/installer.h"
 #include "planner/planner.h"
 #include "router.h"
 #include "runtime.h"
+#include "storage/mem_table.h"
 #include "storage/sqlite.h"
 #include "storage/table.h"
 #include "timer.h"
 #include "types/catalog.h"
 #include "util/dump_table.h"
+#include "util/hash.h"
 #include "util/list.h"
 #include "util/strbuf.h"
 #include "util/tuple_buf.h"
 
+/*
+ * A tuple of a recursive table that the router keeps track of for DRed
+ * (see rederive_strata()): either a base fact, or a tuple that has been
+ * over-deleted and is awaiting rederivation. The entry holds a pin on the
+ * tuple. "ent" is used as the hash key, so it must be the first field.
+ */
+typedef struct TrackedTuple
+{
+    TupleBufEntry ent;
+    /* Has the over-deleted tuple been rederived yet? */
+    bool rederived;
+    struct TrackedTuple *next;
+} TrackedTuple;
+
 struct C4Router
 {
     C4Runtime *c4;
@@ -30,17 +50,54 @@ struct C4Router
     /* Queue of to-be-consumed input events inserted by other threads */
     apr_queue_t *queue;
 
-    /* Inserts and deletes computed within current fixpoint; to-be-routed */
-    TupleBuf *insert_buf;
-    TupleBuf *delete_buf;
+    /*
+     * Inserts, updates and deletes computed within current fixpoint;
+     * to-be-routed. There is one buffer of each kind per stratum.
+     */
+    int nstrata;
+    TupleBuf **insert_bufs;
+    TupleBuf **update_bufs;
+    TupleBuf **delete_bufs;
     bool routing_deletes;       /* Are we currently routing from delete_buf? */
 
+    /*
+     * For each stratum, the tuples that have been over-deleted from
+     * recursive tables, as a list and as a hash table of TrackedTuples.
+     * These are allocated in the runtime's tmp_pool, since they only live
+     * until the stratum has been rederived.
+     */
+    TrackedTuple **overdel_lists;
+    c4_hash_t **overdel_tbls;
+
+    /* If we're currently rederiving, the over-deleted tuples; else NULL */
+    c4_hash_t *rederive_tbl;
+
+    /*
+     * The base facts of recursive tables: that is, tuples that were inserted
+     * directly rather than derived by a rule. An over-deleted base fact is
+     * always rederived. Since there is no way to delete a base fact, this
+     * only ever grows.
+     */
+    c4_hash_t *base_facts;
+
     /* Pending network output tuples computed within current fixpoint */
     TupleBuf *net_buf;
+
+    /* Aggs that have dirty groups, linked via next_dirty_agg */
+    AggOperator *dirty_aggs;
+
+    /* Batch of tuples for the same table that is currently being routed */
+    Tuple **route_batch;
 };
 
 static void router_enqueue(C4Router *router, WorkItem *wi);
 static bool drain_queue(C4Router *router);
+static int get_pending_stratum(C4Router *router);
+static unsigned int buf_entry_hash(const char *key, int klen, void *data);
+static bool buf_entry_cmp(const void *k1, const void *k2, int klen,
+                          void *data);
+static void record_overdeleted(C4Router *router, Tuple *tuple,
+                               TableDef *tbl_def);
 
 C4Router *
 router_make(C4Runtime *c4)
@@ -52,10 +109,21 @@ router_make(C4Runtime *c4)
     router->c4 = c4;
     router->pool = c4->pool;
     router->op_chain_tbl = apr_hash_make(router->pool);
-    router->insert_buf = tuple_buf_make(4096, router->pool);
-    router->delete_buf = tuple_buf_make(512, router->pool);
+    router->nstrata = 0;
+    router->insert_bufs = NULL;
+    router->update_bufs = NULL;
+    router->delete_bufs = NULL;
+    router->overdel_lists = NULL;
+    router->overdel_tbls = NULL;
+    router_set_nstrata(router, 1);
+    router->rederive_tbl = NULL;
+    router->base_facts = c4_hash_make(router->pool, sizeof(TupleBufEntry *),
+                                      NULL, buf_entry_hash, buf_entry_cmp);
     router->routing_deletes = false;
     router->net_buf = tuple_buf_make(512, router->pool);
+    router->dirty_aggs = NULL;
+    router->route_batch = apr_palloc(router->pool,
+                                     sizeof(Tuple *) * OP_BATCH_SIZE);
     s = apr_queue_create(&router->queue, 512, router->pool);
     if (s != APR_SUCCESS)
         FAIL_APR(s);
@@ -63,75 +131,710 @@ router_make(C4Runtime *c4)
     return router;
 }
 
+/*
+ * Make sure that the router has buffers for at least "nstrata" strata. This
+ * is called when a new program is installed, so we don't bother reclaiming
+ * the space used by the old buffer arrays.
+ */
+void
+router_set_nstrata(C4Router *router, int nstrata)
+{
+    TupleBuf **insert_bufs;
+    TupleBuf **update_bufs;
+    TupleBuf **delete_bufs;
+    TrackedTuple **overdel_lists;
+    c4_hash_t **overdel_tbls;
+    int i;
+
+    if (nstrata <= router->nstrata)
+        return;
+
+    insert_bufs = apr_palloc(router->pool, sizeof(TupleBuf *) * nstrata);
+    update_bufs = apr_palloc(router->pool, sizeof(TupleBuf *) * nstrata);
+    delete_bufs = apr_palloc(router->pool, sizeof(TupleBuf *) * nstrata);
+    overdel_lists = apr_pcalloc(router->pool,
+                                sizeof(TrackedTuple *) * nstrata);
+    overdel_tbls = apr_pcalloc(router->pool, sizeof(c4_hash_t *) * nstrata);
+    for (i = 0; i < nstrata; i++)
+    {
+        if (i < router->nstrata)
+        {
+            insert_bufs[i] = router->insert_bufs[i];
+            update_bufs[i] = router->update_bufs[i];
+            delete_bufs[i] = router->delete_bufs[i];
+            overdel_lists[i] = router->overdel_lists[i];
+            overdel_tbls[i] = router->overdel_tbls[i];
+        }
+        else if (i == 0)
+        {
+            insert_bufs[i] = tuple_buf_make(4096, router->pool);
+            update_bufs[i] = tuple_buf_make(64, router->pool);
+            delete_bufs[i] = tuple_buf_make(512, router->pool);
+        }
+        else
+        {
+            insert_bufs[i] = tuple_buf_make(256, router->pool);
+            update_bufs[i] = tuple_buf_make(64, router->pool);
+            delete_bufs[i] = tuple_buf_make(64, router->pool);
+        }
+    }
+
+    router->insert_bufs = insert_bufs;
+    router->update_bufs = update_bufs;
+    router->delete_bufs = delete_bufs;
+    router->overdel_lists = overdel_lists;
+    router->overdel_tbls = overdel_tbls;
+    router->nstrata = nstrata;
+}
+
+/*
+ * Pass a batch of tuples that have already been applied to their table down
+ * each op chain for the table.
+ */
+static void
+route_batch(C4Router *router, Tuple **batch, int nbatch, TableDef *tbl_def,
+            bool is_delete)
+{
+    OpChain *op_chain;
+
+    op_chain = tbl_def->op_chain_list->head;
+    while (op_chain != NULL)
+    {
+        Operator *start = op_chain->chain_start;
+
+        if (op_chain->anti_chain)
+            router->routing_deletes = !is_delete;
+        else
+            router->routing_deletes = is_delete;
+
+        start->invoke_batch(start, batch, nbatch);
+        op_chain = op_chain->next;
+    }
+}
+
 /*
  * We route tuples from the buffer in a FIFO manner, but that is not necessarily
  * the only choice.
+ *
+ * Consecutive tuples that belong to the same table are routed as a batch: we
+ * apply all the tuples in the batch to the table, and then pass the batch
+ * through each op chain at once. Because the tuples of the batch are applied
+ * to the table before any of them are routed, a scan of the delta table
+ * would see a different table state than if the tuples were routed one at a
+ * time; hence, if any op chain scans its own delta table, we route one tuple
+ * at a time.
+ *
+ * The op chains for a table are invoked one after another. Although they
+ * only read stored tables and append to the router's buffers, they can't
+ * safely be run concurrently: tuple and string refcounts are not atomic, and
+ * tuple pools, expression state and the APR pools are not thread-safe. To use
+ * more than one core, partition the program's data across several C4
+ * instances in the same process (see net/exchange.h).
  */
 static void
 route_tuple_buf(C4Router *router, TupleBuf *buf, bool is_delete)
 {
+    Tuple **batch = router->route_batch;
+
     while (!tuple_buf_is_empty(buf))
     {
-        Tuple *tuple;
         TableDef *tbl_def;
-        OpChain *op_chain;
-        bool route_tuple;
+        int max_batch;
+        int nbatch;
+        int i;
+
+        tbl_def = tuple_buf_head(buf)->tbl_def;
+        max_batch = tbl_def->op_chain_list->self_join ? 1 : OP_BATCH_SIZE;
+        nbatch = 0;
+
+        while (nbatch < max_batch && !tuple_buf_is_empty(buf) &&
+               tuple_buf_head(buf)->tbl_def == tbl_def)
+        {
+            Tuple *tuple;
+            bool route_tuple;
 
-        tuple_buf_shift(buf, &tuple, &tbl_def);
+            tuple_buf_shift(buf, &tuple, NULL);
 
 #if 0
-        c4_log(router->c4, "%s: %s %s (=> %s)",
-               __func__, is_delete ? "delete" : "insert",
-               log_tuple(router->c4, tuple, tbl_def->schema),
-               tbl_def->name);
+            c4_log(router->c4, "%s: %s %s (=> %s)",
+                   __func__, is_delete ? "delete" : "insert",
+                   log_tuple(router->c4, tuple, tbl_def->schema),
+                   tbl_def->name);
 #endif
 
-        if (is_delete)
-            route_tuple = tbl_def->table->delete(tbl_def->table, tuple);
-        else
-            route_tuple = tbl_def->table->insert(tbl_def->table, tuple);
+            if (is_delete)
+                route_tuple = tbl_def->table->delete(tbl_def->table, tuple);
+            else
+                route_tuple = tbl_def->table->insert(tbl_def->table, tuple);
+
+            if (route_tuple)
+            {
+                batch[nbatch++] = tuple;
+                if (is_delete && tbl_def->recursive)
+                    record_overdeleted(router, tuple, tbl_def);
+            }
+            else
+                tuple_unpin(tuple, tbl_def->schema);
+        }
 
-        if (!route_tuple)
+        if (nbatch == 0)
             continue;
 
-        op_chain = tbl_def->op_chain_list->head;
-        while (op_chain != NULL)
+        route_batch(router, batch, nbatch, tbl_def, is_delete);
+
+        for (i = 0; i < nbatch; i++)
+            tuple_unpin(batch[i], tbl_def->schema);
+    }
+}
+
+/*
+ * Route the updates in the buffer. We apply both halves of an update to the
+ * table, and then pass the update down each op chain as a unit. If only one
+ * half of the update changes the content of the table (e.g. because the new
+ * tuple was already present), we just route that half. Anti-chains, and op
+ * chains that scan their own delta table, are given a deletion of the old
+ * tuple followed by an insertion of the new tuple, as if the update had been
+ * routed via the delete and insert buffers.
+ */
+static void
+route_update_buf(C4Router *router, TupleBuf *buf)
+{
+    while (!tuple_buf_is_empty(buf))
+    {
+        Tuple *old_tuple;
+        Tuple *new_tuple;
+        TableDef *tbl_def;
+        AbstractTable *table;
+        OpChain *op_chain;
+        bool route_old;
+        bool route_new;
+
+        tuple_buf_shift_update(buf, &old_tuple, &new_tuple, &tbl_def);
+        ASSERT(old_tuple != NULL);
+        table = tbl_def->table;
+
+        if (tbl_def->op_chain_list->self_join)
         {
-            Operator *start = op_chain->chain_start;
+            route_old = table->delete(table, old_tuple);
+            if (route_old)
+                route_batch(router, &old_tuple, 1, tbl_def, true);
+            if (table->insert(table, new_tuple))
+                route_batch(router, &new_tuple, 1, tbl_def, false);
+        }
+        else
+        {
+            route_old = table->delete(table, old_tuple);
+            route_new = table->insert(table, new_tuple);
 
-            if (op_chain->anti_chain)
-                router->routing_deletes = !is_delete;
-            else
-                router->routing_deletes = is_delete;
+            op_chain = tbl_def->op_chain_list->head;
+            while (op_chain != NULL)
+            {
+                Operator *start = op_chain->chain_start;
+
+                if (route_old && route_new && !op_chain->anti_chain)
+                {
+                    router->routing_deletes = false;
+                    start->invoke_update(start, old_tuple, new_tuple);
+                }
+                else
+                {
+                    if (route_old)
+                    {
+                        router->routing_deletes = !op_chain->anti_chain;
+                        start->invoke(start, old_tuple);
+                    }
+                    if (route_new)
+                    {
+                        router->routing_deletes = op_chain->anti_chain;
+                        start->invoke(start, new_tuple);
+                    }
+                }
 
-            start->invoke(start, tuple);
-            op_chain = op_chain->next;
+                op_chain = op_chain->next;
+            }
         }
 
-        tuple_unpin(tuple, tbl_def->schema);
+        if (route_old && tbl_def->recursive)
+            record_overdeleted(router, old_tuple, tbl_def);
+
+        tuple_unpin(old_tuple, tbl_def->schema);
+        tuple_unpin(new_tuple, tbl_def->schema);
     }
 }
 
+/*
+ * Return the lowest stratum that has tuples waiting to be routed, or -1 if
+ * there are no such tuples.
+ */
+static int
+get_pending_stratum(C4Router *router)
+{
+    int i;
+
+    for (i = 0; i < router->nstrata; i++)
+    {
+        if (!tuple_buf_is_empty(router->insert_bufs[i]) ||
+            !tuple_buf_is_empty(router->update_bufs[i]) ||
+            !tuple_buf_is_empty(router->delete_bufs[i]))
+            return i;
+    }
+
+    return -1;
+}
+
 #ifdef C4_ASSERT_ENABLED
 static bool
 has_pending_tuples(C4Router *router)
 {
-    return (!tuple_buf_is_empty(router->insert_buf) ||
-            !tuple_buf_is_empty(router->delete_buf) ||
+    return (get_pending_stratum(router) != -1 ||
+            router->dirty_aggs != NULL ||
             !tuple_buf_is_empty(router->net_buf));
 }
 #endif
 
+static unsigned int
+buf_entry_hash(const char *key, int klen, __unused void *data)
+{
+    TupleBufEntry *ent = (TupleBufEntry *) key;
+
+    return tuple_hash(ent->tuple, ent->tbl_def->schema);
+}
+
+static bool
+buf_entry_cmp(const void *k1, const void *k2, int klen,
+              __unused void *data)
+{
+    TupleBufEntry *ent1 = (TupleBufEntry *) k1;
+    TupleBufEntry *ent2 = (TupleBufEntry *) k2;
+
+    return (ent1->tbl_def == ent2->tbl_def &&
+            tuple_equal(ent1->tuple, ent2->tuple, ent1->tbl_def->schema));
+}
+
+/*
+ * Remove the entries of the buffer that have been marked as cancelled,
+ * unpinning their tuples.
+ */
+static void
+compact_tuple_buf(TupleBuf *buf, bool *cancelled)
+{
+    int nentries = tuple_buf_size(buf);
+    int nkept;
+    int i;
+
+    nkept = 0;
+    for (i = 0; i < nentries; i++)
+    {
+        TupleBufEntry *ent = &buf->entries[buf->start + i];
+
+        if (cancelled[i])
+            tuple_unpin(ent->tuple, ent->tbl_def->schema);
+        else
+            buf->entries[buf->start + nkept++] = *ent;
+    }
+
+    buf->end = buf->start + nkept;
+    if (tuple_buf_is_empty(buf))
+        tuple_buf_reset(buf);
+}
+
+typedef struct DeleteCount
+{
+    int ndeletes;
+    int ncancelled;
+} DeleteCount;
+
+/*
+ * Before routing a stratum, cancel any insertions that are matched by a
+ * deletion of the same tuple in the same stratum. Because all the tuples in
+ * lower strata have already been routed, this typically removes the
+ * intermediate results that an aggregate or negation emitted and then
+ * retracted while its inputs were still changing. Routing an insertion and
+ * the matching deletion has no net effect, so it is safe to drop both. This
+ * is not true of recursive tables, which have set semantics: we leave their
+ * tuples alone.
+ */
+static void
+cancel_insert_delete_pairs(C4Router *router, int stratum)
+{
+    TupleBuf *insert_buf = router->insert_bufs[stratum];
+    TupleBuf *delete_buf = router->delete_bufs[stratum];
+    apr_pool_t *tmp_pool = router->c4->tmp_pool;
+    c4_hash_t *delete_tbl;
+    bool *ins_cancelled;
+    bool *del_cancelled;
+    int ninserts;
+    int ndeletes;
+    int ncancelled;
+    int i;
+
+    ninserts = tuple_buf_size(insert_buf);
+    ndeletes = tuple_buf_size(delete_buf);
+    delete_tbl = c4_hash_make(tmp_pool, sizeof(TupleBufEntry *), NULL,
+                              buf_entry_hash, buf_entry_cmp);
+
+    for (i = 0; i < ndeletes; i++)
+    {
+        TupleBufEntry *ent = &delete_buf->entries[delete_buf->start + i];
+        DeleteCount *count;
+
+        /* See rederive_strata() */
+        if (ent->tbl_def->recursive)
+            continue;
+
+        count = c4_hash_get(delete_tbl, ent);
+        if (count == NULL)
+        {
+            count = apr_pcalloc(tmp_pool, sizeof(*count));
+            c4_hash_set(delete_tbl, ent, count);
+        }
+        count->ndeletes++;
+    }
+
+    ncancelled = 0;
+    ins_cancelled = apr_pcalloc(tmp_pool, sizeof(bool) * ninserts);
+    for (i = 0; i < ninserts; i++)
+    {
+        TupleBufEntry *ent = &insert_buf->entries[insert_buf->start + i];
+        DeleteCount *count;
+
+        count = c4_hash_get(delete_tbl, ent);
+        if (count == NULL || count->ncancelled == count->ndeletes)
+            continue;
+
+        count->ncancelled++;
+        ins_cancelled[i] = true;
+        ncancelled++;
+    }
+
+    if (ncancelled == 0)
+        return;
+
+    del_cancelled = apr_pcalloc(tmp_pool, sizeof(bool) * ndeletes);
+    for (i = 0; i < ndeletes; i++)
+    {
+        TupleBufEntry *ent = &delete_buf->entries[delete_buf->start + i];
+        DeleteCount *count;
+
+        count = c4_hash_get(delete_tbl, ent);
+        if (count != NULL && count->ncancelled > 0)
+        {
+            count->ncancelled--;
+            del_cancelled[i] = true;
+        }
+    }
+
+    compact_tuple_buf(insert_buf, ins_cancelled);
+    compact_tuple_buf(delete_buf, del_cancelled);
+}
+
+/*
+ * Flush the aggs whose inputs are quiescent. An agg's inputs belong to lower
+ * strata than its output table, so we can flush an agg once there are no
+ * pending tuples in strata lower than its output stratum. "stratum" is the
+ * lowest stratum with pending tuples, or -1 if there are none. Returns true
+ * if we flushed any aggs.
+ */
+static bool
+flush_dirty_aggs(C4Router *router, int stratum)
+{
+    AggOperator **prev = &router->dirty_aggs;
+    AggOperator *agg_op;
+    bool flushed = false;
+
+    while ((agg_op = *prev) != NULL)
+    {
+        if (stratum != -1 && agg_op->output_tbl->stratum > stratum)
+        {
+            prev = &agg_op->next_dirty_agg;
+            continue;
+        }
+
+        *prev = agg_op->next_dirty_agg;
+        agg_op->next_dirty_agg = NULL;
+        agg_flush(agg_op);
+        flushed = true;
+    }
+
+    return flushed;
+}
+
+/*
+ * Look up a tuple in a hash table of TrackedTuples.
+ */
+static TrackedTuple *
+tracked_tuple_get(c4_hash_t *tbl, Tuple *tuple, TableDef *tbl_def)
+{
+    TupleBufEntry key;
+
+    key.tuple = tuple;
+    key.tbl_def = tbl_def;
+    key.old_tuple = NULL;
+
+    return c4_hash_get(tbl, &key);
+}
+
+/*
+ * Remember that a tuple has been over-deleted from a recursive table, so
+ * that it can be rederived once its stratum has been routed.
+ */
+static void
+record_overdeleted(C4Router *router, Tuple *tuple, TableDef *tbl_def)
+{
+    apr_pool_t *tmp_pool = router->c4->tmp_pool;
+    int stratum = tbl_def->stratum;
+    TrackedTuple *tt;
+
+    if (router->overdel_tbls[stratum] == NULL)
+        router->overdel_tbls[stratum] = c4_hash_make(tmp_pool,
+                                                     sizeof(TupleBufEntry *),
+                                                     NULL, buf_entry_hash,
+                                                     buf_entry_cmp);
+    else if (tracked_tuple_get(router->overdel_tbls[stratum],
+                               tuple, tbl_def) != NULL)
+        return;
+
+    tt = apr_palloc(tmp_pool, sizeof(*tt));
+    tt->ent.tuple = tuple;
+    tt->ent.tbl_def = tbl_def;
+    tt->ent.old_tuple = NULL;
+    tt->rederived = false;
+    tt->next = router->overdel_lists[stratum];
+    tuple_pin(tuple);
+
+    router->overdel_lists[stratum] = tt;
+    c4_hash_set(router->overdel_tbls[stratum], &tt->ent, tt);
+}
+
+/*
+ * Remember that a tuple of a recursive table is a base fact. The entry
+ * lives as long as the router.
+ */
+static void
+record_base_fact(C4Router *router, Tuple *tuple, TableDef *tbl_def)
+{
+    TrackedTuple *tt;
+
+    if (tracked_tuple_get(router->base_facts, tuple, tbl_def) != NULL)
+        return;
+
+    tt = apr_palloc(router->pool, sizeof(*tt));
+    tt->ent.tuple = tuple;
+    tt->ent.tbl_def = tbl_def;
+    tt->ent.old_tuple = NULL;
+    tt->rederived = false;
+    tt->next = NULL;
+    tuple_pin(tuple);
+
+    c4_hash_set(router->base_facts, &tt->ent, tt);
+}
+
+/*
+ * Pass the tuples of the op chain's delta table that might derive one of
+ * the over-deleted tuples in "overdel" down the op chain, as insertions.
+ * This doesn't modify any tables: the derived tuples are just added to the
+ * router's buffers.
+ *
+ * If the delta table is a memory table and some of its columns are bound
+ * by the rule head, we probe a hash index on those columns with the values
+ * of each over-deleted tuple. Otherwise, we have to pass the entire content
+ * of the delta table down the op chain.
+ */
+static void
+rederive_op_chain(C4Router *router, OpChain *op_chain, TrackedTuple *overdel)
+{
+    AbstractTable *table = op_chain->delta_tbl->table;
+    Schema *head_schema = op_chain->head_tbl->schema;
+    Operator *start = op_chain->chain_start;
+    Tuple **batch = router->route_batch;
+    int nkeys = op_chain->nrederive_keys;
+    Datum *key;
+    TrackedTuple *tt;
+    int nbatch;
+
+    nbatch = 0;
+    if (nkeys == 0 || table->def->storage != AST_STORAGE_MEMORY)
+    {
+        ScanCursor *cursor;
+        Tuple *tuple;
+
+        cursor = table->scan_make(table, router->c4->tmp_pool);
+        table->scan_reset(table, cursor);
+        while ((tuple = table->scan_next(table, cursor)) != NULL)
+        {
+            batch[nbatch++] = tuple;
+            if (nbatch == OP_BATCH_SIZE)
+            {
+                start->invoke_batch(start, batch, nbatch);
+                nbatch = 0;
+            }
+        }
+
+        if (nbatch > 0)
+            start->invoke_batch(start, batch, nbatch);
+        return;
+    }
+
+    if (op_chain->rederive_index == NULL)
+        op_chain->rederive_index =
+            mem_table_add_hash_index((MemTable *) table, nkeys,
+                                     op_chain->rederive_delta_cols);
+
+    key = apr_palloc(router->c4->tmp_pool, sizeof(Datum) * nkeys);
+    for (tt = overdel; tt != NULL; tt = tt->next)
+    {
+        HashIndexEntry *entry;
+        int i;
+
+        if (tt->ent.tbl_def != op_chain->head_tbl || tt->rederived)
+            continue;
+
+        for (i = 0; i < nkeys; i++)
+            key[i] = tuple_get_val(tt->ent.tuple, head_schema,
+                                   op_chain->rederive_head_cols[i]);
+
+        entry = hash_index_probe(op_chain->rederive_index, key);
+        for (; entry != NULL; entry = entry->next)
+        {
+            batch[nbatch++] = entry->tuple;
+            if (nbatch == OP_BATCH_SIZE)
+            {
+                start->invoke_batch(start, batch, nbatch);
+                nbatch = 0;
+            }
+        }
+    }
+
+    if (nbatch > 0)
+        start->invoke_batch(start, batch, nbatch);
+}
+
+/*
+ * Deletions from recursive tables use DRed ("delete and rederive"). Because
+ * a recursive table has set semantics, deleting a tuple always removes it,
+ * along with everything derived from it, even if the tuple has another
+ * derivation (this is the "over-deletion" phase). Once all the tuples in the
+ * stratum have been routed, we rederive the over-deleted tuples that are
+ * still supported by the remaining content of the database. Over-deleted
+ * base facts are always rederived. For the others, we invoke one op chain
+ * of each rule that derives the tuple's table (see plan_install_rules()),
+ * passing it just the delta tuples that agree with an over-deleted tuple on
+ * the columns that the head binds. While we're rederiving, the router drops
+ * any derived tuple that isn't an over-deleted tuple of the stratum (see
+ * router_insert_derived_tuple()). Rederived tuples are then routed as
+ * usual, which rederives the tuples that depend on them in turn.
+ *
+ * Aggregate rules are skipped, since re-invoking them would count their
+ * inputs twice; aggregate output can't be recursive in a stratifiable
+ * program anyway. Note that facts inserted into a table before it became
+ * recursive (i.e. by a program installed before the rule that made it
+ * recursive) are not known to be base facts.
+ *
+ * "stratum" is the lowest stratum with pending tuples, or -1 if there are
+ * none. Returns true if we rederived any tuples.
+ */
+static bool
+rederive_strata(C4Router *router, int stratum)
+{
+    int nstrata = (stratum == -1) ? router->nstrata : stratum;
+    TrackedTuple *overdel;
+    TrackedTuple *tt;
+    apr_hash_index_t *hi;
+    int i;
+
+    for (i = 0; i < nstrata; i++)
+    {
+        if (router->overdel_lists[i] != NULL)
+            break;
+    }
+
+    if (i == nstrata)
+        return false;
+
+    /* Tuples over-deleted from now on are rederived in a later round */
+    overdel = router->overdel_lists[i];
+    router->rederive_tbl = router->overdel_tbls[i];
+    router->overdel_lists[i] = NULL;
+    router->overdel_tbls[i] = NULL;
+
+    for (tt = overdel; tt != NULL; tt = tt->next)
+    {
+        if (tracked_tuple_get(router->base_facts, tt->ent.tuple,
+                              tt->ent.tbl_def) == NULL)
+            continue;
+
+        tt->rederived = true;
+        table_invoke_callbacks(tt->ent.tuple, tt->ent.tbl_def, false);
+        router_enqueue_internal(router, tt->ent.tuple, tt->ent.tbl_def);
+    }
+
+    router->routing_deletes = false;
+    for (hi = apr_hash_first(router->c4->tmp_pool, router->op_chain_tbl);
+         hi != NULL; hi = apr_hash_next(hi))
+    {
+        OpChainList *op_chain_list;
+        OpChain *op_chain;
+
+        apr_hash_this(hi, NULL, NULL, (void **) &op_chain_list);
+        for (op_chain = op_chain_list->head; op_chain != NULL;
+             op_chain = op_chain->next)
+        {
+            TableDef *head_tbl = op_chain->head_tbl;
+
+            if (!op_chain->rederive || !head_tbl->recursive ||
+                head_tbl->stratum != i)
+                continue;
+
+            rederive_op_chain(router, op_chain, overdel);
+        }
+    }
+
+    router->rederive_tbl = NULL;
+    for (tt = overdel; tt != NULL; tt = tt->next)
+        tuple_unpin(tt->ent.tuple, tt->ent.tbl_def->schema);
+
+    return true;
+}
+
+/*
+ * Route tuples until there are no more tuples to route. We route the tuples
+ * in each stratum only once all the tuples in lower strata have been routed;
+ * if routing tuples in a higher stratum derives new tuples in a lower stratum
+ * (which only happens for programs that are not stratifiable), we go back to
+ * the lower stratum. Over-deleted tuples in recursive tables are rederived
+ * once their stratum has been routed.
+ */
 static void
 router_do_fixpoint(C4Router *router)
 {
     TupleBuf *net_buf = router->net_buf;
+    int stratum;
 
-    while (!tuple_buf_is_empty(router->insert_buf) ||
-           !tuple_buf_is_empty(router->delete_buf))
+    while (true)
     {
-        route_tuple_buf(router, router->insert_buf, false);
-        route_tuple_buf(router, router->delete_buf, true);
+        TupleBuf *insert_buf;
+        TupleBuf *update_buf;
+        TupleBuf *delete_buf;
+
+        stratum = get_pending_stratum(router);
+        if (rederive_strata(router, stratum))
+            continue;
+        if (flush_dirty_aggs(router, stratum))
+            continue;
+        if (stratum == -1)
+            break;
+
+        insert_buf = router->insert_bufs[stratum];
+        update_buf = router->update_bufs[stratum];
+        delete_buf = router->delete_bufs[stratum];
+
+        if (!tuple_buf_is_empty(insert_buf) &&
+            !tuple_buf_is_empty(delete_buf))
+            cancel_insert_delete_pairs(router, stratum);
+
+        route_tuple_buf(router, insert_buf, false);
+        route_update_buf(router, update_buf);
+        route_tuple_buf(router, delete_buf, true);
     }
 
     /* If we modified persistent storage, commit to disk */
@@ -147,7 +850,8 @@ router_do_fixpoint(C4Router *router)
         TableDef *tbl_def;
 
         tuple_buf_shift(net_buf, &tuple, &tbl_def);
-        network_send(router->c4->net, tuple, tbl_def);
+        if (!exchange_send(router->c4->exchange, tuple, tbl_def))
+            network_send(router->c4->net, tuple, tbl_def);
         tuple_unpin(tuple, tbl_def->schema);
     }
 
@@ -184,6 +888,41 @@ router_insert_tuple(C4Router *router, Tuple *tuple, TableDef *tbl_def,
         return;
     }
 
+    if (tbl_def->recursive)
+        record_base_fact(router, tuple, tbl_def);
+
+    table_invoke_callbacks(tuple, tbl_def, false);
+    router_enqueue_internal(router, tuple, tbl_def);
+}
+
+/*
+ * Route a new tuple that has been derived by a rule. This is the same as
+ * router_insert_tuple() with "check_remote" set, except that the tuple is
+ * not a base fact. While we are rederiving over-deleted tuples (see
+ * rederive_strata()), we only route the over-deleted tuples that haven't
+ * been rederived yet: any other tuple the rule derives is either already
+ * present, or is remote and has been sent already.
+ */
+void
+router_insert_derived_tuple(C4Router *router, Tuple *tuple,
+                            TableDef *tbl_def)
+{
+    if (router->rederive_tbl != NULL)
+    {
+        TrackedTuple *tt;
+
+        tt = tracked_tuple_get(router->rederive_tbl, tuple, tbl_def);
+        if (tt == NULL || tt->rederived)
+            return;
+
+        tt->rederived = true;
+    }
+    else if (tuple_is_remote(tuple, tbl_def, router->c4))
+    {
+        tuple_buf_push(router->net_buf, tuple, tbl_def);
+        return;
+    }
+
     table_invoke_callbacks(tuple, tbl_def, false);
     router_enqueue_internal(router, tuple, tbl_def);
 }
@@ -198,7 +937,31 @@ router_delete_tuple(C4Router *router, Tuple *tuple, TableDef *tbl_def)
 #endif
 
     table_invoke_callbacks(tuple, tbl_def, true);
-    tuple_buf_push(router->delete_buf, tuple, tbl_def);
+    ASSERT(tbl_def->stratum < router->nstrata);
+    tuple_buf_push(router->delete_bufs[tbl_def->stratum], tuple, tbl_def);
+}
+
+/*
+ * Route an update that replaces "old_tuple" with "new_tuple". If the new
+ * tuple is remote, we instead delete the old tuple locally, and send the new
+ * tuple to the remote node (see router_insert_tuple()).
+ */
+void
+router_update_tuple(C4Router *router, Tuple *old_tuple, Tuple *new_tuple,
+                    TableDef *tbl_def, bool check_remote)
+{
+    if (check_remote && tuple_is_remote(new_tuple, tbl_def, router->c4))
+    {
+        router_delete_tuple(router, old_tuple, tbl_def);
+        router_insert_derived_tuple(router, new_tuple, tbl_def);
+        return;
+    }
+
+    table_invoke_callbacks(old_tuple, tbl_def, true);
+    table_invoke_callbacks(new_tuple, tbl_def, false);
+    ASSERT(tbl_def->stratum < router->nstrata);
+    tuple_buf_push_update(router->update_bufs[tbl_def->stratum],
+                          old_tuple, new_tuple, tbl_def);
 }
 
 static void
@@ -213,6 +976,23 @@ route_program(C4Router *router, const char *src)
     install_plan(plan, c4->tmp_pool, c4);
 }
 
+/*
+ * Plan the program, and emit C source for its compiled expressions to "buf",
+ * without installing it.
+ */
+static void
+compile_program(C4Router *router, const char *src, StrBuf *buf)
+{
+    C4Runtime *c4 = router->c4;
+    AstProgram *ast;
+    ProgramPlan *plan;
+
+    ast = parse_str(src, c4->tmp_pool, c4);
+    plan = plan_program(ast, c4->tmp_pool, c4);
+    codegen_program(plan, buf, c4->tmp_pool);
+    sbuf_append_char(buf, '\0');
+}
+
 void
 router_main_loop(C4Router *router)
 {
@@ -233,6 +1013,10 @@ router_main_loop(C4Router *router)
                 break;      /* Saw shutdown request */
         }
 
+        /* Route tuples sent by other C4 instances in this process */
+        if (exchange_drain(router->c4->exchange))
+            router_do_fixpoint(router);
+
         ASSERT(!has_pending_tuples(router));
     }
 }
@@ -261,6 +1045,14 @@ drain_queue(C4Router *router)
                 route_program(router, wi->program_src);
                 break;
 
+            case WI_COMPILE:
+                compile_program(router, wi->program_src, wi->buf);
+                break;
+
+            case WI_LOAD_LIBRARY:
+                codegen_load_library(router->c4, wi->lib_path);
+                break;
+
             case WI_DUMP_TABLE:
                 dump_table(router->c4, wi->tbl_name, wi->buf);
                 break;
@@ -354,7 +1146,20 @@ router_add_op_chain(C4Router *router, OpChain *op_chain)
 void
 router_enqueue_internal(C4Router *router, Tuple *tuple, TableDef *tbl_def)
 {
-    tuple_buf_push(router->insert_buf, tuple, tbl_def);
+    ASSERT(tbl_def->stratum < router->nstrata);
+    tuple_buf_push(router->insert_bufs[tbl_def->stratum], tuple, tbl_def);
+}
+
+/*
+ * Called by an agg when it has new dirty groups; the agg will be flushed
+ * once its inputs are quiescent.
+ */
+void
+router_add_dirty_agg(C4Router *router, AggOperator *agg_op)
+{
+    ASSERT(agg_op->next_dirty_agg == NULL);
+    agg_op->next_dirty_agg = router->dirty_aggs;
+    router->dirty_aggs = agg_op;
 }
 
 bool
@@ -362,3 +1167,9 @@ router_is_deleting(C4Router *router)
 {
     return router->routing_deletes;
 }
+
+void
+router_set_deleting(C4Router *router, bool is_deleting)
+{
+    router->routing_deletes = is_deleting;
+}
@@ -1,10 +1,14 @@
 #include "c4-internal.h"
+#include "net/exchange.h"
 #include "net/network.h"
 #include "router.h"
 #include "runtime.h"
 #include "storage/sqlite.h"
 #include "timer.h"
 #include "types/catalog.h"
+#include "util/host_tbl.h"
+#include "util/intern.h"
+#include "util/stats.h"
 
 static void * APR_THREAD_FUNC runtime_thread_main(apr_thread_t *thread,
                                                   void *data);
@@ -13,16 +17,19 @@ static Datum
 get_local_addr(int port, apr_pool_t *pool)
 {
     char buf[APRMAXHOSTLEN + 1];
-    char addr[APRMAXHOSTLEN + 1 + 20];
+    char addr_str[APRMAXHOSTLEN + 1 + 20];
     apr_status_t s;
+    Datum addr;
 
     s = apr_gethostname(buf, sizeof(buf), pool);
     if (s != APR_SUCCESS)
         FAIL_APR(s);
 
-    snprintf(addr, sizeof(addr), "tcp:%s:%d", buf, port);
-    printf("Local address = %s\n", addr);
-    return string_from_str(addr);
+    snprintf(addr_str, sizeof(addr_str), "tcp:%s:%d", buf, port);
+    if (!addr_resolve(addr_from_str(addr_str), &addr))
+        ERROR("Failed to resolve local host name \"%s\"", buf);
+    printf("Local address = %s (%s)\n", addr_str, addr_to_text(addr, pool));
+    return addr;
 }
 
 static char *
@@ -81,6 +88,12 @@ c4_runtime_make(int port)
     c4 = apr_pcalloc(pool, sizeof(*c4));
     c4->pool = pool;
     c4->tmp_pool = make_subpool(c4->pool);
+    /* Strings created by this thread are interned from now on */
+    c4->intern_tbl = intern_table_make(c4->pool);
+    intern_table_set_current(c4->intern_tbl);
+    /* Host names resolved by this thread are cached */
+    c4->host_cache = host_cache_make(c4->pool);
+    host_cache_set_current(c4->host_cache);
     c4->log = logger_make(c4);
     c4->cat = cat_make(c4);
     c4->net = network_make(c4, port);
@@ -91,6 +104,8 @@ c4_runtime_make(int port)
     c4->port = network_get_port(c4->net);
     c4->local_addr = get_local_addr(c4->port, c4->tmp_pool);
     c4->base_dir = get_c4_base_dir(c4->port, c4->pool, c4->tmp_pool);
+    c4->exchange = exchange_make(c4);
+    c4->compiled_exprs = apr_hash_make(c4->pool);
 
     return c4;
 }
@@ -159,6 +174,7 @@ runtime_thread_main(apr_thread_t *thread, void *data)
     router_main_loop(c4->router);
 
     /* Client initiated an orderly shutdown */
+    stats_log(c4);
     apr_pool_destroy(c4->pool);
     apr_thread_exit(thread, APR_SUCCESS);
 
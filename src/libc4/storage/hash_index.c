@@ -0,0 +1,254 @@
+#include "c4-internal.h"
+#include "storage/hash_index.h"
+#include "util/hash_func.h"
+
+static apr_status_t hash_index_cleanup(void *data);
+
+static unsigned int
+bucket_tbl_hash(const char *key, int klen, void *data)
+{
+    Datum *key_vals = (Datum *) key;
+    HashIndex *idx = (HashIndex *) data;
+    unsigned int result;
+    int i;
+
+    ASSERT(klen == sizeof(Datum *));
+    result = 0;
+    for (i = 0; i < idx->ncols; i++)
+    {
+        int colno = idx->colnos[i];
+        apr_uint32_t h;
+
+        h = (idx->schema->hash_funcs[colno])(key_vals[i]);
+        result = hash_combine(result, h);
+    }
+
+    return result;
+}
+
+static bool
+bucket_tbl_cmp(const void *k1, const void *k2, int klen, void *data)
+{
+    Datum *key1 = (Datum *) k1;
+    Datum *key2 = (Datum *) k2;
+    HashIndex *idx = (HashIndex *) data;
+    int i;
+
+    ASSERT(klen == sizeof(Datum *));
+    for (i = 0; i < idx->ncols; i++)
+    {
+        int colno = idx->colnos[i];
+
+        if (!(idx->schema->eq_funcs[colno])(key1[i], key2[i]))
+            return false;
+    }
+
+    return true;
+}
+
+HashIndex *
+hash_index_make(Schema *schema, int ncols, int *colnos, apr_pool_t *pool)
+{
+    HashIndex *idx;
+
+    ASSERT(ncols > 0);
+
+    idx = apr_palloc(pool, sizeof(*idx));
+    idx->pool = pool;
+    idx->schema = schema;
+    idx->ncols = ncols;
+    idx->colnos = apr_pmemdup(pool, colnos, ncols * sizeof(*colnos));
+    idx->tmp_key = apr_palloc(pool, ncols * sizeof(*idx->tmp_key));
+    idx->free_buckets = NULL;
+    idx->free_entries = NULL;
+    idx->bucket_tbl = c4_hash_make(pool, sizeof(Datum *), idx,
+                                   bucket_tbl_hash, bucket_tbl_cmp);
+
+    apr_pool_cleanup_register(pool, idx, hash_index_cleanup,
+                              apr_pool_cleanup_null);
+
+    return idx;
+}
+
+/*
+ * Does this index have exactly the given key columns (in order)?
+ */
+bool
+hash_index_has_cols(HashIndex *idx, int ncols, int *colnos)
+{
+    int i;
+
+    if (idx->ncols != ncols)
+        return false;
+
+    for (i = 0; i < ncols; i++)
+    {
+        if (idx->colnos[i] != colnos[i])
+            return false;
+    }
+
+    return true;
+}
+
+static void
+fill_tmp_key(HashIndex *idx, Tuple *t)
+{
+    int i;
+
+    for (i = 0; i < idx->ncols; i++)
+        idx->tmp_key[i] = tuple_get_val(t, idx->schema, idx->colnos[i]);
+}
+
+static HashIndexBucket *
+make_bucket(HashIndex *idx)
+{
+    HashIndexBucket *bucket;
+    int i;
+
+    if (idx->free_buckets != NULL)
+    {
+        bucket = idx->free_buckets;
+        idx->free_buckets = bucket->next_free;
+    }
+    else
+    {
+        bucket = apr_palloc(idx->pool, sizeof(*bucket));
+        bucket->key = apr_palloc(idx->pool,
+                                 idx->ncols * sizeof(*bucket->key));
+    }
+
+    for (i = 0; i < idx->ncols; i++)
+    {
+        DataType type = schema_get_type(idx->schema, idx->colnos[i]);
+
+        bucket->key[i] = datum_copy(idx->tmp_key[i], type);
+    }
+
+    bucket->entries = NULL;
+    bucket->next_free = NULL;
+    return bucket;
+}
+
+static void
+release_bucket_key(HashIndex *idx, HashIndexBucket *bucket)
+{
+    int i;
+
+    for (i = 0; i < idx->ncols; i++)
+    {
+        DataType type = schema_get_type(idx->schema, idx->colnos[i]);
+
+        datum_free(bucket->key[i], type);
+    }
+}
+
+void
+hash_index_add(HashIndex *idx, Tuple *t)
+{
+    HashIndexBucket *bucket;
+    HashIndexEntry *entry;
+
+    fill_tmp_key(idx, t);
+    bucket = c4_hash_get(idx->bucket_tbl, idx->tmp_key);
+    if (bucket == NULL)
+    {
+        bucket = make_bucket(idx);
+        c4_hash_set(idx->bucket_tbl, bucket->key, bucket);
+    }
+
+    if (idx->free_entries != NULL)
+    {
+        entry = idx->free_entries;
+        idx->free_entries = entry->next;
+    }
+    else
+    {
+        entry = apr_palloc(idx->pool, sizeof(*entry));
+    }
+
+    entry->tuple = t;
+    entry->next = bucket->entries;
+    bucket->entries = entry;
+}
+
+/*
+ * Remove the given tuple from the index. Note that we compare tuples by
+ * pointer, so the caller must pass the same Tuple that was added to the
+ * index.
+ */
+void
+hash_index_remove(HashIndex *idx, Tuple *t)
+{
+    HashIndexBucket *bucket;
+    HashIndexEntry *entry;
+    HashIndexEntry *prev;
+
+    fill_tmp_key(idx, t);
+    bucket = c4_hash_get(idx->bucket_tbl, idx->tmp_key);
+    if (bucket == NULL)
+        ERROR("Failed to find index bucket for tuple");
+
+    prev = NULL;
+    for (entry = bucket->entries; entry != NULL; entry = entry->next)
+    {
+        if (entry->tuple == t)
+            break;
+
+        prev = entry;
+    }
+
+    if (entry == NULL)
+        ERROR("Failed to find tuple in index bucket");
+
+    if (prev == NULL)
+        bucket->entries = entry->next;
+    else
+        prev->next = entry->next;
+
+    entry->tuple = NULL;
+    entry->next = idx->free_entries;
+    idx->free_entries = entry;
+
+    if (bucket->entries == NULL)
+    {
+        c4_hash_remove(idx->bucket_tbl, bucket->key);
+        release_bucket_key(idx, bucket);
+        bucket->next_free = idx->free_buckets;
+        idx->free_buckets = bucket;
+    }
+}
+
+/*
+ * Return the entries of the index that have the given key values, or NULL
+ * if there are no such entries. The "key" array is indexed by key column
+ * position, not by column number in the table's schema.
+ */
+HashIndexEntry *
+hash_index_probe(HashIndex *idx, Datum *key)
+{
+    HashIndexBucket *bucket;
+
+    bucket = c4_hash_get(idx->bucket_tbl, key);
+    if (bucket == NULL)
+        return NULL;
+
+    return bucket->entries;
+}
+
+static apr_status_t
+hash_index_cleanup(void *data)
+{
+    HashIndex *idx = (HashIndex *) data;
+    c4_hash_index_t *hi;
+
+    hi = c4_hash_iter_make(idx->pool, idx->bucket_tbl);
+    while (c4_hash_iter_next(hi))
+    {
+        HashIndexBucket *bucket;
+
+        bucket = c4_hash_this_val(hi);
+        release_bucket_key(idx, bucket);
+    }
+
+    return APR_SUCCESS;
+}
@@ -27,10 +27,37 @@ mem_table_insert(AbstractTable *a_tbl, Tuple *t)
     MemTable *tbl = (MemTable *) a_tbl;
     bool is_new;
 
+    /*
+     * Recursive tables have set semantics: a tuple is stored at most once,
+     * regardless of how many derivations it has. Derivation counts are not
+     * meaningful for recursive rules, since a tuple can (indirectly) support
+     * itself; instead, the router uses DRed to handle deletions.
+     */
+    if (a_tbl->def->recursive && rset_get(tbl->tuples, t) > 0)
+        return false;
+
     is_new = rset_add(tbl->tuples, t);
     if (is_new)
+    {
+        ListCell *lc;
+
         tuple_pin(t);
 
+        foreach (lc, tbl->hash_indexes)
+        {
+            HashIndex *idx = (HashIndex *) lc_ptr(lc);
+
+            hash_index_add(idx, t);
+        }
+
+        foreach (lc, tbl->ordered_indexes)
+        {
+            OrderedIndex *idx = (OrderedIndex *) lc_ptr(lc);
+
+            ordered_index_add(idx, t);
+        }
+    }
+
     return is_new;
 }
 
@@ -42,8 +69,33 @@ mem_table_delete(AbstractTable *a_tbl, Tuple *t)
     unsigned int new_count;
 
     old_t = rset_remove(tbl->tuples, t, &new_count);
+
+    /*
+     * A table that became recursive when a new rule was installed might
+     * still contain tuples with a count > 1; since recursive tables have set
+     * semantics, a deletion always removes the tuple.
+     */
+    while (old_t != NULL && new_count > 0 && a_tbl->def->recursive)
+        (void) rset_remove(tbl->tuples, t, &new_count);
+
     if (old_t != NULL && new_count == 0)
     {
+        ListCell *lc;
+
+        foreach (lc, tbl->hash_indexes)
+        {
+            HashIndex *idx = (HashIndex *) lc_ptr(lc);
+
+            hash_index_remove(idx, old_t);
+        }
+
+        foreach (lc, tbl->ordered_indexes)
+        {
+            OrderedIndex *idx = (OrderedIndex *) lc_ptr(lc);
+
+            ordered_index_remove(idx, old_t);
+        }
+
         tuple_unpin(old_t, a_tbl->def->schema);
         return true;
     }
@@ -95,6 +147,69 @@ mem_table_make(TableDef *def, C4Runtime *c4, apr_pool_t *pool)
                                         pool);
     tbl->tuples = rset_make(pool, def->schema,
                             tuple_hash_tbl, tuple_cmp_tbl);
+    tbl->hash_indexes = list_make(pool);
+    tbl->ordered_indexes = list_make(pool);
 
     return tbl;
 }
+
+/*
+ * Return a hash index on the given key columns, creating it if necessary.
+ * Indexes are shared by all the operators that probe the same table on the
+ * same key columns; a new index is populated with the current content of
+ * the table.
+ */
+HashIndex *
+mem_table_add_hash_index(MemTable *tbl, int ncols, int *colnos)
+{
+    AbstractTable *a_tbl = (AbstractTable *) tbl;
+    HashIndex *idx;
+    ListCell *lc;
+    rset_index_t *ri;
+
+    foreach (lc, tbl->hash_indexes)
+    {
+        idx = (HashIndex *) lc_ptr(lc);
+
+        if (hash_index_has_cols(idx, ncols, colnos))
+            return idx;
+    }
+
+    idx = hash_index_make(a_tbl->def->schema, ncols, colnos, a_tbl->pool);
+
+    ri = rset_iter_make(a_tbl->pool, tbl->tuples);
+    while (rset_iter_next(ri))
+        hash_index_add(idx, rset_this(ri));
+
+    list_append(tbl->hash_indexes, idx);
+    return idx;
+}
+
+/*
+ * Return an ordered index on the given column, creating it if necessary.
+ */
+OrderedIndex *
+mem_table_add_ordered_index(MemTable *tbl, int colno)
+{
+    AbstractTable *a_tbl = (AbstractTable *) tbl;
+    OrderedIndex *idx;
+    ListCell *lc;
+    rset_index_t *ri;
+
+    foreach (lc, tbl->ordered_indexes)
+    {
+        idx = (OrderedIndex *) lc_ptr(lc);
+
+        if (idx->colno == colno)
+            return idx;
+    }
+
+    idx = ordered_index_make(a_tbl->def->schema, colno, a_tbl->pool);
+
+    ri = rset_iter_make(a_tbl->pool, tbl->tuples);
+    while (rset_iter_next(ri))
+        ordered_index_add(idx, rset_this(ri));
+
+    list_append(tbl->ordered_indexes, idx);
+    return idx;
+}
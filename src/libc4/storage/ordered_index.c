@@ -0,0 +1,144 @@
+#include "c4-internal.h"
+#include "storage/ordered_index.h"
+#include "types/catalog.h"
+
+static int
+ordered_index_node_cmp(struct ordered_index_tree *tree,
+                       OrderedIndexNode *n1, OrderedIndexNode *n2)
+{
+    OrderedIndex *idx = (OrderedIndex *) tree->opaque;
+    apr_uintptr_t p1;
+    apr_uintptr_t p2;
+    int result;
+
+    result = idx->cmp_func(n1->key, n2->key);
+    if (result != 0)
+        return result;
+
+    /* Only the search key (the first argument) can have a bound */
+    if (n1->bound != 0)
+        return n1->bound;
+
+    p1 = (apr_uintptr_t) n1->tuple;
+    p2 = (apr_uintptr_t) n2->tuple;
+    if (p1 < p2)
+        return -1;
+    if (p1 > p2)
+        return 1;
+    return 0;
+}
+
+RB_GENERATE_STATIC(ordered_index_tree, OrderedIndexNode, entry,
+                   ordered_index_node_cmp)
+
+OrderedIndex *
+ordered_index_make(Schema *schema, int colno, apr_pool_t *pool)
+{
+    OrderedIndex *idx;
+
+    idx = apr_palloc(pool, sizeof(*idx));
+    idx->pool = pool;
+    idx->schema = schema;
+    idx->colno = colno;
+    idx->cmp_func = type_get_cmp_func(schema_get_type(schema, colno));
+    idx->free_head = NULL;
+    RB_INIT(&idx->tree, idx);
+
+    return idx;
+}
+
+void
+ordered_index_add(OrderedIndex *idx, Tuple *t)
+{
+    OrderedIndexNode *n;
+
+    if (idx->free_head != NULL)
+    {
+        n = idx->free_head;
+        idx->free_head = n->next_free;
+    }
+    else
+    {
+        n = apr_palloc(idx->pool, sizeof(*n));
+    }
+
+    n->key = tuple_get_val(t, idx->schema, idx->colno);
+    n->tuple = t;
+    n->bound = 0;
+    n->next_free = NULL;
+
+    if (RB_INSERT(ordered_index_tree, &idx->tree, n) != NULL)
+        ERROR("Duplicate tuple in ordered index");
+}
+
+void
+ordered_index_remove(OrderedIndex *idx, Tuple *t)
+{
+    OrderedIndexNode find;
+    OrderedIndexNode *n;
+
+    find.key = tuple_get_val(t, idx->schema, idx->colno);
+    find.tuple = t;
+    find.bound = 0;
+
+    n = RB_FIND(ordered_index_tree, &idx->tree, &find);
+    if (n == NULL)
+        ERROR("Failed to find tuple in ordered index");
+
+    RB_REMOVE(ordered_index_tree, &idx->tree, n);
+    n->tuple = NULL;
+    n->next_free = idx->free_head;
+    idx->free_head = n;
+}
+
+/*
+ * Position the cursor at the first tuple whose key is within the given
+ * bounds. A NULL bound means that the range is unbounded in that direction.
+ */
+void
+ordered_index_scan_reset(OrderedIndex *idx, ScanCursor *cur,
+                         Datum *lower, bool lower_incl,
+                         Datum *upper, bool upper_incl)
+{
+    if (lower != NULL)
+    {
+        OrderedIndexNode find;
+
+        find.key = *lower;
+        find.tuple = NULL;
+        find.bound = lower_incl ? -1 : 1;
+        cur->range_next = RB_NFIND(ordered_index_tree, &idx->tree, &find);
+    }
+    else
+    {
+        cur->range_next = RB_MIN(ordered_index_tree, &idx->tree);
+    }
+
+    cur->range_has_upper = (upper != NULL);
+    if (upper != NULL)
+        cur->range_upper = *upper;
+    cur->range_upper_incl = upper_incl;
+}
+
+Tuple *
+ordered_index_scan_next(OrderedIndex *idx, ScanCursor *cur)
+{
+    OrderedIndexNode *n = cur->range_next;
+
+    if (n == NULL)
+        return NULL;
+
+    if (cur->range_has_upper)
+    {
+        int cmp = idx->cmp_func(n->key, cur->range_upper);
+
+        if (cmp > 0 || (cmp == 0 && !cur->range_upper_incl))
+        {
+            cur->range_next = NULL;
+            return NULL;
+        }
+    }
+
+    cur->range_next = RB_NEXT(ordered_index_tree, &idx->tree, n);
+    return n->tuple;
+}
@@ -30,6 +30,7 @@ sqlite_table_create_sql(SQLiteTable *tbl)
             case TYPE_BOOL:
             case TYPE_CHAR:
             case TYPE_INT:
+            case TYPE_ADDR:
                 sbuf_appendf(stmt, "c%d integer", i);
                 sbuf_appendf(pkeys, "c%d", i);
                 break;
@@ -106,7 +107,7 @@ sqlite_table_insert(AbstractTable *a_tbl, Tuple *t)
 
     for (i = 0; i < tbl_def->schema->len; i++)
     {
-        Datum val = tuple_get_val(t, i);
+        Datum val = tuple_get_val(t, tbl_def->schema, i);
 
         switch (types[i])
         {
@@ -119,12 +120,24 @@ sqlite_table_insert(AbstractTable *a_tbl, Tuple *t)
             case TYPE_INT:
                 sqlite3_bind_int64(tbl->insert_stmt, i + 1, val.i8);
                 break;
+            case TYPE_ADDR:
+                /* Host IDs are local to a process, so store names as text */
+                if (addr_is_named(val))
+                    sqlite3_bind_text(tbl->insert_stmt, i + 1,
+                                      addr_to_text(val, a_tbl->c4->tmp_pool),
+                                      -1, SQLITE_TRANSIENT);
+                else
+                    sqlite3_bind_int64(tbl->insert_stmt, i + 1, val.i8);
+                break;
             case TYPE_DOUBLE:
                 sqlite3_bind_double(tbl->insert_stmt, i + 1, val.d8);
                 break;
             case TYPE_STRING:
-                sqlite3_bind_text(tbl->insert_stmt, i + 1, val.s->data,
-                                  val.s->len, SQLITE_STATIC);
+                /* Inline strings point into "val", so SQLite must copy them */
+                sqlite3_bind_text(tbl->insert_stmt, i + 1,
+                                  string_get_data(&val), string_get_len(&val),
+                                  string_is_inline(val) ?
+                                  SQLITE_TRANSIENT : SQLITE_STATIC);
                 break;
 
             case TYPE_INVALID:
@@ -219,6 +232,16 @@ sqlite_table_scan_next(AbstractTable *a_tbl, ScanCursor *scan)
             case TYPE_INT:
                 d.i8 = (apr_int64_t) sqlite3_column_int64(scan->sqlite_stmt, i);
                 break;
+            case TYPE_ADDR:
+                /* See sqlite_table_insert() */
+                if (sqlite3_column_type(scan->sqlite_stmt, i) == SQLITE_TEXT)
+                    d = addr_from_str((const char *)
+                                      sqlite3_column_text(scan->sqlite_stmt,
+                                                          i));
+                else
+                    d.i8 = (apr_int64_t)
+                        sqlite3_column_int64(scan->sqlite_stmt, i);
+                break;
             case TYPE_DOUBLE:
                 d.d8 = (double) sqlite3_column_double(scan->sqlite_stmt, i);
                 break;
@@ -232,7 +255,7 @@ sqlite_table_scan_next(AbstractTable *a_tbl, ScanCursor *scan)
                 ERROR("Unexpected data type: %uc", schema->types[i]);
         }
 
-        tuple->vals[i] = d;
+        tuple_set_val(tuple, schema, i, d);
     }
 
     return tuple;
@@ -6,15 +6,22 @@ typedef struct AlarmState
 {
     apr_interval_time_t period;
     apr_interval_time_t deadline;
+    AstTimerPolicy policy;
     TableDef *tbl_def;
-    struct AlarmState *next;
 } AlarmState;
 
+/*
+ * Alarms are kept in a binary min-heap ordered by deadline, so that finding
+ * the next alarm to fire is O(1), and adding or re-arming an alarm is
+ * O(log n).
+ */
 struct C4Timer
 {
     apr_pool_t *pool;
     C4Runtime *c4;
-    AlarmState *alarm;
+    AlarmState **heap;
+    int nalarms;
+    int heap_size;
 };
 
 C4Timer *
@@ -25,10 +32,82 @@ timer_make(C4Runtime *c4)
     timer = apr_palloc(c4->pool, sizeof(*timer));
     timer->pool = c4->pool;
     timer->c4 = c4;
-    timer->alarm = NULL;
+    timer->heap_size = 16;
+    timer->heap = apr_palloc(timer->pool,
+                             sizeof(AlarmState *) * timer->heap_size);
+    timer->nalarms = 0;
     return timer;
 }
 
+static void
+heap_sift_up(C4Timer *timer, int i)
+{
+    AlarmState **heap = timer->heap;
+    AlarmState *alarm = heap[i];
+
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+
+        if (heap[parent]->deadline <= alarm->deadline)
+            break;
+
+        heap[i] = heap[parent];
+        i = parent;
+    }
+
+    heap[i] = alarm;
+}
+
+static void
+heap_sift_down(C4Timer *timer, int i)
+{
+    AlarmState **heap = timer->heap;
+    AlarmState *alarm = heap[i];
+
+    while (true)
+    {
+        int child = (2 * i) + 1;
+
+        if (child >= timer->nalarms)
+            break;
+        if (child + 1 < timer->nalarms &&
+            heap[child + 1]->deadline < heap[child]->deadline)
+            child++;
+        if (alarm->deadline <= heap[child]->deadline)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = alarm;
+}
+
+/*
+ * Add an alarm to the heap. We don't bother reclaiming the space used by the
+ * old heap array when we grow it, since alarms are only added when a program
+ * is installed.
+ */
+static void
+heap_add(C4Timer *timer, AlarmState *alarm)
+{
+    if (timer->nalarms == timer->heap_size)
+    {
+        AlarmState **new_heap;
+
+        new_heap = apr_palloc(timer->pool,
+                              sizeof(AlarmState *) * timer->heap_size * 2);
+        memcpy(new_heap, timer->heap,
+               sizeof(AlarmState *) * timer->nalarms);
+        timer->heap = new_heap;
+        timer->heap_size *= 2;
+    }
+
+    timer->heap[timer->nalarms++] = alarm;
+    heap_sift_up(timer, timer->nalarms - 1);
+}
+
 static apr_time_t
 get_deadline(apr_time_t now, apr_interval_time_t delta)
 {
@@ -40,16 +119,17 @@ get_deadline(apr_time_t now, apr_interval_time_t delta)
 }
 
 void
-timer_add_alarm(C4Timer *timer, const char *name, apr_int64_t period_msec)
+timer_add_alarm(C4Timer *timer, const char *name, apr_int64_t period_msec,
+                AstTimerPolicy policy)
 {
     AlarmState *alarm;
 
     alarm = apr_palloc(timer->pool, sizeof(*alarm));
     alarm->period = period_msec * 1000;
     alarm->deadline = get_deadline(apr_time_now(), alarm->period);
+    alarm->policy = policy;
     alarm->tbl_def = cat_get_table(timer->c4->cat, name);
-    alarm->next = timer->alarm;
-    timer->alarm = alarm;
+    heap_add(timer, alarm);
 }
 
 /*
@@ -61,39 +141,42 @@ timer_get_sleep_time(C4Timer *timer)
 {
     apr_time_t min_deadline;
     apr_time_t now;
-    AlarmState *alarm;
 
-    if (timer->alarm == NULL)
+    if (timer->nalarms == 0)
         return -1;
 
-    min_deadline = APR_INT64_MAX;
+    min_deadline = timer->heap[0]->deadline;
     now = apr_time_now();
-    alarm = timer->alarm;
-    while (alarm != NULL)
-    {
-        /* If we should have fired the alarm already, don't sleep */
-        if (alarm->deadline <= now)
-            return 0;
 
-        if (alarm->deadline < min_deadline)
-            min_deadline = alarm->deadline;
+    /* If we should have fired the alarm already, don't sleep */
+    if (min_deadline <= now)
+        return 0;
 
-        alarm = alarm->next;
-    }
-
-    ASSERT(min_deadline > now);
-    ASSERT(min_deadline < APR_INT64_MAX);
     return min_deadline - now;
 }
 
+/*
+ * Fire an alarm whose deadline has passed, and advance its deadline. Unless
+ * the alarm fires once per period, we fire once for all the periods that
+ * have elapsed, using the most recent deadline.
+ */
 static void
-fire_alarm(AlarmState *alarm, C4Timer *timer)
+fire_alarm(AlarmState *alarm, C4Timer *timer, apr_time_t now)
 {
-    Datum time_val;
+    Datum vals[2];
     Tuple *alarm_tuple;
-
-    time_val.i8 = alarm->deadline;
-    alarm_tuple = tuple_make(alarm->tbl_def->schema, &time_val);
+    apr_int64_t nperiods;
+
+    ASSERT(alarm->deadline <= now);
+    if (alarm->policy == AST_TIMER_FIRE_ALL)
+        nperiods = 1;
+    else
+        nperiods = ((now - alarm->deadline) / alarm->period) + 1;
+
+    alarm->deadline += (nperiods - 1) * alarm->period;
+    vals[0].i8 = alarm->deadline;
+    vals[1].i8 = nperiods;
+    alarm_tuple = tuple_make(alarm->tbl_def->schema, vals);
     router_insert_tuple(timer->c4->router, alarm_tuple,
                         alarm->tbl_def, false);
     tuple_unpin(alarm_tuple, alarm->tbl_def->schema);
@@ -105,22 +188,24 @@ bool
 timer_poll(C4Timer *timer)
 {
     apr_time_t now;
-    AlarmState *alarm;
     bool fired_alarm;
 
+    if (timer->nalarms == 0)
+        return false;
+
     fired_alarm = false;
     now = apr_time_now();
-    alarm = timer->alarm;
-    while (alarm != NULL)
+
+    /*
+     * Fire the earliest alarm and re-insert it with its new deadline, until
+     * no alarm is due. NB: we might fire the same alarm many times, unless
+     * its policy is to fire only once for all the elapsed periods.
+     */
+    while (timer->heap[0]->deadline <= now)
     {
-        /* NB: we might fire many times before advancing to the next alarm */
-        if (alarm->deadline <= now)
-        {
-            fire_alarm(alarm, timer);
-            fired_alarm = true;
-        }
-        else
-            alarm = alarm->next;
+        fire_alarm(timer->heap[0], timer, now);
+        heap_sift_down(timer, 0);
+        fired_alarm = true;
     }
 
     return fired_alarm;
@@ -14,8 +14,26 @@ struct C4Catalog
 
     /* A map from table names => TableDef */
     apr_hash_t *tbl_def_tbl;
+
+    /* The ID to assign to the next table that is defined */
+    int next_tbl_id;
+
+    /* List of TableDep: edges in the rule dependency graph */
+    List *deps;
 };
 
+/*
+ * An edge in the rule dependency graph: tuples in "from" are used to derive
+ * tuples in "to". The dependency is "strict" if "to" can only be computed
+ * correctly once "from" is complete (negation and aggregation).
+ */
+typedef struct TableDep
+{
+    char *from;
+    char *to;
+    bool strict;
+} TableDep;
+
 C4Catalog *
 cat_make(C4Runtime *c4)
 {
@@ -27,6 +45,7 @@ cat_make(C4Runtime *c4)
     cat->c4 = c4;
     cat->pool = pool;
     cat->tbl_def_tbl = apr_hash_make(cat->pool);
+    cat->deps = list_make(cat->pool);
 
     return cat;
 }
@@ -71,7 +90,10 @@ cat_define_table(C4Catalog *cat, const char *name,
     tbl_def->name = apr_pstrdup(tbl_pool, name);
     tbl_def->storage = storage;
     tbl_def->schema = schema_make_from_ast(schema, cat->c4, tbl_pool);
+    tbl_def->id = cat->next_tbl_id++;
     tbl_def->ls_colno = find_loc_spec_colno(schema);
+    tbl_def->stratum = 0;
+    tbl_def->recursive = false;
     tbl_def->cb = NULL;
     tbl_def->table = table_make(tbl_def, cat->c4, tbl_pool);
     tbl_def->op_chain_list = router_get_opchain_list(cat->c4->router,
@@ -119,6 +141,150 @@ cat_get_table_impl(C4Catalog *cat, const char *name)
     return (cat_get_table(cat, name))->table;
 }
 
+/*
+ * Record that tuples in table "from" are used to derive tuples in table
+ * "to". If the dependency is already known, this is a no-op.
+ */
+void
+cat_add_dependency(C4Catalog *cat, const char *from, const char *to,
+                   bool strict)
+{
+    TableDep *dep;
+    ListCell *lc;
+
+    foreach (lc, cat->deps)
+    {
+        dep = (TableDep *) lc_ptr(lc);
+
+        if (strcmp(dep->from, from) == 0 && strcmp(dep->to, to) == 0)
+        {
+            dep->strict = (dep->strict || strict);
+            return;
+        }
+    }
+
+    dep = apr_palloc(cat->pool, sizeof(*dep));
+    dep->from = apr_pstrdup(cat->pool, from);
+    dep->to = apr_pstrdup(cat->pool, to);
+    dep->strict = strict;
+    list_append(cat->deps, dep);
+}
+
+/*
+ * Is "target" reachable from "from" in the dependency graph? "visited"
+ * records the tables we have already searched from.
+ */
+static bool
+table_reaches(C4Catalog *cat, const char *from, const char *target,
+              apr_hash_t *visited)
+{
+    ListCell *lc;
+
+    if (apr_hash_get(visited, from, APR_HASH_KEY_STRING) != NULL)
+        return false;
+    apr_hash_set(visited, from, APR_HASH_KEY_STRING, from);
+
+    foreach (lc, cat->deps)
+    {
+        TableDep *dep = (TableDep *) lc_ptr(lc);
+
+        if (strcmp(dep->from, from) != 0)
+            continue;
+
+        if (strcmp(dep->to, target) == 0 ||
+            table_reaches(cat, dep->to, target, visited))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Assign a stratum to every table, such that a table's stratum is >= the
+ * stratum of every table it depends on, and > the stratum of every table it
+ * strictly depends on. We compute the longest path from a source in the
+ * dependency graph, where strict edges have weight 1 and other edges have
+ * weight 0. If the program is not stratifiable (a cycle contains a strict
+ * edge), we give up after enough passes to have reached a fixpoint
+ * otherwise; the resulting strata are still safe to use, since they only
+ * affect the order in which tuples are routed. We also mark the tables that
+ * depend on themselves as recursive. Returns the number of strata.
+ */
+int
+cat_stratify(C4Catalog *cat)
+{
+    apr_hash_index_t *hi;
+    int ntables;
+    int npasses;
+    int max_stratum;
+    bool changed;
+
+    ntables = 0;
+    for (hi = apr_hash_first(cat->c4->tmp_pool, cat->tbl_def_tbl);
+         hi != NULL; hi = apr_hash_next(hi))
+    {
+        TableDef *tbl_def;
+
+        apr_hash_this(hi, NULL, NULL, (void **) &tbl_def);
+        tbl_def->stratum = 0;
+        ntables++;
+    }
+
+    npasses = 0;
+    do
+    {
+        ListCell *lc;
+
+        changed = false;
+        foreach (lc, cat->deps)
+        {
+            TableDep *dep = (TableDep *) lc_ptr(lc);
+            TableDef *from;
+            TableDef *to;
+            int min_stratum;
+
+            from = apr_hash_get(cat->tbl_def_tbl, dep->from,
+                                APR_HASH_KEY_STRING);
+            to = apr_hash_get(cat->tbl_def_tbl, dep->to,
+                              APR_HASH_KEY_STRING);
+            if (from == NULL || to == NULL)
+                continue;
+
+            min_stratum = from->stratum + (dep->strict ? 1 : 0);
+            if (to->stratum < min_stratum)
+            {
+                to->stratum = min_stratum;
+                changed = true;
+            }
+        }
+
+        if (changed && ++npasses > ntables)
+        {
+            c4_log(cat->c4, "Program is not stratifiable: cycle through "
+                   "negation or aggregation");
+            break;
+        }
+    } while (changed);
+
+    max_stratum = 0;
+    for (hi = apr_hash_first(cat->c4->tmp_pool, cat->tbl_def_tbl);
+         hi != NULL; hi = apr_hash_next(hi))
+    {
+        TableDef *tbl_def;
+        apr_hash_t *visited;
+
+        apr_hash_this(hi, NULL, NULL, (void **) &tbl_def);
+        max_stratum = Max(max_stratum, tbl_def->stratum);
+
+        visited = apr_hash_make(cat->c4->tmp_pool);
+        tbl_def->recursive = (tbl_def->storage == AST_STORAGE_MEMORY &&
+                              table_reaches(cat, tbl_def->name,
+                                            tbl_def->name, visited));
+    }
+
+    return max_stratum + 1;
+}
+
 void
 cat_register_callback(C4Catalog *cat, const char *tbl_name,
                       C4TupleCallback callback, void *data)
@@ -180,6 +346,8 @@ get_type_id(const char *type_name)
         return TYPE_INT;
     if (strcmp(type_name, "string") == 0)
         return TYPE_STRING;
+    if (strcmp(type_name, "addr") == 0)
+        return TYPE_ADDR;
 
     return TYPE_INVALID;
 }
@@ -201,6 +369,8 @@ get_type_name(DataType type_id)
             return "int";
         case TYPE_STRING:
             return "string";
+        case TYPE_ADDR:
+            return "addr";
 
         default:
             ERROR("Unexpected type id: %d", type_id);
@@ -227,6 +397,9 @@ type_get_hash_func(DataType type)
         case TYPE_STRING:
             return string_hash;
 
+        case TYPE_ADDR:
+            return addr_hash;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -255,6 +428,9 @@ type_get_eq_func(DataType type)
         case TYPE_STRING:
             return string_equal;
 
+        case TYPE_ADDR:
+            return addr_equal;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -283,6 +459,9 @@ type_get_cmp_func(DataType type)
         case TYPE_STRING:
             return string_cmp;
 
+        case TYPE_ADDR:
+            return addr_cmp;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -311,6 +490,9 @@ type_get_binary_in_func(DataType type)
         case TYPE_STRING:
             return string_from_buf;
 
+        case TYPE_ADDR:
+            return addr_from_buf;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -319,6 +501,30 @@ type_get_binary_in_func(DataType type)
     }
 }
 
+/*
+ * Returns a function pointer that converts a datum from the compact binary
+ * format into the in-memory format. Only some types have a distinct compact
+ * format; for the others, this is the standard binary input function.
+ */
+datum_bin_in_func
+type_get_compact_in_func(DataType type)
+{
+    switch (type)
+    {
+        case TYPE_INT:
+            return int_from_buf_compact;
+
+        case TYPE_STRING:
+            return string_from_buf_compact;
+
+        case TYPE_ADDR:
+            return addr_from_buf_compact;
+
+        default:
+            return type_get_binary_in_func(type);
+    }
+}
+
 datum_text_in_func
 type_get_text_in_func(DataType type)
 {
@@ -339,6 +545,9 @@ type_get_text_in_func(DataType type)
         case TYPE_STRING:
             return string_from_str;
 
+        case TYPE_ADDR:
+            return addr_from_str;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -371,6 +580,9 @@ type_get_binary_out_func(DataType type)
         case TYPE_STRING:
             return string_to_buf;
 
+        case TYPE_ADDR:
+            return addr_to_buf;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -379,6 +591,25 @@ type_get_binary_out_func(DataType type)
     }
 }
 
+datum_bin_out_func
+type_get_compact_out_func(DataType type)
+{
+    switch (type)
+    {
+        case TYPE_INT:
+            return int_to_buf_compact;
+
+        case TYPE_STRING:
+            return string_to_buf_compact;
+
+        case TYPE_ADDR:
+            return addr_to_buf_compact;
+
+        default:
+            return type_get_binary_out_func(type);
+    }
+}
+
 datum_text_out_func
 type_get_text_out_func(DataType type)
 {
@@ -399,6 +630,9 @@ type_get_text_out_func(DataType type)
         case TYPE_STRING:
             return string_to_str;
 
+        case TYPE_ADDR:
+            return addr_to_str;
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -1,8 +1,12 @@
 #include <apr_hash.h>
+#include <apr_network_io.h>
 
 #include "c4-internal.h"
 #include "types/datum.h"
 #include "util/hash_func.h"
+#include "util/host_tbl.h"
+#include "util/intern.h"
+#include "util/recv_slab.h"
 
 bool
 bool_equal(Datum d1, Datum d2)
@@ -31,13 +35,31 @@ int_equal(Datum d1, Datum d2)
 bool
 string_equal(Datum d1, Datum d2)
 {
-    C4String *s1 = d1.s;
-    C4String *s2 = d2.s;
+    apr_size_t len1;
+    apr_size_t len2;
 
-    if (s1->len != s2->len)
+    /* Inline strings are equal iff their representations are */
+    if (string_is_inline(d1) || string_is_inline(d2))
+        return (d1.i8 == d2.i8);
+
+    /* Likewise, interned strings are equal iff they are the same string */
+    if (d1.s == d2.s)
+        return true;
+    if (d1.s->interned && d2.s->interned)
+        return false;
+
+    len1 = string_get_len(&d1);
+    len2 = string_get_len(&d2);
+    if (len1 != len2)
         return false;
 
-    return (memcmp(s1->data, s2->data, s1->len) == 0);
+    return (memcmp(string_get_data(&d1), string_get_data(&d2), len1) == 0);
+}
+
+bool
+addr_equal(Datum d1, Datum d2)
+{
+    return d1.i8 == d2.i8;
 }
 
 /* XXX: get rid of this */
@@ -61,6 +83,9 @@ datum_equal(Datum d1, Datum d2, DataType type)
         case TYPE_STRING:
             return string_equal(d1, d2);
 
+        case TYPE_ADDR:
+            return addr_equal(d1, d2);
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -116,17 +141,24 @@ int_cmp(Datum d1, Datum d2)
 int
 string_cmp(Datum d1, Datum d2)
 {
-    C4String *s1 = d1.s;
-    C4String *s2 = d2.s;
+    apr_size_t len1 = string_get_len(&d1);
+    apr_size_t len2 = string_get_len(&d2);
     int result;
 
-    result = memcmp(s1->data, s2->data, Min(s1->len, s2->len));
-    if ((result == 0) && (s1->len != s2->len))
-        result = (s1->len < s2->len ? -1 : 1);
+    result = memcmp(string_get_data(&d1), string_get_data(&d2),
+                    Min(len1, len2));
+    if ((result == 0) && (len1 != len2))
+        result = (len1 < len2 ? -1 : 1);
 
     return result;
 }
 
+int
+addr_cmp(Datum d1, Datum d2)
+{
+    return int_cmp(d1, d2);
+}
+
 /* XXX: get rid of this */
 int
 datum_cmp(Datum d1, Datum d2, DataType type)
@@ -148,6 +180,9 @@ datum_cmp(Datum d1, Datum d2, DataType type)
         case TYPE_STRING:
             return string_cmp(d1, d2);
 
+        case TYPE_ADDR:
+            return addr_cmp(d1, d2);
+
         case TYPE_INVALID:
             ERROR("Invalid data type: TYPE_INVALID");
 
@@ -185,13 +220,29 @@ double_hash(Datum d)
 apr_uint32_t
 int_hash(Datum d)
 {
-    return hash_any((unsigned char *) &(d.i8), sizeof(apr_int64_t));
+    return hash_uint64((apr_uint64_t) d.i8);
 }
 
 apr_uint32_t
 string_hash(Datum d)
 {
-    return hash_any((unsigned char *) d.s->data, d.s->len);
+    /* Since inline strings are zero-padded, we can hash them as ints */
+    if (string_is_inline(d))
+        return hash_uint64((apr_uint64_t) d.i8);
+    if (!d.s->hash_valid)
+    {
+        d.s->hash = hash_any((unsigned char *) string_get_data(&d),
+                             d.s->len);
+        d.s->hash_valid = true;
+    }
+
+    return d.s->hash;
+}
+
+apr_uint32_t
+addr_hash(Datum d)
+{
+    return hash_uint64((apr_uint64_t) d.i8);
 }
 
 static void
@@ -206,14 +257,28 @@ string_unpin(C4String *s)
     ASSERT(s->refcount >= 1);
     s->refcount--;
     if (s->refcount == 0)
+    {
+        if (s->interned)
+            intern_table_remove(intern_table_get_current(), s);
+        if (s->is_slab)
+        {
+            SlabString *ss = (SlabString *) s;
+
+            if (ss->slab != NULL)
+                recv_slab_remove_string(ss->slab, ss);
+            else
+                ol_free(ss->data);  /* Copied out of its slab */
+        }
+
         ol_free(s);
+    }
 }
 
 /* XXX: Consider inlining this function */
 Datum
 datum_copy(Datum in, DataType type)
 {
-    if (type == TYPE_STRING)
+    if (type == TYPE_STRING && !string_is_inline(in))
         string_pin(in.s);
 
     return in;
@@ -223,7 +288,7 @@ datum_copy(Datum in, DataType type)
 void
 datum_free(Datum in, DataType type)
 {
-    if (type == TYPE_STRING)
+    if (type == TYPE_STRING && !string_is_inline(in))
         string_unpin(in.s);
 }
 
@@ -246,7 +311,7 @@ void
 pool_track_datum(apr_pool_t *pool, Datum datum, DataType type)
 {
     /* Right now, strings are the only pass-by-ref datums */
-    if (type == TYPE_STRING)
+    if (type == TYPE_STRING && !string_is_inline(datum))
         apr_pool_cleanup_register(pool, datum.s, datum_cleanup,
                                   apr_pool_cleanup_null);
 }
@@ -320,30 +385,180 @@ int_from_str(const char *str)
     return result;
 }
 
-C4String *
+/*
+ * Make a string Datum of the given length; the caller should fill in its
+ * contents via string_get_data(). Short strings are stored inline, so we
+ * only need to allocate memory for longer strings.
+ */
+Datum
 make_string(apr_size_t slen)
 {
-    C4String *s;
+    Datum result;
 
-    s = ol_alloc(offsetof(C4String, data) + (slen * sizeof(char)));
-    s->len = slen;
-    s->refcount = 1;
-    return s;
+    if (slen <= STRING_INLINE_MAX)
+    {
+        result.i8 = 0;
+        result.str[STRING_TAG_BYTE] = (char) ((slen << 1) | 1);
+    }
+    else
+    {
+        C4String *s;
+
+        s = ol_alloc(offsetof(C4String, data) + (slen * sizeof(char)));
+        s->len = slen;
+        s->refcount = 1;
+        s->hash = 0;
+        s->hash_valid = false;
+        s->interned = false;
+        s->is_slab = false;
+        result.s = s;
+    }
+
+    return result;
 }
 
-/* FIXME */
-Datum
-string_from_str(const char *str)
+/*
+ * Make a string Datum with the given contents. If the current thread has an
+ * intern table, we return the interned copy of the string, creating it if
+ * necessary.
+ */
+static Datum
+make_interned_string(const char *data, apr_size_t slen)
 {
-    apr_size_t slen;
+    InternTable *tbl;
+    apr_uint32_t hash;
     Datum result;
 
-    slen = strlen(str);
-    result.s = make_string(slen);
-    memcpy(result.s->data, str, slen);
+    tbl = intern_table_get_current();
+    if (slen <= STRING_INLINE_MAX || tbl == NULL)
+    {
+        result = make_string(slen);
+        memcpy(string_get_data(&result), data, slen);
+        return result;
+    }
+
+    hash = hash_any((const unsigned char *) data, slen);
+    result.s = intern_table_lookup(tbl, data, slen, hash);
+    if (result.s != NULL)
+    {
+        string_pin(result.s);
+        return result;
+    }
+
+    result = make_string(slen);
+    memcpy(result.s->data, data, slen);
+    result.s->hash = hash;
+    result.s->hash_valid = true;
+    intern_table_add(tbl, result.s);
     return result;
 }
 
+Datum
+string_from_str(const char *str)
+{
+    return make_interned_string(str, strlen(str));
+}
+
+/*
+ * Parse a dotted-quad IPv4 address, returning it in host byte order. Returns
+ * false if "host" isn't a dotted quad (e.g. because it is a host name).
+ */
+static bool
+parse_ipv4(const char *host, apr_uint32_t *ipv4)
+{
+    const char *p = host;
+    apr_uint32_t result = 0;
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        unsigned int octet = 0;
+        int ndigits = 0;
+
+        if (i > 0 && *p++ != '.')
+            return false;
+
+        while (ndigits < 3 && *p >= '0' && *p <= '9')
+        {
+            octet = (octet * 10) + (*p++ - '0');
+            ndigits++;
+        }
+
+        if (ndigits == 0 || octet > 255)
+            return false;
+
+        result = (result << 8) | octet;
+    }
+
+    if (*p != '\0')
+        return false;
+
+    *ipv4 = result;
+    return true;
+}
+
+/*
+ * Parse an address of the form "tcp:host:port". If the host is not an IPv4
+ * address, we make a named address: the host name is not resolved until it
+ * is needed (see addr_resolve()).
+ */
+Datum
+addr_from_str(const char *str)
+{
+    const char *host_start;
+    const char *colon_ptr;
+    char host[APRMAXHOSTLEN];
+    ptrdiff_t host_len;
+    apr_int64_t port;
+    apr_uint32_t ipv4;
+
+    /* We only handle TCP for now */
+    if (strncmp(str, "tcp:", 4) != 0)
+        ERROR("Invalid address \"%s\": expected \"tcp:host:port\"", str);
+
+    host_start = str + 4;
+    colon_ptr = strrchr(host_start, ':');
+    if (colon_ptr == NULL)
+        ERROR("Invalid address \"%s\": expected \"tcp:host:port\"", str);
+
+    host_len = colon_ptr - host_start;
+    if (host_len <= 0 || host_len >= (ptrdiff_t) sizeof(host))
+        ERROR("Invalid host name in address \"%s\"", str);
+
+    memcpy(host, host_start, host_len);
+    host[host_len] = '\0';
+
+    port = parse_int64(colon_ptr + 1, APR_UINT16_MAX, 1);
+    if (parse_ipv4(host, &ipv4))
+        return addr_make(ipv4, (apr_uint16_t) port);
+
+    return addr_make_named(host_tbl_intern(host, host_len),
+                           (apr_uint16_t) port);
+}
+
+/*
+ * Resolve a named address to the address of its host; the first time a
+ * host name is resolved, this might block. Other addresses are returned
+ * unchanged. Returns false if the host name can't be resolved.
+ */
+bool
+addr_resolve(Datum d, Datum *result)
+{
+    apr_uint32_t ipv4;
+
+    if (!addr_is_named(d))
+    {
+        *result = d;
+        return true;
+    }
+
+    if (!host_tbl_resolve(addr_get_host_id(d), &ipv4))
+        return false;
+
+    *result = addr_make(ipv4, addr_get_port(d));
+    return true;
+}
+
 void
 bool_to_str(Datum d, StrBuf *buf)
 {
@@ -371,8 +586,26 @@ int_to_str(Datum d, StrBuf *buf)
 void
 string_to_str(Datum d, StrBuf *buf)
 {
-    C4String *s = d.s;
-    sbuf_append_data(buf, s->data, s->len);
+    sbuf_append_data(buf, string_get_data(&d), string_get_len(&d));
+}
+
+void
+addr_to_str(Datum d, StrBuf *buf)
+{
+    apr_uint32_t ipv4 = addr_get_ipv4(d);
+
+    if (addr_is_named(d))
+    {
+        sbuf_appendf(buf, "tcp:%s:%u",
+                     host_tbl_get_name(addr_get_host_id(d)),
+                     (unsigned int) addr_get_port(d));
+        return;
+    }
+
+    sbuf_appendf(buf, "tcp:%u.%u.%u.%u:%u",
+                 (ipv4 >> 24) & 0xFF, (ipv4 >> 16) & 0xFF,
+                 (ipv4 >> 8) & 0xFF, ipv4 & 0xFF,
+                 (unsigned int) addr_get_port(d));
 }
 
 /*
@@ -383,8 +616,18 @@ string_to_str(Datum d, StrBuf *buf)
 char *
 string_to_text(Datum d, apr_pool_t *pool)
 {
-    C4String *s = d.s;
-    return apr_pstrmemdup(pool, s->data, s->len);
+    return apr_pstrmemdup(pool, string_get_data(&d), string_get_len(&d));
+}
+
+char *
+addr_to_text(Datum d, apr_pool_t *pool)
+{
+    StrBuf *buf;
+
+    buf = sbuf_make(pool);
+    addr_to_str(d, buf);
+    sbuf_append_char(buf, '\0');
+    return buf->data;
 }
 
 Datum
@@ -432,19 +675,135 @@ int_from_buf(StrBuf *buf)
     return result;
 }
 
-/* FIXME */
+/*
+ * Make a string Datum that references "slen" bytes of the given slab, rather
+ * than copying them. If an equal string is already interned, we use that
+ * instead, so as to avoid holding the slab in memory unnecessarily. Slab
+ * strings are not themselves interned. If the slab is mostly dead once its
+ * owner has released it, the string's bytes are copied out of the slab (see
+ * util/recv_slab.h).
+ */
+static Datum
+make_slab_string(RecvSlab *slab, const char *data, apr_size_t slen)
+{
+    InternTable *tbl;
+    SlabString *ss;
+    apr_uint32_t hash;
+    Datum result;
+
+    ASSERT(slen > STRING_INLINE_MAX);
+    hash = hash_any((const unsigned char *) data, slen);
+    tbl = intern_table_get_current();
+    if (tbl != NULL)
+    {
+        result.s = intern_table_lookup(tbl, data, slen, hash);
+        if (result.s != NULL)
+        {
+            string_pin(result.s);
+            return result;
+        }
+    }
+
+    ss = ol_alloc(sizeof(*ss));
+    ss->str.hash = hash;
+    ss->str.hash_valid = true;
+    ss->str.len = slen;
+    ss->str.refcount = 1;
+    ss->str.interned = false;
+    ss->str.is_slab = true;
+    ss->data = (char *) data;
+    ss->slab = slab;
+    recv_slab_add_string(slab, ss);
+
+    result.s = &ss->str;
+    return result;
+}
+
+/*
+ * Read a string's contents of the given length from the buffer.
+ */
+static Datum
+string_read_data(StrBuf *buf, apr_size_t slen)
+{
+    RecvSlab *slab;
+    const char *data;
+
+    data = sbuf_read_ptr(buf, slen);
+
+    /* Reference long strings in place if we're reading from a slab */
+    slab = recv_slab_get_current();
+    if (slab != NULL && buf == &slab->buf && slen > STRING_INLINE_MAX)
+        return make_slab_string(slab, data, slen);
+
+    return make_interned_string(data, slen);
+}
+
 Datum
 string_from_buf(StrBuf *buf)
 {
-    Datum result;
     apr_uint32_t slen;
 
     slen = ntohl(sbuf_read_int32(buf));
-    result.s = make_string(slen);
-    sbuf_read_data(buf, result.s->data, slen);
+    return string_read_data(buf, slen);
+}
+
+/*
+ * Host IDs are local to a process, so a named address is sent as its host
+ * name: in place of the ID, the address holds the length of the name, and
+ * the name follows it.
+ */
+Datum
+addr_from_buf(StrBuf *buf)
+{
+    Datum result;
+
+    result = int_from_buf(buf);
+    if (addr_is_named(result))
+    {
+        apr_uint32_t name_len = addr_get_host_id(result);
+        const char *name;
+
+        /* Don't let a bad peer add arbitrary names to the host table */
+        if (name_len == 0 || name_len >= APRMAXHOSTLEN)
+            ERROR("Invalid host name length in address: %u", name_len);
+
+        name = sbuf_read_ptr(buf, name_len);
+        if (memchr(name, '\0', name_len) != NULL)
+            ERROR("Invalid host name in address");
+
+        result = addr_make_named(host_tbl_intern(name, name_len),
+                                 addr_get_port(result));
+    }
+
     return result;
 }
 
+/*
+ * Return the number of bytes that addr_from_buf() will read for the address
+ * at the current position of "buf", which must hold at least the first
+ * sizeof(apr_int64_t) bytes of it. Doesn't consume any input.
+ */
+apr_size_t
+addr_get_buf_len(StrBuf *buf)
+{
+    apr_size_t pos = buf->pos;
+    Datum header;
+    apr_uint32_t name_len;
+
+    header = int_from_buf(buf);
+    buf->pos = pos;
+
+    if (!addr_is_named(header))
+        return sizeof(apr_int64_t);
+
+    /* If the length is invalid, addr_from_buf() will reject it */
+    name_len = addr_get_host_id(header);
+    if (name_len >= APRMAXHOSTLEN)
+        return sizeof(apr_int64_t);
+
+    return sizeof(apr_int64_t) + name_len;
+}
+
 void
 bool_to_buf(Datum d, StrBuf *buf)
 {
@@ -488,12 +847,137 @@ int_to_buf(Datum d, StrBuf *buf)
 void
 string_to_buf(Datum d, StrBuf *buf)
 {
-    C4String *s = d.s;
+    apr_uint32_t slen = string_get_len(&d);
     apr_uint32_t net_len;
 
-    net_len = htonl(s->len);
+    net_len = htonl(slen);
     sbuf_append_data(buf, (char *) &net_len, sizeof(net_len));
-    sbuf_append_data(buf, s->data, s->len);
+    sbuf_append_data(buf, string_get_data(&d), slen);
+}
+
+void
+addr_to_buf(Datum d, StrBuf *buf)
+{
+    const char *name;
+    apr_size_t name_len;
+
+    if (!addr_is_named(d))
+    {
+        int_to_buf(d, buf);
+        return;
+    }
+
+    /* See addr_from_buf() */
+    name = host_tbl_get_name(addr_get_host_id(d));
+    name_len = strlen(name);
+    int_to_buf(addr_make_named((apr_uint32_t) name_len, addr_get_port(d)),
+               buf);
+    sbuf_append_data(buf, name, name_len);
+}
+
+/*
+ * The compact binary format, used for network traffic. Ints are sent as
+ * "zigzag" varints, so that small values of either sign take few bytes.
+ * Strings are prefixed with a varint length, which takes a single byte for
+ * strings shorter than 128 bytes. An address is a single tag byte if it is
+ * equal to the current base address (see addr_set_compact_base()), and the
+ * tag followed by the address otherwise. Other types use the same format
+ * as for the standard binary format.
+ */
+#define ADDR_COMPACT_BASE       0
+#define ADDR_COMPACT_FULL       1
+
+/* Only valid if compact_addr_base_set */
+static __thread bool compact_addr_base_set = false;
+static __thread Datum compact_addr_base;
+
+/*
+ * Set the base address for compact addresses read or written by this
+ * thread, or clear it if "base" is NULL. Typically this is the address of
+ * the remote end of the connection, which is the value of the location
+ * specifier of every tuple sent over it.
+ */
+void
+addr_set_compact_base(Datum *base)
+{
+    compact_addr_base_set = (base != NULL);
+    if (base != NULL)
+        compact_addr_base = *base;
+}
+
+Datum
+int_from_buf_compact(StrBuf *buf)
+{
+    Datum result;
+    apr_uint64_t u;
+
+    u = sbuf_read_varint64(buf);
+    result.i8 = (apr_int64_t) ((u >> 1) ^ (~(u & 1) + 1));
+    return result;
+}
+
+Datum
+string_from_buf_compact(StrBuf *buf)
+{
+    apr_uint32_t slen;
+
+    slen = sbuf_read_varint(buf);
+    return string_read_data(buf, slen);
+}
+
+Datum
+addr_from_buf_compact(StrBuf *buf)
+{
+    Datum result;
+
+    switch (sbuf_read_char(buf))
+    {
+        case ADDR_COMPACT_BASE:
+            if (!compact_addr_base_set)
+                ERROR("No base address for compact address");
+            result = compact_addr_base;
+            break;
+
+        case ADDR_COMPACT_FULL:
+            result = addr_from_buf(buf);
+            break;
+
+        default:
+            ERROR("Unrecognized compact address tag");
+    }
+
+    return result;
+}
+
+void
+int_to_buf_compact(Datum d, StrBuf *buf)
+{
+    apr_uint64_t u = (apr_uint64_t) d.i8;
+
+    /* Zigzag: move the sign bit to bit 0, and flip the other bits if set */
+    sbuf_append_varint(buf, (u << 1) ^ (~(u >> 63) + 1));
+}
+
+void
+string_to_buf_compact(Datum d, StrBuf *buf)
+{
+    apr_uint32_t slen = string_get_len(&d);
+
+    sbuf_append_varint(buf, slen);
+    sbuf_append_data(buf, string_get_data(&d), slen);
+}
+
+void
+addr_to_buf_compact(Datum d, StrBuf *buf)
+{
+    if (compact_addr_base_set && d.i8 == compact_addr_base.i8)
+    {
+        sbuf_append_char(buf, ADDR_COMPACT_BASE);
+        return;
+    }
+
+    sbuf_append_char(buf, ADDR_COMPACT_FULL);
+    addr_to_buf(d, buf);
 }
 
 void
@@ -1,381 +1,701 @@
+#include <apr_hash.h>
+
 #include "c4-internal.h"
+#include "types/catalog.h"
 #include "types/expr.h"
 
-static Datum
-eval_op_uminus_i8(ExprState *state)
+/*
+ * Expressions are compiled into a linear program of typed instructions
+ * over a small register file, rather than being evaluated by walking the
+ * expression tree. Each instruction reads its operands from registers and
+ * writes its result to a register of its own; constants are loaded into
+ * their registers once, when the program is compiled. Operand types are
+ * resolved at compile time, so evaluation doesn't need to check them.
+ */
+typedef enum ExprOpcode
 {
-    Datum lhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_INT);
-    ASSERT(state->expr->type == TYPE_INT);
-
-    lhs = eval_expr(state->lhs);
-    result.i8 = -(lhs.i8);
-    return result;
-}
-
-static Datum
-eval_op_plus_string(ExprState *state)
+    EXPR_INSTR_VAR,
+    EXPR_INSTR_UMINUS_I8,
+    EXPR_INSTR_PLUS_I8,
+    EXPR_INSTR_MINUS_I8,
+    EXPR_INSTR_TIMES_I8,
+    EXPR_INSTR_DIVIDE_I8,
+    EXPR_INSTR_MODULUS_I8,
+    EXPR_INSTR_PLUS_D8,
+    EXPR_INSTR_MINUS_D8,
+    EXPR_INSTR_TIMES_D8,
+    EXPR_INSTR_PLUS_STRING,
+    EXPR_INSTR_LT_I8,
+    EXPR_INSTR_LTE_I8,
+    EXPR_INSTR_GT_I8,
+    EXPR_INSTR_GTE_I8,
+    EXPR_INSTR_EQ_I8,
+    EXPR_INSTR_NEQ_I8,
+    EXPR_INSTR_LT,
+    EXPR_INSTR_LTE,
+    EXPR_INSTR_GT,
+    EXPR_INSTR_GTE,
+    EXPR_INSTR_EQ,
+    EXPR_INSTR_NEQ,
+    /*
+     * Superinstructions that compare an int-valued variable with a register
+     * (typically a constant), without loading the variable first.
+     */
+    EXPR_INSTR_LT_VAR_I8,
+    EXPR_INSTR_LTE_VAR_I8,
+    EXPR_INSTR_GT_VAR_I8,
+    EXPR_INSTR_GTE_VAR_I8,
+    EXPR_INSTR_EQ_VAR_I8,
+    EXPR_INSTR_NEQ_VAR_I8
+} ExprOpcode;
+
+struct ExprInstr
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_STRING);
-    ASSERT(state->rhs->expr->type == TYPE_STRING);
-    ASSERT(state->expr->type == TYPE_STRING);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    /* XXX: FIXME */
-    result.s = make_string(lhs.s->len + rhs.s->len);
-    memcpy(result.s->data, lhs.s->data, lhs.s->len);
-    memcpy(result.s->data + lhs.s->len, rhs.s->data, rhs.s->len);
-
-    return result;
-}
+    ExprOpcode opcode;
+    /* Operand type, for generic comparisons */
+    DataType type;
+    Datum *dst;
+    Datum *lhs;
+    Datum *rhs;
+    /*
+     * For variable references: the context tuple, its schema, and the
+     * attribute number
+     */
+    Tuple **tuple;
+    Schema **schema;
+    int attno;
+};
 
-static Datum
-eval_op_plus_i8(ExprState *state)
+typedef struct ExprCompileState
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_INT);
-    ASSERT(state->rhs->expr->type == TYPE_INT);
-    ASSERT(state->expr->type == TYPE_INT);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    /* XXX: check for overflow? */
-    result.i8 = lhs.i8 + rhs.i8;
-    return result;
-}
+    ExprState *state;
+    int nregs;
+} ExprCompileState;
 
-static Datum
-eval_op_minus_i8(ExprState *state)
-{
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_INT);
-    ASSERT(state->rhs->expr->type == TYPE_INT);
-    ASSERT(state->expr->type == TYPE_INT);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    /* XXX: check for underflow? */
-    result.i8 = lhs.i8 - rhs.i8;
-    return result;
-}
+static Datum *compile_expr(ExprNode *expr, ExprCompileState *cstate);
 
 static Datum
-eval_op_times_i8(ExprState *state)
+eval_var_expr(ExprState *state)
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_INT);
-    ASSERT(state->rhs->expr->type == TYPE_INT);
-    ASSERT(state->expr->type == TYPE_INT);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    /* XXX: check for overflow? */
-    result.i8 = lhs.i8 * rhs.i8;
-    return result;
-}
+    ExprInstr *instr = &state->instrs[0];
 
-static Datum
-eval_op_divide_i8(ExprState *state)
-{
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_INT);
-    ASSERT(state->rhs->expr->type == TYPE_INT);
-    ASSERT(state->expr->type == TYPE_INT);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    /* XXX: error checking? e.g. divide by zero */
-    /* XXX: should the return type be integer or float? */
-    result.i8 = lhs.i8 / rhs.i8;
-    return result;
+    ASSERT(*instr->tuple != NULL);
+    /* XXX: bump refcount for pass-by-ref datums? */
+    return tuple_get_val(*instr->tuple, *instr->schema, instr->attno);
 }
 
 static Datum
-eval_op_modulus_i8(ExprState *state)
+eval_const_expr(ExprState *state)
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_INT);
-    ASSERT(state->rhs->expr->type == TYPE_INT);
-    ASSERT(state->expr->type == TYPE_INT);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    /* XXX: error checking?  */
-    result.i8 = lhs.i8 % rhs.i8;
-    return result;
+    /* XXX: bump refcount for pass-by-ref datums? */
+    return *state->result;
 }
 
 static Datum
-eval_op_plus_d8(ExprState *state)
+eval_program(ExprState *state)
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_DOUBLE);
-    ASSERT(state->rhs->expr->type == TYPE_DOUBLE);
-    ASSERT(state->expr->type == TYPE_DOUBLE);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    result.d8 = lhs.d8 + rhs.d8;
-    return result;
-}
+    ExprInstr *instr = state->instrs;
+    ExprInstr *end = instr + state->ninstrs;
 
-static Datum
-eval_op_minus_d8(ExprState *state)
-{
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_DOUBLE);
-    ASSERT(state->rhs->expr->type == TYPE_DOUBLE);
-    ASSERT(state->expr->type == TYPE_DOUBLE);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    result.d8 = lhs.d8 - rhs.d8;
-    return result;
-}
+    for (; instr < end; instr++)
+    {
+        Datum *dst = instr->dst;
+        Datum *lhs = instr->lhs;
+        Datum *rhs = instr->rhs;
+
+        switch (instr->opcode)
+        {
+            case EXPR_INSTR_VAR:
+                ASSERT(*instr->tuple != NULL);
+                *dst = tuple_get_val(*instr->tuple, *instr->schema,
+                                     instr->attno);
+                break;
+
+            case EXPR_INSTR_UMINUS_I8:
+                dst->i8 = -(lhs->i8);
+                break;
+
+            case EXPR_INSTR_PLUS_I8:
+                /* XXX: check for overflow? */
+                dst->i8 = lhs->i8 + rhs->i8;
+                break;
+
+            case EXPR_INSTR_MINUS_I8:
+                /* XXX: check for underflow? */
+                dst->i8 = lhs->i8 - rhs->i8;
+                break;
+
+            case EXPR_INSTR_TIMES_I8:
+                /* XXX: check for overflow? */
+                dst->i8 = lhs->i8 * rhs->i8;
+                break;
+
+            case EXPR_INSTR_DIVIDE_I8:
+                /* XXX: error checking? e.g. divide by zero */
+                /* XXX: should the return type be integer or float? */
+                dst->i8 = lhs->i8 / rhs->i8;
+                break;
+
+            case EXPR_INSTR_MODULUS_I8:
+                /* XXX: error checking?  */
+                dst->i8 = lhs->i8 % rhs->i8;
+                break;
+
+            case EXPR_INSTR_PLUS_D8:
+                dst->d8 = lhs->d8 + rhs->d8;
+                break;
+
+            case EXPR_INSTR_MINUS_D8:
+                dst->d8 = lhs->d8 - rhs->d8;
+                break;
+
+            case EXPR_INSTR_TIMES_D8:
+                dst->d8 = lhs->d8 * rhs->d8;
+                break;
+
+            case EXPR_INSTR_PLUS_STRING:
+                /* XXX: FIXME */
+                {
+                    apr_size_t lhs_len = string_get_len(lhs);
+                    apr_size_t rhs_len = string_get_len(rhs);
+                    char *data;
+
+                    *dst = make_string(lhs_len + rhs_len);
+                    data = string_get_data(dst);
+                    memcpy(data, string_get_data(lhs), lhs_len);
+                    memcpy(data + lhs_len, string_get_data(rhs), rhs_len);
+                }
+                break;
+
+            case EXPR_INSTR_LT_I8:
+                dst->b = (lhs->i8 < rhs->i8);
+                break;
+
+            case EXPR_INSTR_LTE_I8:
+                dst->b = (lhs->i8 <= rhs->i8);
+                break;
+
+            case EXPR_INSTR_GT_I8:
+                dst->b = (lhs->i8 > rhs->i8);
+                break;
+
+            case EXPR_INSTR_GTE_I8:
+                dst->b = (lhs->i8 >= rhs->i8);
+                break;
+
+            case EXPR_INSTR_EQ_I8:
+                dst->b = (lhs->i8 == rhs->i8);
+                break;
+
+            case EXPR_INSTR_NEQ_I8:
+                dst->b = (lhs->i8 != rhs->i8);
+                break;
+
+            case EXPR_INSTR_LT:
+                dst->b = (datum_cmp(*lhs, *rhs, instr->type) < 0);
+                break;
+
+            case EXPR_INSTR_LTE:
+                dst->b = (datum_cmp(*lhs, *rhs, instr->type) <= 0);
+                break;
+
+            case EXPR_INSTR_GT:
+                dst->b = (datum_cmp(*lhs, *rhs, instr->type) > 0);
+                break;
+
+            case EXPR_INSTR_GTE:
+                dst->b = (datum_cmp(*lhs, *rhs, instr->type) >= 0);
+                break;
+
+            case EXPR_INSTR_EQ:
+                dst->b = datum_equal(*lhs, *rhs, instr->type);
+                break;
+
+            case EXPR_INSTR_NEQ:
+                dst->b = !datum_equal(*lhs, *rhs, instr->type);
+                break;
+
+            case EXPR_INSTR_LT_VAR_I8:
+                dst->b = (tuple_get_int(*instr->tuple, *instr->schema,
+                                        instr->attno) < rhs->i8);
+                break;
+
+            case EXPR_INSTR_LTE_VAR_I8:
+                dst->b = (tuple_get_int(*instr->tuple, *instr->schema,
+                                        instr->attno) <= rhs->i8);
+                break;
+
+            case EXPR_INSTR_GT_VAR_I8:
+                dst->b = (tuple_get_int(*instr->tuple, *instr->schema,
+                                        instr->attno) > rhs->i8);
+                break;
+
+            case EXPR_INSTR_GTE_VAR_I8:
+                dst->b = (tuple_get_int(*instr->tuple, *instr->schema,
+                                        instr->attno) >= rhs->i8);
+                break;
+
+            case EXPR_INSTR_EQ_VAR_I8:
+                dst->b = (tuple_get_int(*instr->tuple, *instr->schema,
+                                        instr->attno) == rhs->i8);
+                break;
+
+            case EXPR_INSTR_NEQ_VAR_I8:
+                dst->b = (tuple_get_int(*instr->tuple, *instr->schema,
+                                        instr->attno) != rhs->i8);
+                break;
+
+            default:
+                ERROR("Unexpected opcode: %d", (int) instr->opcode);
+        }
+    }
 
-static Datum
-eval_op_times_d8(ExprState *state)
-{
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == TYPE_DOUBLE);
-    ASSERT(state->rhs->expr->type == TYPE_DOUBLE);
-    ASSERT(state->expr->type == TYPE_DOUBLE);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    result.d8 = lhs.d8 * rhs.d8;
-    return result;
+    return *state->result;
 }
 
-static Datum
-eval_op_eq(ExprState *state)
+static int
+count_expr_nodes(ExprNode *expr)
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
+    ExprOp *op_expr;
+    int count;
 
-    ASSERT(state->lhs->expr->type == state->rhs->expr->type);
-    ASSERT(state->expr->type == TYPE_BOOL);
+    if (expr->node.kind != EXPR_OP)
+        return 1;
 
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    result.b = datum_equal(lhs, rhs, state->lhs->expr->type);
-    return result;
+    op_expr = (ExprOp *) expr;
+    count = 1 + count_expr_nodes(op_expr->lhs);
+    if (op_expr->rhs)
+        count += count_expr_nodes(op_expr->rhs);
+
+    return count;
 }
 
-static Datum
-eval_op_neq(ExprState *state)
+static ExprInstr *
+emit_instr(ExprOpcode opcode, ExprCompileState *cstate)
 {
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-
-    ASSERT(state->lhs->expr->type == state->rhs->expr->type);
-    ASSERT(state->expr->type == TYPE_BOOL);
-
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
-    result.b = datum_equal(lhs, rhs, state->lhs->expr->type) ? false : true;
-    return result;
+    ExprState *state = cstate->state;
+    ExprInstr *instr;
+
+    instr = &state->instrs[state->ninstrs++];
+    instr->opcode = opcode;
+    instr->type = TYPE_INVALID;
+    instr->dst = &state->regs[cstate->nregs++];
+    instr->lhs = NULL;
+    instr->rhs = NULL;
+    instr->tuple = NULL;
+    instr->schema = NULL;
+    instr->attno = -1;
+
+    return instr;
 }
 
-static Datum
-eval_op_logical(ExprState *state)
+/*
+ * Set up "instr" to reference the variable "var" in the evaluation context.
+ * Note that the context's tuples and schemas are read when the instruction
+ * is evaluated, not when it is compiled.
+ */
+static void
+set_var_ref(ExprInstr *instr, ExprVar *var, ExprCompileState *cstate)
 {
-    ExprOp *op = (ExprOp *) state->expr;
-    Datum lhs;
-    Datum rhs;
-    Datum result;
-    int cmp_result;
+    ExprEvalContext *cxt = cstate->state->cxt;
 
-    ASSERT(state->lhs->expr->type == state->rhs->expr->type);
-    ASSERT(state->expr->type == TYPE_BOOL);
+    if (var->is_outer)
+    {
+        instr->tuple = &cxt->outer;
+        instr->schema = &cxt->outer_schema;
+    }
+    else
+    {
+        instr->tuple = &cxt->inner;
+        instr->schema = &cxt->inner_schema;
+    }
 
-    lhs = eval_expr(state->lhs);
-    rhs = eval_expr(state->rhs);
+    instr->attno = var->attno;
+}
 
-    cmp_result = datum_cmp(lhs, rhs, state->lhs->expr->type);
-    switch (op->op_kind)
+static bool
+is_comparison(AstOperKind op_kind)
+{
+    switch (op_kind)
     {
         case AST_OP_LT:
-            result.b = (cmp_result < 0 ? true : false);
-            break;
-
         case AST_OP_LTE:
-            result.b = (cmp_result <= 0 ? true : false);
-            break;
-
         case AST_OP_GT:
-            result.b = (cmp_result > 0 ? true : false);
-            break;
-
         case AST_OP_GTE:
-            result.b = (cmp_result >= 0 ? true : false);
-            break;
+        case AST_OP_EQ:
+        case AST_OP_NEQ:
+            return true;
 
         default:
-            ERROR("Unexpected op kind: %d", (int) op->op_kind);
+            return false;
     }
-
-    return result;
 }
 
-static Datum
-eval_var_expr(ExprState *state)
+/*
+ * Return the comparison that gives the same result when its operands are
+ * swapped.
+ */
+static AstOperKind
+commute_comparison(AstOperKind op_kind)
 {
-    ExprVar *var = (ExprVar *) state->expr;
-    ExprEvalContext *cxt = state->cxt;
-
-    /* XXX: bump refcount for pass-by-ref datums? */
-    if (var->is_outer)
-    {
-        ASSERT(cxt->outer != NULL);
-        return tuple_get_val(cxt->outer, var->attno);
-    }
-    else
+    switch (op_kind)
     {
-        ASSERT(cxt->inner != NULL);
-        return tuple_get_val(cxt->inner, var->attno);
+        case AST_OP_LT:
+            return AST_OP_GT;
+        case AST_OP_LTE:
+            return AST_OP_GTE;
+        case AST_OP_GT:
+            return AST_OP_LT;
+        case AST_OP_GTE:
+            return AST_OP_LTE;
+        default:
+            return op_kind;
     }
 }
 
-static Datum
-eval_const_expr(ExprState *state)
+static ExprOpcode
+lookup_comparison_opcode(AstOperKind op_kind, DataType type, bool fuse_var)
 {
-    ExprConst *c_expr = (ExprConst *) state->expr;
+    switch (op_kind)
+    {
+        case AST_OP_LT:
+            if (fuse_var)
+                return EXPR_INSTR_LT_VAR_I8;
+            return (type == TYPE_INT) ? EXPR_INSTR_LT_I8 : EXPR_INSTR_LT;
 
-    /* XXX: bump refcount for pass-by-ref datums? */
-    return c_expr->value;
+        case AST_OP_LTE:
+            if (fuse_var)
+                return EXPR_INSTR_LTE_VAR_I8;
+            return (type == TYPE_INT) ? EXPR_INSTR_LTE_I8 : EXPR_INSTR_LTE;
+
+        case AST_OP_GT:
+            if (fuse_var)
+                return EXPR_INSTR_GT_VAR_I8;
+            return (type == TYPE_INT) ? EXPR_INSTR_GT_I8 : EXPR_INSTR_GT;
+
+        case AST_OP_GTE:
+            if (fuse_var)
+                return EXPR_INSTR_GTE_VAR_I8;
+            return (type == TYPE_INT) ? EXPR_INSTR_GTE_I8 : EXPR_INSTR_GTE;
+
+        case AST_OP_EQ:
+            if (fuse_var)
+                return EXPR_INSTR_EQ_VAR_I8;
+            return (type == TYPE_INT) ? EXPR_INSTR_EQ_I8 : EXPR_INSTR_EQ;
+
+        case AST_OP_NEQ:
+            if (fuse_var)
+                return EXPR_INSTR_NEQ_VAR_I8;
+            return (type == TYPE_INT) ? EXPR_INSTR_NEQ_I8 : EXPR_INSTR_NEQ;
+
+        default:
+            ERROR("Unexpected op kind: %d", (int) op_kind);
+    }
 }
 
-static eval_expr_func
-lookup_op_expr_eval_func(ExprOp *op_expr)
+static ExprOpcode
+lookup_arith_opcode(ExprOp *op_expr)
 {
     switch (op_expr->op_kind)
     {
         case AST_OP_UMINUS:
-            return eval_op_uminus_i8;
+            return EXPR_INSTR_UMINUS_I8;
 
         case AST_OP_PLUS:
             if (op_expr->lhs->type == TYPE_STRING &&
                 op_expr->rhs->type == TYPE_STRING)
-                return eval_op_plus_string;
+                return EXPR_INSTR_PLUS_STRING;
             else if (op_expr->lhs->type == TYPE_DOUBLE &&
                      op_expr->rhs->type == TYPE_DOUBLE)
-                return eval_op_plus_d8;
+                return EXPR_INSTR_PLUS_D8;
             else
-                return eval_op_plus_i8;
+                return EXPR_INSTR_PLUS_I8;
 
         case AST_OP_MINUS:
             if (op_expr->lhs->type == TYPE_DOUBLE &&
                 op_expr->rhs->type == TYPE_DOUBLE)
-                return eval_op_minus_d8;
+                return EXPR_INSTR_MINUS_D8;
             else
-                return eval_op_minus_i8;
+                return EXPR_INSTR_MINUS_I8;
 
         case AST_OP_TIMES:
             if (op_expr->lhs->type == TYPE_DOUBLE &&
                 op_expr->rhs->type == TYPE_DOUBLE)
-                return eval_op_times_d8;
+                return EXPR_INSTR_TIMES_D8;
             else
-                return eval_op_times_i8;
+                return EXPR_INSTR_TIMES_I8;
 
         case AST_OP_DIVIDE:
-            return eval_op_divide_i8;
+            return EXPR_INSTR_DIVIDE_I8;
 
         case AST_OP_MODULUS:
-            return eval_op_modulus_i8;
+            return EXPR_INSTR_MODULUS_I8;
+
+        default:
+            ERROR("Unexpected op kind: %d", (int) op_expr->op_kind);
+    }
+}
+
+/*
+ * Compile a comparison. If one operand is an int-valued variable, we emit a
+ * superinstruction that compares the variable's value directly with the
+ * register holding the other operand.
+ */
+static Datum *
+compile_comparison(ExprOp *op_expr, ExprCompileState *cstate)
+{
+    AstOperKind op_kind = op_expr->op_kind;
+    ExprNode *lhs = op_expr->lhs;
+    ExprNode *rhs = op_expr->rhs;
+    DataType type = lhs->type;
+    ExprInstr *instr;
+    Datum *lhs_reg;
+    Datum *rhs_reg;
+
+    ASSERT(lhs->type == rhs->type);
+    ASSERT(op_expr->expr.type == TYPE_BOOL);
+
+    if (type == TYPE_INT && rhs->node.kind == EXPR_VAR &&
+        lhs->node.kind != EXPR_VAR)
+    {
+        ExprNode *tmp = lhs;
+
+        lhs = rhs;
+        rhs = tmp;
+        op_kind = commute_comparison(op_kind);
+    }
+
+    if (type == TYPE_INT && lhs->node.kind == EXPR_VAR)
+    {
+        ExprVar *var = (ExprVar *) lhs;
+
+        rhs_reg = compile_expr(rhs, cstate);
+        instr = emit_instr(lookup_comparison_opcode(op_kind, type, true),
+                           cstate);
+        set_var_ref(instr, var, cstate);
+        instr->rhs = rhs_reg;
+    }
+    else
+    {
+        lhs_reg = compile_expr(lhs, cstate);
+        rhs_reg = compile_expr(rhs, cstate);
+        instr = emit_instr(lookup_comparison_opcode(op_kind, type, false),
+                           cstate);
+        instr->lhs = lhs_reg;
+        instr->rhs = rhs_reg;
+    }
+
+    instr->type = type;
+    return instr->dst;
+}
+
+/*
+ * Append the instructions that evaluate "expr" to the program, and return
+ * the register that holds the result.
+ */
+static Datum *
+compile_expr(ExprNode *expr, ExprCompileState *cstate)
+{
+    ExprState *state = cstate->state;
+
+    switch (expr->node.kind)
+    {
+        case EXPR_OP:
+            {
+                ExprOp *op_expr = (ExprOp *) expr;
+                ExprInstr *instr;
+                Datum *lhs_reg;
+                Datum *rhs_reg;
+
+                if (is_comparison(op_expr->op_kind))
+                    return compile_comparison(op_expr, cstate);
+
+                lhs_reg = compile_expr(op_expr->lhs, cstate);
+                rhs_reg = NULL;
+                if (op_expr->rhs)
+                    rhs_reg = compile_expr(op_expr->rhs, cstate);
+
+                instr = emit_instr(lookup_arith_opcode(op_expr), cstate);
+                instr->type = expr->type;
+                instr->lhs = lhs_reg;
+                instr->rhs = rhs_reg;
+                return instr->dst;
+            }
+
+        case EXPR_VAR:
+            {
+                ExprVar *var = (ExprVar *) expr;
+                ExprInstr *instr;
 
+                instr = emit_instr(EXPR_INSTR_VAR, cstate);
+                instr->type = expr->type;
+                set_var_ref(instr, var, cstate);
+                return instr->dst;
+            }
+
+        case EXPR_CONST:
+            {
+                ExprConst *c_expr = (ExprConst *) expr;
+                Datum *reg;
+
+                reg = &state->regs[cstate->nregs++];
+                *reg = c_expr->value;
+                return reg;
+            }
+
+        default:
+            ERROR("Unexpected node kind: %d", (int) expr->node.kind);
+    }
+}
+
+static const char *
+get_op_symbol(AstOperKind op_kind)
+{
+    switch (op_kind)
+    {
+        case AST_OP_PLUS:
+            return "+";
+        case AST_OP_MINUS:
+            return "-";
+        case AST_OP_TIMES:
+            return "*";
+        case AST_OP_DIVIDE:
+            return "/";
+        case AST_OP_MODULUS:
+            return "%";
+        case AST_OP_UMINUS:
+            return "neg";
         case AST_OP_LT:
+            return "<";
         case AST_OP_LTE:
+            return "<=";
         case AST_OP_GT:
+            return ">";
         case AST_OP_GTE:
-            return eval_op_logical;
-
+            return ">=";
         case AST_OP_EQ:
-            return eval_op_eq;
-
+            return "==";
         case AST_OP_NEQ:
-            return eval_op_neq;
+            return "!=";
 
-        /* AST_OP_UMINUS is handled above */
         default:
-            ERROR("Unexpected op kind: %d", (int) op_expr->op_kind);
+            ERROR("Unexpected op kind: %d", (int) op_kind);
     }
 }
 
-static eval_expr_func
-lookup_expr_eval_func(ExprNode *expr)
+/*
+ * Append a canonical textual form of the expression to "buf". Expressions
+ * with the same signature compute the same result from the same
+ * ExprEvalContext, so the signature is used to match expressions with
+ * their ahead-of-time compiled versions.
+ */
+void
+expr_get_signature(ExprNode *expr, StrBuf *buf)
 {
     switch (expr->node.kind)
     {
         case EXPR_OP:
-            return lookup_op_expr_eval_func((ExprOp *) expr);
+            {
+                ExprOp *op_expr = (ExprOp *) expr;
+
+                sbuf_appendf(buf, "(%s:%s ", get_op_symbol(op_expr->op_kind),
+                             get_type_name(expr->type));
+                expr_get_signature(op_expr->lhs, buf);
+                if (op_expr->rhs)
+                {
+                    sbuf_append_char(buf, ' ');
+                    expr_get_signature(op_expr->rhs, buf);
+                }
+                sbuf_append_char(buf, ')');
+            }
+            break;
 
         case EXPR_VAR:
-            return eval_var_expr;
+            {
+                ExprVar *var = (ExprVar *) expr;
+
+                sbuf_appendf(buf, "$%c%d:%s", var->is_outer ? 'o' : 'i',
+                             var->attno, get_type_name(expr->type));
+            }
+            break;
 
         case EXPR_CONST:
-            return eval_const_expr;
+            {
+                Datum value = ((ExprConst *) expr)->value;
+
+                sbuf_appendf(buf, "%s'", get_type_name(expr->type));
+                /* Make sure that distinct doubles have distinct signatures */
+                if (expr->type == TYPE_DOUBLE)
+                    sbuf_appendf(buf, "%.17g", value.d8);
+                else
+                    datum_to_str(value, expr->type, buf);
+                sbuf_append_char(buf, '\'');
+            }
+            break;
 
         default:
             ERROR("Unexpected node kind: %d", (int) expr->node.kind);
     }
 }
 
+static eval_expr_func
+lookup_compiled_expr(ExprNode *expr, C4Runtime *c4)
+{
+    C4CompiledExpr *compiled;
+    StrBuf *buf;
+
+    if (apr_hash_count(c4->compiled_exprs) == 0)
+        return NULL;
+
+    buf = sbuf_make(c4->tmp_pool);
+    expr_get_signature(expr, buf);
+    sbuf_append_char(buf, '\0');
+
+    compiled = apr_hash_get(c4->compiled_exprs, buf->data,
+                            APR_HASH_KEY_STRING);
+    if (compiled == NULL)
+        return NULL;
+
+    return compiled->func;
+}
+
 ExprState *
-make_expr_state(ExprNode *expr, ExprEvalContext *cxt, apr_pool_t *pool)
+make_expr_state(ExprNode *expr, ExprEvalContext *cxt, C4Runtime *c4,
+                apr_pool_t *pool)
 {
     ExprState *expr_state;
+    ExprCompileState cstate;
+    eval_expr_func compiled_func;
+    int nnodes;
 
     expr_state = apr_pcalloc(pool, sizeof(*expr_state));
     expr_state->cxt = cxt;
     expr_state->expr = expr;
-    expr_state->expr_func = lookup_expr_eval_func(expr_state->expr);
 
-    /*
-     * XXX: Slightly ugly, but we need to down-cast to determine whether we
-     * need to initialize sub-ExprStates.
-     */
-    if (expr->node.kind == EXPR_OP)
-    {
-        ExprOp *op_expr = (ExprOp *) expr;
+    /* Each node needs at most one instruction and one register */
+    nnodes = count_expr_nodes(expr);
+    expr_state->instrs = apr_palloc(pool, sizeof(ExprInstr) * nnodes);
+    expr_state->regs = apr_palloc(pool, sizeof(Datum) * nnodes);
+    expr_state->ninstrs = 0;
+
+    cstate.state = expr_state;
+    cstate.nregs = 0;
+    expr_state->result = compile_expr(expr, &cstate);
+    ASSERT(expr_state->ninstrs <= nnodes);
+    ASSERT(cstate.nregs <= nnodes);
+
+    /* Variables and constants don't need to run the interpreter loop */
+    if (expr->node.kind == EXPR_VAR)
+        expr_state->expr_func = eval_var_expr;
+    else if (expr->node.kind == EXPR_CONST)
+        expr_state->expr_func = eval_const_expr;
+    else
+        expr_state->expr_func = eval_program;
 
-        expr_state->lhs = make_expr_state(op_expr->lhs, cxt, pool);
-        if (op_expr->rhs)
-            expr_state->rhs = make_expr_state(op_expr->rhs, cxt, pool);
-    }
+    /* Prefer an ahead-of-time compiled version of the expression, if any */
+    compiled_func = lookup_compiled_expr(expr, c4);
+    if (compiled_func != NULL)
+        expr_state->expr_func = compiled_func;
 
     return expr_state;
 }
@@ -4,8 +4,12 @@
 #include "types/datum.h"
 #include "types/expr.h"
 #include "types/schema.h"
+#include "types/tuple.h"
+#include "util/hash_func.h"
 
 static void lookup_type_funcs(Schema *schema, apr_pool_t *pool);
+static void compute_tuple_layout(Schema *schema, apr_pool_t *pool);
+static void lookup_tuple_funcs(Schema *schema, apr_pool_t *pool);
 static TuplePool *schema_new_tuple_pool(Schema *schema, C4Runtime *c4);
 
 Schema *
@@ -17,6 +21,8 @@ schema_make(int len, DataType *types, C4Runtime *c4, apr_pool_t *pool)
     schema->len = len;
     schema->types = apr_pmemdup(pool, types, len * sizeof(DataType));
     lookup_type_funcs(schema, pool);
+    compute_tuple_layout(schema, pool);
+    lookup_tuple_funcs(schema, pool);
     schema->tuple_pool = schema_new_tuple_pool(schema, c4);
 
     return schema;
@@ -42,6 +48,8 @@ schema_make_from_ast(List *schema_ast, C4Runtime *c4, apr_pool_t *pool)
         i++;
     }
     lookup_type_funcs(schema, pool);
+    compute_tuple_layout(schema, pool);
+    lookup_tuple_funcs(schema, pool);
     schema->tuple_pool = schema_new_tuple_pool(schema, c4);
 
     return schema;
@@ -62,6 +70,8 @@ schema_make_from_exprs(int len, ExprState **expr_ary, C4Runtime *c4, apr_pool_t
         schema->types[i] = expr_ary[i]->expr->type;
     }
     lookup_type_funcs(schema, pool);
+    compute_tuple_layout(schema, pool);
+    lookup_tuple_funcs(schema, pool);
     schema->tuple_pool = schema_new_tuple_pool(schema, c4);
 
     return schema;
@@ -90,7 +100,7 @@ schema_equal(Schema *s1, Schema *s2)
 static apr_size_t
 schema_get_tuple_size(Schema *schema)
 {
-    return offsetof(Tuple, vals) + (schema->len * sizeof(Datum));
+    return offsetof(Tuple, data) + schema->data_size;
 }
 
 static TuplePool *
@@ -110,6 +120,10 @@ void lookup_type_funcs(Schema *s, apr_pool_t *pool)
     s->text_in_funcs = apr_palloc(pool, s->len * sizeof(datum_text_in_func));
     s->bin_out_funcs = apr_palloc(pool, s->len * sizeof(datum_bin_out_func));
     s->text_out_funcs = apr_palloc(pool, s->len * sizeof(datum_text_out_func));
+    s->compact_in_funcs = apr_palloc(pool,
+                                     s->len * sizeof(datum_bin_in_func));
+    s->compact_out_funcs = apr_palloc(pool,
+                                      s->len * sizeof(datum_bin_out_func));
 
     for (i = 0; i < s->len; i++)
     {
@@ -119,6 +133,213 @@ void lookup_type_funcs(Schema *s, apr_pool_t *pool)
         s->text_in_funcs[i] = type_get_text_in_func(s->types[i]);
         s->bin_out_funcs[i] = type_get_binary_out_func(s->types[i]);
         s->text_out_funcs[i] = type_get_text_out_func(s->types[i]);
+        s->compact_in_funcs[i] = type_get_compact_in_func(s->types[i]);
+        s->compact_out_funcs[i] = type_get_compact_out_func(s->types[i]);
+    }
+}
+
+/*
+ * Returns the number of bytes used to store a value of the given type in a
+ * packed tuple. Pass-by-reference types are stored as a pointer, so every
+ * value fits into a Datum.
+ */
+static int
+get_type_width(DataType type)
+{
+    switch (type)
+    {
+        case TYPE_BOOL:
+            return sizeof(bool);
+
+        case TYPE_CHAR:
+            return sizeof(unsigned char);
+
+        default:
+            return sizeof(Datum);
+    }
+}
+
+/*
+ * Compute the packed layout of tuples with this schema. We place columns in
+ * descending order of width (preserving schema order among columns of the
+ * same width), which means that every column is naturally aligned without
+ * needing any padding: e.g. a tuple with two ints and six bools needs 22
+ * bytes of column data, rather than 64.
+ */
+static void
+compute_tuple_layout(Schema *s, apr_pool_t *pool)
+{
+    int width;
+    int offset;
+    int i;
+
+    s->offsets = apr_palloc(pool, s->len * sizeof(int));
+    offset = 0;
+    for (width = sizeof(Datum); width > 0; width /= 2)
+    {
+        for (i = 0; i < s->len; i++)
+        {
+            if (get_type_width(s->types[i]) != width)
+                continue;
+
+            s->offsets[i] = offset;
+            offset += width;
+        }
+    }
+
+    s->data_size = offset;
+}
+
+/*
+ * Hash and equality functions for schemas that consist entirely of integer
+ * columns, which are by far the most common case. We avoid calling through
+ * the per-column function pointers, and unroll the loop for narrow schemas.
+ * In such schemas, the layout is simply an array of int64s.
+ */
+#define int_col(t, i)       (((apr_int64_t *) (t)->data)[(i)])
+
+static apr_uint32_t
+int1_tuple_hash(Tuple *t, __unused Schema *s)
+{
+    return hash_uint64((apr_uint64_t) int_col(t, 0));
+}
+
+static bool
+int1_tuple_eq(Tuple *t1, Tuple *t2, __unused Schema *s)
+{
+    return (int_col(t1, 0) == int_col(t2, 0));
+}
+
+static apr_uint32_t
+int2_tuple_hash(Tuple *t, __unused Schema *s)
+{
+    apr_uint32_t result;
+
+    result = hash_uint64((apr_uint64_t) int_col(t, 0));
+    return hash_combine(result,
+                        hash_uint64((apr_uint64_t) int_col(t, 1)));
+}
+
+static bool
+int2_tuple_eq(Tuple *t1, Tuple *t2, __unused Schema *s)
+{
+    return (int_col(t1, 0) == int_col(t2, 0) &&
+            int_col(t1, 1) == int_col(t2, 1));
+}
+
+static apr_uint32_t
+int_tuple_hash(Tuple *t, Schema *s)
+{
+    apr_uint32_t result;
+    int i;
+
+    result = 0;
+    for (i = 0; i < s->len; i++)
+    {
+        apr_uint64_t val = (apr_uint64_t) int_col(t, i);
+
+        result = hash_combine(result, hash_uint64(val));
+    }
+
+    return result;
+}
+
+static bool
+int_tuple_eq(Tuple *t1, Tuple *t2, Schema *s)
+{
+    int i;
+
+    for (i = 0; i < s->len; i++)
+    {
+        if (int_col(t1, i) != int_col(t2, i))
+            return false;
+    }
+
+    return true;
+}
+
+static apr_uint32_t
+generic_tuple_hash(Tuple *t, Schema *s)
+{
+    apr_uint32_t result;
+    int i;
+
+    result = 0;
+    for (i = 0; i < s->len; i++)
+        result = hash_combine(result,
+                              (s->hash_funcs[i])(tuple_get_val(t, s, i)));
+
+    return result;
+}
+
+static bool
+generic_tuple_eq(Tuple *t1, Tuple *t2, Schema *s)
+{
+    int i;
+
+    for (i = 0; i < s->len; i++)
+    {
+        int colno = s->eq_order[i];
+
+        if (!(s->eq_funcs[colno])(tuple_get_val(t1, s, colno),
+                                  tuple_get_val(t2, s, colno)))
+            return false;
+    }
+
+    return true;
+}
+
+static void
+lookup_tuple_funcs(Schema *s, apr_pool_t *pool)
+{
+    bool all_int;
+    int nfixed;
+    int fixed_idx;
+    int var_idx;
+    int i;
+
+    /* Addresses are compared and hashed as ints (see datum.h) */
+    all_int = true;
+    nfixed = 0;
+    for (i = 0; i < s->len; i++)
+    {
+        if (s->types[i] != TYPE_INT && s->types[i] != TYPE_ADDR)
+            all_int = false;
+        if (s->types[i] != TYPE_STRING)
+            nfixed++;
+    }
+
+    /* Put the pass-by-value columns first, preserving their order */
+    s->eq_order = apr_palloc(pool, s->len * sizeof(int));
+    fixed_idx = 0;
+    var_idx = nfixed;
+    for (i = 0; i < s->len; i++)
+    {
+        if (s->types[i] != TYPE_STRING)
+            s->eq_order[fixed_idx++] = i;
+        else
+            s->eq_order[var_idx++] = i;
+    }
+
+    if (all_int && s->len == 1)
+    {
+        s->tuple_hash = int1_tuple_hash;
+        s->tuple_eq = int1_tuple_eq;
+    }
+    else if (all_int && s->len == 2)
+    {
+        s->tuple_hash = int2_tuple_hash;
+        s->tuple_eq = int2_tuple_eq;
+    }
+    else if (all_int)
+    {
+        s->tuple_hash = int_tuple_hash;
+        s->tuple_eq = int_tuple_eq;
+    }
+    else
+    {
+        s->tuple_hash = generic_tuple_hash;
+        s->tuple_eq = generic_tuple_eq;
     }
 }
 
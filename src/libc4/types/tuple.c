@@ -10,6 +10,7 @@ tuple_make_empty(Schema *s)
 
     t = tuple_pool_loan(s->tuple_pool);
     t->refcount = 1;
+    t->hash_valid = false;
     return t;
 }
 
@@ -17,10 +18,13 @@ Tuple *
 tuple_make(Schema *s, Datum *values)
 {
     Tuple *t;
+    int i;
 
     t = tuple_make_empty(s);
     /* XXX: pass-by-ref types? */
-    memcpy(t->vals, values, s->len * sizeof(Datum));
+    for (i = 0; i < s->len; i++)
+        tuple_set_val(t, s, i, values[i]);
+
     return t;
 }
 
@@ -34,7 +38,7 @@ tuple_make_from_strings(Schema *s, char **values)
 
     for (i = 0; i < s->len; i++)
     {
-        tuple_get_val(t, i) = (s->text_in_funcs[i])(values[i]);
+        tuple_set_val(t, s, i, (s->text_in_funcs[i])(values[i]));
     }
 
     return t;
@@ -58,49 +62,13 @@ tuple_unpin(Tuple *tuple, Schema *s)
         int i;
 
         for (i = 0; i < s->len; i++)
-            datum_free(tuple_get_val(tuple, i),
+            datum_free(tuple_get_val(tuple, s, i),
                        schema_get_type(s, i));
 
         tuple_pool_return(s->tuple_pool, tuple);
     }
 }
 
-bool
-tuple_equal(Tuple *t1, Tuple *t2, Schema *s)
-{
-    int i;
-
-    for (i = 0; i < s->len; i++)
-    {
-        Datum val1 = tuple_get_val(t1, i);
-        Datum val2 = tuple_get_val(t2, i);
-
-        if ((s->eq_funcs[i])(val1, val2) == false)
-            return false;
-    }
-
-    return true;
-}
-
-apr_uint32_t
-tuple_hash(Tuple *tuple, Schema *s)
-{
-    apr_uint32_t result;
-    int i;
-
-    result = 37;
-    for (i = 0; i < s->len; i++)
-    {
-        Datum val = tuple_get_val(tuple, i);
-        apr_uint32_t h = (s->hash_funcs[i])(val);
-
-        /* XXX: choose a better mixing function than XOR */
-        result ^= h;
-    }
-
-    return result;
-}
-
 bool
 tuple_cmp_tbl(const void *k1, const void *k2, void *data)
 {
@@ -146,7 +114,7 @@ tuple_to_str_buf(Tuple *tuple, Schema *s, StrBuf *buf)
         if (i != 0)
             sbuf_append_char(buf, ',');
 
-        (s->text_out_funcs[i])(tuple_get_val(tuple, i), buf);
+        (s->text_out_funcs[i])(tuple_get_val(tuple, s, i), buf);
     }
 
     /* Note that we don't NUL-terminate the buffer */
@@ -159,7 +127,7 @@ tuple_to_buf(Tuple *tuple, Schema *s, StrBuf *buf)
 
     for (i = 0; i < s->len; i++)
     {
-        (s->bin_out_funcs[i])(tuple_get_val(tuple, i), buf);
+        (s->bin_out_funcs[i])(tuple_get_val(tuple, s, i), buf);
     }
 }
 
@@ -173,7 +141,38 @@ tuple_from_buf(StrBuf *buf, Schema *s)
 
     for (i = 0; i < s->len; i++)
     {
-        tuple_get_val(result, i) = (s->bin_in_funcs[i])(buf);
+        tuple_set_val(result, s, i, (s->bin_in_funcs[i])(buf));
+    }
+
+    return result;
+}
+
+/*
+ * Like tuple_to_buf() and tuple_from_buf(), but using the compact binary
+ * format; see datum.c.
+ */
+void
+tuple_to_buf_compact(Tuple *tuple, Schema *s, StrBuf *buf)
+{
+    int i;
+
+    for (i = 0; i < s->len; i++)
+    {
+        (s->compact_out_funcs[i])(tuple_get_val(tuple, s, i), buf);
+    }
+}
+
+Tuple *
+tuple_from_buf_compact(StrBuf *buf, Schema *s)
+{
+    Tuple *result;
+    int i;
+
+    result = tuple_make_empty(s);
+
+    for (i = 0; i < s->len; i++)
+    {
+        tuple_set_val(result, s, i, (s->compact_in_funcs[i])(buf));
     }
 
     return result;
@@ -198,7 +197,7 @@ tuple_to_sql_insert_str(Tuple *tuple, Schema *s, apr_pool_t *pool)
         if (s->types[i] == TYPE_STRING)
             sbuf_append_char(buf, '\'');
 
-        (s->text_out_funcs[i])(tuple_get_val(tuple, i), buf);
+        (s->text_out_funcs[i])(tuple_get_val(tuple, s, i), buf);
 
         if (s->types[i] == TYPE_STRING)
             sbuf_append_char(buf, '\'');
@@ -208,6 +207,11 @@ tuple_to_sql_insert_str(Tuple *tuple, Schema *s, apr_pool_t *pool)
     return buf->data;
 }
 
+/*
+ * A tuple is remote if its location specifier is not the local address. A
+ * named address is compared by the address its host name resolves to; if
+ * the name can't be resolved, the tuple is considered remote.
+ */
 bool
 tuple_is_remote(Tuple *tuple, TableDef *tbl_def, C4Runtime *c4)
 {
@@ -216,6 +220,9 @@ tuple_is_remote(Tuple *tuple, TableDef *tbl_def, C4Runtime *c4)
     if (tbl_def->ls_colno == -1)
         return false;
 
-    tuple_addr = tuple_get_val(tuple, tbl_def->ls_colno);
-    return (string_equal(c4->local_addr, tuple_addr) == false);
+    tuple_addr = tuple_get_val(tuple, tbl_def->schema, tbl_def->ls_colno);
+    if (!addr_resolve(tuple_addr, &tuple_addr))
+        return true;
+
+    return (addr_equal(c4->local_addr, tuple_addr) == false);
 }
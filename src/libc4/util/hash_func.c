@@ -312,3 +312,27 @@ hash_any(register const unsigned char *k, register int keylen)
 
     return c;
 }
+
+/*
+ * hash_uint64() -- hash a 64-bit value
+ *
+ * This has the same result as
+ *      hash_any(&k, sizeof(apr_uint64_t))
+ * on little-endian machines, but is faster: the value is always aligned and
+ * of known length, so we can skip the main loop.
+ */
+apr_uint32_t
+hash_uint64(apr_uint64_t k)
+{
+    register apr_uint32_t a,
+                b,
+                c;
+
+    a = b = c = 0x9e3779b9 + (apr_uint32_t) sizeof(apr_uint64_t) + 3923095;
+    a += (apr_uint32_t) k;
+    b += (apr_uint32_t) (k >> 32);
+
+    final(a, b, c);
+
+    return c;
+}
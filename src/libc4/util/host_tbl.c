@@ -0,0 +1,353 @@
+#include <apr_hash.h>
+#include <apr_network_io.h>
+#include <apr_thread_mutex.h>
+#include <apr_time.h>
+
+#include "c4-internal.h"
+#include "util/host_tbl.h"
+
+typedef enum HostState
+{
+    HOST_UNRESOLVED,
+    HOST_RESOLVED,
+    HOST_FAILED
+} HostState;
+
+/*
+ * After a name fails to resolve, we don't try again until a backoff period
+ * has passed. The backoff doubles with each consecutive failure, up to a
+ * limit.
+ */
+#define HOST_RETRY_MIN_USEC     apr_time_from_sec(1)
+#define HOST_RETRY_MAX_USEC     apr_time_from_sec(60)
+
+typedef struct HostEntry
+{
+    /* NUL-terminated; immutable once the entry has been added */
+    char *name;
+    HostState state;
+    /* In host byte order; only valid if state == HOST_RESOLVED */
+    apr_uint32_t ipv4;
+    /* Only valid if state == HOST_FAILED */
+    int nfailures;
+    apr_time_t retry_time;
+} HostEntry;
+
+typedef struct HostCacheEntry
+{
+    /* NULL if not yet cached */
+    const char *name;
+    bool resolved;
+    apr_uint32_t ipv4;
+} HostCacheEntry;
+
+/*
+ * A runtime's copy of the names it has used and the addresses it has
+ * resolved, indexed by host ID. Only its own thread uses it, so it can be
+ * read without taking the lock.
+ */
+struct HostCache
+{
+    apr_pool_t *pool;
+    HostCacheEntry *entries;
+    apr_uint32_t nentries;
+};
+
+/*
+ * Allocated in a top-level pool, which is released by apr_terminate(). The
+ * lock must be held to access the table, but not while resolving a name.
+ */
+static apr_pool_t *host_pool = NULL;
+static apr_thread_mutex_t *host_lock = NULL;
+/* Map from host name => HostEntry */
+static apr_hash_t *host_names = NULL;
+/* Array of entries, indexed by ID */
+static HostEntry **host_entries = NULL;
+static apr_uint32_t host_nentries = 0;
+static apr_uint32_t host_max_entries = 0;
+
+static __thread HostCache *current_cache = NULL;
+
+static apr_status_t host_cache_cleanup(void *data);
+
+static void
+lock_host_tbl(void)
+{
+    apr_status_t s;
+
+    s = apr_thread_mutex_lock(host_lock);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+}
+
+static void
+unlock_host_tbl(void)
+{
+    apr_status_t s;
+
+    s = apr_thread_mutex_unlock(host_lock);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+}
+
+/*
+ * Invoked by c4_initialize(), before any C4 instances have been created.
+ */
+void
+host_tbl_initialize(void)
+{
+    apr_status_t s;
+
+    if (host_pool != NULL)
+        return;
+
+    s = apr_pool_create(&host_pool, NULL);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+
+    s = apr_thread_mutex_create(&host_lock, APR_THREAD_MUTEX_DEFAULT,
+                                host_pool);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+
+    host_names = apr_hash_make(host_pool);
+    host_max_entries = 16;
+    host_entries = apr_palloc(host_pool,
+                              host_max_entries * sizeof(HostEntry *));
+}
+
+static HostEntry *
+get_entry(apr_uint32_t id)
+{
+    ASSERT(id < host_nentries);
+    return host_entries[id];
+}
+
+/*
+ * Return the ID of the given host name, adding it to the table if needed.
+ * The name does not need to be NUL-terminated. This does not resolve the
+ * name.
+ */
+apr_uint32_t
+host_tbl_intern(const char *name, apr_size_t len)
+{
+    apr_uint32_t *id;
+
+    lock_host_tbl();
+    id = apr_hash_get(host_names, name, len);
+    if (id == NULL)
+    {
+        HostEntry *entry;
+
+        entry = apr_palloc(host_pool, sizeof(*entry));
+        entry->name = apr_pstrmemdup(host_pool, name, len);
+        entry->state = HOST_UNRESOLVED;
+        entry->ipv4 = 0;
+        entry->nfailures = 0;
+        entry->retry_time = 0;
+
+        /* The old array is just left in the pool */
+        if (host_nentries == host_max_entries)
+        {
+            HostEntry **new_entries;
+
+            host_max_entries *= 2;
+            new_entries = apr_palloc(host_pool,
+                                     host_max_entries * sizeof(HostEntry *));
+            memcpy(new_entries, host_entries,
+                   host_nentries * sizeof(HostEntry *));
+            host_entries = new_entries;
+        }
+
+        id = apr_palloc(host_pool, sizeof(*id));
+        *id = host_nentries++;
+        host_entries[*id] = entry;
+        apr_hash_set(host_names, entry->name, len, id);
+    }
+    unlock_host_tbl();
+
+    return *id;
+}
+
+HostCache *
+host_cache_make(apr_pool_t *pool)
+{
+    HostCache *cache;
+
+    cache = apr_palloc(pool, sizeof(*cache));
+    cache->pool = pool;
+    cache->entries = NULL;
+    cache->nentries = 0;
+
+    apr_pool_cleanup_register(pool, cache, host_cache_cleanup,
+                              apr_pool_cleanup_null);
+
+    return cache;
+}
+
+void
+host_cache_set_current(HostCache *cache)
+{
+    current_cache = cache;
+}
+
+static apr_status_t
+host_cache_cleanup(void *data)
+{
+    if (current_cache == (HostCache *) data)
+        current_cache = NULL;
+
+    return APR_SUCCESS;
+}
+
+static HostCacheEntry *
+host_cache_get_entry(HostCache *cache, apr_uint32_t id)
+{
+    /* The old array is just left in the pool */
+    if (id >= cache->nentries)
+    {
+        HostCacheEntry *new_entries;
+        apr_uint32_t new_size;
+
+        new_size = Max(cache->nentries * 2, 16);
+        while (new_size <= id)
+            new_size *= 2;
+
+        new_entries = apr_pcalloc(cache->pool,
+                                  new_size * sizeof(HostCacheEntry));
+        if (cache->nentries > 0)
+            memcpy(new_entries, cache->entries,
+                   cache->nentries * sizeof(HostCacheEntry));
+        cache->entries = new_entries;
+        cache->nentries = new_size;
+    }
+
+    return &cache->entries[id];
+}
+
+const char *
+host_tbl_get_name(apr_uint32_t id)
+{
+    HostCache *cache = current_cache;
+    const char *result;
+
+    if (cache != NULL && id < cache->nentries &&
+        cache->entries[id].name != NULL)
+        return cache->entries[id].name;
+
+    lock_host_tbl();
+    result = get_entry(id)->name;
+    unlock_host_tbl();
+
+    if (cache != NULL)
+        host_cache_get_entry(cache, id)->name = result;
+
+    return result;
+}
+
+static apr_time_t
+get_retry_backoff(int nfailures)
+{
+    apr_time_t backoff = HOST_RETRY_MIN_USEC;
+
+    while (--nfailures > 0 && backoff < HOST_RETRY_MAX_USEC)
+        backoff *= 2;
+
+    return Min(backoff, HOST_RETRY_MAX_USEC);
+}
+
+/*
+ * Resolve the name via the shared table, looking it up if no thread has
+ * resolved it yet and we're not waiting out the backoff after a failure.
+ */
+static bool
+resolve_entry(apr_uint32_t id, apr_uint32_t *ipv4)
+{
+    HostEntry *entry;
+    HostState state;
+    apr_time_t now;
+    apr_pool_t *tmp_pool;
+    apr_sockaddr_t *sa;
+    apr_status_t s;
+
+    now = apr_time_now();
+    lock_host_tbl();
+    entry = get_entry(id);
+    state = entry->state;
+    *ipv4 = entry->ipv4;
+    if (state == HOST_FAILED && now >= entry->retry_time)
+    {
+        /* Other threads keep waiting while we retry */
+        entry->retry_time = now + get_retry_backoff(entry->nfailures);
+        state = HOST_UNRESOLVED;
+    }
+    unlock_host_tbl();
+
+    if (state != HOST_UNRESOLVED)
+        return (state == HOST_RESOLVED);
+
+    s = apr_pool_create(&tmp_pool, NULL);
+    if (s != APR_SUCCESS)
+        FAIL_APR(s);
+
+    s = apr_sockaddr_info_get(&sa, entry->name, APR_INET, 0, 0, tmp_pool);
+    if (s == APR_SUCCESS)
+        *ipv4 = ntohl(sa->sa.sin.sin_addr.s_addr);
+
+    apr_pool_destroy(tmp_pool);
+
+    /*
+     * Another thread might have looked the name up concurrently; a success
+     * by either of us wins.
+     */
+    lock_host_tbl();
+    if (s == APR_SUCCESS)
+    {
+        entry->state = HOST_RESOLVED;
+        entry->ipv4 = *ipv4;
+    }
+    else if (entry->state != HOST_RESOLVED)
+    {
+        entry->state = HOST_FAILED;
+        entry->nfailures++;
+        entry->retry_time = apr_time_now() +
+                            get_retry_backoff(entry->nfailures);
+    }
+    state = entry->state;
+    *ipv4 = entry->ipv4;
+    unlock_host_tbl();
+
+    return (state == HOST_RESOLVED);
+}
+
+/*
+ * Resolve the host name with the given ID to an IPv4 address, in host byte
+ * order. Returns false if the name can't be resolved (for now). The first
+ * lookup of a name might block; after that, the calling runtime finds the
+ * address in its own cache, without taking the lock.
+ */
+bool
+host_tbl_resolve(apr_uint32_t id, apr_uint32_t *ipv4)
+{
+    HostCache *cache = current_cache;
+
+    if (cache != NULL && id < cache->nentries &&
+        cache->entries[id].resolved)
+    {
+        *ipv4 = cache->entries[id].ipv4;
+        return true;
+    }
+
+    if (!resolve_entry(id, ipv4))
+        return false;
+
+    if (cache != NULL)
+    {
+        HostCacheEntry *cache_entry = host_cache_get_entry(cache, id);
+
+        cache_entry->resolved = true;
+        cache_entry->ipv4 = *ipv4;
+    }
+
+    return true;
+}
@@ -0,0 +1,182 @@
+#include "c4-internal.h"
+#include "util/intern.h"
+
+/*
+ * We use open addressing with linear probing. Since we know the hash code of
+ * each interned string, we can delete entries by shifting later entries in
+ * the same probe sequence backward, rather than leaving tombstones.
+ */
+struct InternTable
+{
+    apr_pool_t *pool;
+    C4String **slots;
+    apr_uint32_t nslots;    /* Always a power of 2 */
+    apr_uint32_t nused;
+};
+
+#define INTERN_INITIAL_SIZE     256
+
+static __thread InternTable *current_tbl = NULL;
+
+static apr_status_t intern_table_cleanup(void *data);
+
+static C4String **
+alloc_slots(apr_uint32_t nslots)
+{
+    return ol_alloc0(nslots * sizeof(C4String *));
+}
+
+InternTable *
+intern_table_make(apr_pool_t *pool)
+{
+    InternTable *tbl;
+
+    tbl = apr_palloc(pool, sizeof(*tbl));
+    tbl->pool = pool;
+    tbl->nslots = INTERN_INITIAL_SIZE;
+    tbl->nused = 0;
+    tbl->slots = alloc_slots(tbl->nslots);
+
+    apr_pool_cleanup_register(pool, tbl, intern_table_cleanup,
+                              apr_pool_cleanup_null);
+
+    return tbl;
+}
+
+void
+intern_table_set_current(InternTable *tbl)
+{
+    current_tbl = tbl;
+}
+
+InternTable *
+intern_table_get_current(void)
+{
+    return current_tbl;
+}
+
+C4String *
+intern_table_lookup(InternTable *tbl, const char *data, apr_size_t len,
+                    apr_uint32_t hash)
+{
+    apr_uint32_t mask = tbl->nslots - 1;
+    apr_uint32_t i;
+
+    for (i = hash & mask; tbl->slots[i] != NULL; i = (i + 1) & mask)
+    {
+        C4String *s = tbl->slots[i];
+
+        if (s->hash == hash && s->len == len &&
+            memcmp(s->data, data, len) == 0)
+            return s;
+    }
+
+    return NULL;
+}
+
+static void
+insert_slot(C4String **slots, apr_uint32_t nslots, C4String *s)
+{
+    apr_uint32_t mask = nslots - 1;
+    apr_uint32_t i;
+
+    for (i = s->hash & mask; slots[i] != NULL; i = (i + 1) & mask)
+        ;
+
+    slots[i] = s;
+}
+
+static void
+grow_table(InternTable *tbl)
+{
+    C4String **new_slots;
+    apr_uint32_t new_nslots;
+    apr_uint32_t i;
+
+    new_nslots = tbl->nslots * 2;
+    new_slots = alloc_slots(new_nslots);
+    for (i = 0; i < tbl->nslots; i++)
+    {
+        if (tbl->slots[i] != NULL)
+            insert_slot(new_slots, new_nslots, tbl->slots[i]);
+    }
+
+    ol_free(tbl->slots);
+    tbl->slots = new_slots;
+    tbl->nslots = new_nslots;
+}
+
+/*
+ * Add a string to the table; the caller should have already checked that
+ * the table doesn't contain an equal string. The string's "hash" field must
+ * be filled in.
+ */
+void
+intern_table_add(InternTable *tbl, C4String *s)
+{
+    ASSERT(!s->interned);
+
+    /* Keep the load factor below 1/2 */
+    if ((tbl->nused + 1) * 2 > tbl->nslots)
+        grow_table(tbl);
+
+    insert_slot(tbl->slots, tbl->nslots, s);
+    s->interned = true;
+    tbl->nused++;
+}
+
+void
+intern_table_remove(InternTable *tbl, C4String *s)
+{
+    apr_uint32_t mask = tbl->nslots - 1;
+    apr_uint32_t i;
+    apr_uint32_t j;
+
+    ASSERT(s->interned);
+    for (i = s->hash & mask; tbl->slots[i] != s; i = (i + 1) & mask)
+        ASSERT(tbl->slots[i] != NULL);
+
+    /*
+     * Shift back any later entries in the probe sequence that would no
+     * longer be reachable once slot "i" is empty.
+     */
+    for (j = (i + 1) & mask; tbl->slots[j] != NULL; j = (j + 1) & mask)
+    {
+        apr_uint32_t home = tbl->slots[j]->hash & mask;
+
+        /* Can the entry at "j" be moved to "i"? */
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            tbl->slots[i] = tbl->slots[j];
+            i = j;
+        }
+    }
+
+    tbl->slots[i] = NULL;
+    s->interned = false;
+    tbl->nused--;
+}
+
+/*
+ * When the runtime is shutdown, some interned strings might outlive the
+ * table (e.g. if they are referenced by a pool that is destroyed later), so
+ * mark them as no longer interned.
+ */
+static apr_status_t
+intern_table_cleanup(void *data)
+{
+    InternTable *tbl = (InternTable *) data;
+    apr_uint32_t i;
+
+    for (i = 0; i < tbl->nslots; i++)
+    {
+        if (tbl->slots[i] != NULL)
+            tbl->slots[i]->interned = false;
+    }
+
+    ol_free(tbl->slots);
+    if (current_tbl == tbl)
+        current_tbl = NULL;
+
+    return APR_SUCCESS;
+}
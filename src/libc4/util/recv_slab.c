@@ -0,0 +1,131 @@
+#include "c4-internal.h"
+#include "util/recv_slab.h"
+
+static __thread RecvSlab *current_slab = NULL;
+
+/*
+ * Make a new slab with room for "size" bytes. The caller owns the slab, and
+ * holds the only reference to it.
+ */
+RecvSlab *
+recv_slab_make(apr_size_t size)
+{
+    RecvSlab *slab;
+
+    slab = ol_alloc(sizeof(*slab));
+    slab->refcount = 1;
+    slab->owned = true;
+    slab->strings = NULL;
+    slab->live_bytes = 0;
+    slab->buf.data = ol_alloc(size);
+    slab->buf.max_len = size;
+    sbuf_reset(&slab->buf);
+
+    return slab;
+}
+
+static void
+recv_slab_unpin(RecvSlab *slab)
+{
+    ASSERT(slab->refcount >= 1);
+    slab->refcount--;
+    if (slab->refcount == 0)
+    {
+        ASSERT(slab != current_slab);
+        ASSERT(slab->strings == NULL);
+        ol_free(slab->buf.data);
+        ol_free(slab);
+    }
+}
+
+/*
+ * If the owner has released the slab and most of it is dead, copy the
+ * strings that reference it into their own storage, dropping their
+ * references to the slab. The caller must hold a reference to the slab.
+ */
+static void
+recv_slab_maybe_evacuate(RecvSlab *slab)
+{
+    SlabString *ss;
+
+    if (slab->owned ||
+        slab->live_bytes * RECV_SLAB_MIN_LIVE_RATIO >= slab->buf.max_len)
+        return;
+
+    while ((ss = slab->strings) != NULL)
+    {
+        char *data;
+
+        data = ol_alloc(ss->str.len);
+        memcpy(data, ss->data, ss->str.len);
+        ss->data = data;
+        ss->slab = NULL;
+
+        slab->strings = ss->next;
+        slab->live_bytes -= ss->str.len;
+        ss->prev = NULL;
+        ss->next = NULL;
+        recv_slab_unpin(slab);
+    }
+
+    ASSERT(slab->live_bytes == 0);
+}
+
+/*
+ * Drop the owner's reference to the slab; the slab is freed once no strings
+ * reference it.
+ */
+void
+recv_slab_release(RecvSlab *slab)
+{
+    ASSERT(slab->owned);
+    slab->owned = false;
+    recv_slab_maybe_evacuate(slab);
+    recv_slab_unpin(slab);
+}
+
+/*
+ * Record that a string references the slab's bytes.
+ */
+void
+recv_slab_add_string(RecvSlab *slab, SlabString *ss)
+{
+    ss->prev = NULL;
+    ss->next = slab->strings;
+    if (slab->strings != NULL)
+        slab->strings->prev = ss;
+    slab->strings = ss;
+    slab->live_bytes += ss->str.len;
+    slab->refcount++;
+}
+
+/*
+ * Record that a string no longer references the slab's bytes; it must not
+ * be used afterward.
+ */
+void
+recv_slab_remove_string(RecvSlab *slab, SlabString *ss)
+{
+    if (ss->prev != NULL)
+        ss->prev->next = ss->next;
+    else
+        slab->strings = ss->next;
+    if (ss->next != NULL)
+        ss->next->prev = ss->prev;
+    slab->live_bytes -= ss->str.len;
+
+    recv_slab_maybe_evacuate(slab);
+    recv_slab_unpin(slab);
+}
+
+void
+recv_slab_set_current(RecvSlab *slab)
+{
+    current_slab = slab;
+}
+
+RecvSlab *
+recv_slab_get_current(void)
+{
+    return current_slab;
+}
@@ -28,18 +28,43 @@ socket_get_remote_addr(apr_socket_t *sock)
     return addr;
 }
 
-char *
-socket_get_remote_loc(apr_socket_t *sock, apr_pool_t *pool)
+/*
+ * Returns the address of the remote end of the socket, as an address Datum.
+ */
+Datum
+socket_get_remote_loc(apr_socket_t *sock)
 {
     apr_sockaddr_t *addr;
+
+    addr = socket_get_remote_addr(sock);
+    ASSERT(addr->family == APR_INET);
+
+    return addr_make(ntohl(addr->sa.sin.sin_addr.s_addr), addr->port);
+}
+
+/*
+ * Convert an address Datum into a socket address that can be connected to.
+ * No name resolution is required, since the Datum must hold an IP address
+ * (see addr_resolve()).
+ */
+apr_sockaddr_t *
+socket_addr_from_loc(Datum loc, apr_pool_t *pool)
+{
+    apr_sockaddr_t *addr;
+    apr_uint32_t ipv4;
     apr_status_t s;
     char *ip;
 
-    addr = socket_get_remote_addr(sock);
+    ASSERT(!addr_is_named(loc));
+    ipv4 = addr_get_ipv4(loc);
+    ip = apr_psprintf(pool, "%u.%u.%u.%u",
+                      (ipv4 >> 24) & 0xFF, (ipv4 >> 16) & 0xFF,
+                      (ipv4 >> 8) & 0xFF, ipv4 & 0xFF);
 
-    s = apr_sockaddr_ip_get(&ip, addr);
+    s = apr_sockaddr_info_get(&addr, ip, APR_INET, addr_get_port(loc),
+                              0, pool);
     if (s != APR_SUCCESS)
         FAIL_APR(s);
 
-    return apr_psprintf(pool, "tcp:%s:%hu", ip, addr->port);
+    return addr;
 }
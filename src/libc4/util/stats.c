@@ -0,0 +1,23 @@
+#include "c4-internal.h"
+#include "util/stats.h"
+
+#ifdef C4_STATS_ENABLED
+__thread C4Stats c4_stats;
+#endif
+
+void
+stats_log(__unused C4Runtime *c4)
+{
+#ifdef C4_STATS_ENABLED
+    c4_log(c4, "Tuple hash: %" APR_UINT64_T_FMT " calls, %"
+           APR_UINT64_T_FMT " computed, %" APR_UINT64_T_FMT " cached",
+           c4_stats.tuple_hash_calls, c4_stats.tuple_hash_computed,
+           c4_stats.tuple_hash_calls - c4_stats.tuple_hash_computed);
+    c4_log(c4, "Network: %" APR_UINT64_T_FMT " tuples sent, %"
+           APR_UINT64_T_FMT " received; %" APR_UINT64_T_FMT " bytes in %"
+           APR_UINT64_T_FMT " send calls; %" APR_UINT64_T_FMT " recv calls",
+           c4_stats.net_tuples_sent, c4_stats.net_tuples_recv,
+           c4_stats.net_bytes_sent, c4_stats.net_send_calls,
+           c4_stats.net_recv_calls);
+#endif
+}
@@ -1,5 +1,8 @@
+#include <sys/uio.h>
+
 #include "c4-internal.h"
 #include "util/socket.h"
+#include "util/stats.h"
 #include "util/strbuf.h"
 
 static apr_status_t sbuf_cleanup(void *data);
@@ -41,6 +44,22 @@ sbuf_reset_pos(StrBuf *sbuf)
     sbuf->pos = 0;
 }
 
+/*
+ * Discard the data before the current position, moving any unread data to
+ * the start of the buffer. The buffer's storage is retained for reuse.
+ */
+void
+sbuf_compact(StrBuf *sbuf)
+{
+    apr_size_t avail = sbuf_data_avail(sbuf);
+
+    if (avail > 0 && sbuf->pos > 0)
+        memmove(sbuf->data, sbuf->data + sbuf->pos, avail);
+
+    sbuf->len = avail;
+    sbuf->pos = 0;
+}
+
 /*
  * Return a copy of the current content of the StrBuf allocated from "pool",
  * plus a NUL-terminator. Note that we can do much better than apr_pstrdup()
@@ -167,6 +186,23 @@ sbuf_append_int32(StrBuf *sbuf, apr_uint32_t i)
     sbuf->len += sizeof(i);
 }
 
+/*
+ * Append an unsigned integer in a variable-length format: 7 bits per byte,
+ * least significant group first, with the high bit of each byte set if more
+ * bytes follow. Small values take a single byte.
+ */
+void
+sbuf_append_varint(StrBuf *sbuf, apr_uint64_t i)
+{
+    sbuf_enlarge(sbuf, VARINT_MAX_LEN);
+    while (i >= 0x80)
+    {
+        sbuf->data[sbuf->len++] = (char) ((i & 0x7F) | 0x80);
+        i >>= 7;
+    }
+    sbuf->data[sbuf->len++] = (char) i;
+}
+
 /*
  * Ensure that the buffer can hold "more_bytes" more bytes.
  *
@@ -221,6 +257,44 @@ sbuf_read_int32(StrBuf *sbuf)
     return result;
 }
 
+/*
+ * Read an unsigned integer in the format written by sbuf_append_varint().
+ */
+apr_uint64_t
+sbuf_read_varint64(StrBuf *sbuf)
+{
+    apr_uint64_t result;
+    int shift;
+
+    result = 0;
+    for (shift = 0; shift < 64; shift += 7)
+    {
+        unsigned char c = sbuf_read_char(sbuf);
+
+        result |= ((apr_uint64_t) (c & 0x7F)) << shift;
+        if ((c & 0x80) == 0)
+            return result;
+    }
+
+    FAIL();             /* Malformed varint */
+    return 0;           /* Keep compiler quiet */
+}
+
+/*
+ * Like sbuf_read_varint64(), but the value must fit in 32 bits.
+ */
+apr_uint32_t
+sbuf_read_varint(StrBuf *sbuf)
+{
+    apr_uint64_t result;
+
+    result = sbuf_read_varint64(sbuf);
+    if (result > APR_UINT32_MAX)
+        FAIL();
+
+    return (apr_uint32_t) result;
+}
+
 void
 sbuf_read_data(StrBuf *sbuf, char *data, apr_size_t len)
 {
@@ -232,30 +306,41 @@ sbuf_read_data(StrBuf *sbuf, char *data, apr_size_t len)
 }
 
 /*
- * Try to make it so that there are "len" bytes available to be read
- * from the buffer. This is performed relative to the current buffer
- * position: for instance, if we already have 2 un-read bytes in the
- * buffer and the caller asks for 4, we try to read 2 more bytes from
- * the given socket.
- *
- * Returns true if successful, false otherwise. *is_eof indicates
- * whether we hit EOF -- this might happen even if "true" is returned.
+ * Like sbuf_read_data(), but return a pointer to the data within the buffer,
+ * rather than copying it. The result is only valid until the buffer is next
+ * modified.
  */
-bool
-sbuf_socket_recv(StrBuf *sbuf, apr_socket_t *sock, apr_size_t len, bool *is_eof)
+const char *
+sbuf_read_ptr(StrBuf *sbuf, apr_size_t len)
+{
+    const char *result;
+
+    if (len > sbuf_data_avail(sbuf))
+        FAIL();         /* Not enough data in the buffer */
+
+    result = sbuf->data + sbuf->pos;
+    sbuf->pos += len;
+    return result;
+}
+
+/*
+ * Read whatever data is available from the socket, up to "max_len" bytes,
+ * and append it to the buffer. Returns the number of bytes read; *is_eof
+ * indicates whether we hit EOF.
+ */
+apr_size_t
+sbuf_socket_recv_some(StrBuf *sbuf, apr_socket_t *sock,
+                      apr_size_t max_len, bool *is_eof)
 {
-    apr_size_t to_read;
     apr_size_t did_read;
     apr_status_t s;
 
     *is_eof = false;
 
-    if (len <= sbuf_data_avail(sbuf))
-        return true;
-
-    did_read = to_read = len - sbuf_data_avail(sbuf);
-    sbuf_enlarge(sbuf, sbuf->len + to_read);
+    sbuf_enlarge(sbuf, max_len);
+    did_read = max_len;
     s = apr_socket_recv(sock, sbuf->data + sbuf->len, &did_read);
+    STATS_INCR(net_recv_calls);
     sbuf->len += did_read;
 
     if (s != APR_SUCCESS)
@@ -266,7 +351,7 @@ sbuf_socket_recv(StrBuf *sbuf, apr_socket_t *sock, apr_size_t len, bool *is_eof)
             FAIL_APR(s);
     }
 
-    return (to_read == did_read);
+    return did_read;
 }
 
 /*
@@ -287,9 +372,74 @@ sbuf_socket_send(StrBuf *sbuf, apr_socket_t *sock)
 
     s = apr_socket_send(sock, sbuf->data + sbuf->pos, &did_write);
     sbuf->pos += did_write;
+    STATS_INCR(net_send_calls);
+    STATS_ADD(net_bytes_sent, did_write);
 
     if (s != APR_SUCCESS && !APR_STATUS_IS_EAGAIN(s))
         FAIL_APR(s);
 
     return (to_write == did_write);
 }
+
+/*
+ * Like sbuf_socket_send(), but write the available data from each of
+ * "nbufs" StrBufs in turn, using a single gather write. Returns "true" if we
+ * wrote all the data from every buffer.
+ */
+bool
+sbuf_socket_sendv(StrBuf **sbufs, int nbufs, apr_socket_t *sock)
+{
+    struct iovec vec[SBUF_SENDV_MAX];
+    apr_size_t to_write;
+    apr_size_t did_write;
+    apr_status_t s;
+    int nvec;
+    int i;
+
+    ASSERT(nbufs <= SBUF_SENDV_MAX);
+
+    to_write = 0;
+    nvec = 0;
+    for (i = 0; i < nbufs; i++)
+    {
+        apr_size_t avail = sbuf_data_avail(sbufs[i]);
+
+        if (avail == 0)
+            continue;
+
+        vec[nvec].iov_base = sbufs[i]->data + sbufs[i]->pos;
+        vec[nvec].iov_len = avail;
+        to_write += avail;
+        nvec++;
+    }
+
+    if (to_write == 0)
+        return true;
+
+    s = apr_socket_sendv(sock, vec, nvec, &did_write);
+    STATS_INCR(net_send_calls);
+    STATS_ADD(net_bytes_sent, did_write);
+
+    if (s != APR_SUCCESS && !APR_STATUS_IS_EAGAIN(s))
+        FAIL_APR(s);
+
+    /* Advance each buffer's position past the data that was written */
+    for (i = 0; i < nbufs; i++)
+    {
+        apr_size_t done = sbuf_data_avail(sbufs[i]);
+
+        if (done > did_write)
+            done = did_write;
+
+        sbufs[i]->pos += done;
+        did_write -= done;
+    }
+
+    for (i = 0; i < nbufs; i++)
+    {
+        if (sbuf_data_avail(sbufs[i]) != 0)
+            return false;
+    }
+
+    return true;
+}
@@ -28,10 +28,13 @@ tuple_buf_cleanup(void *data)
     while (!tuple_buf_is_empty(buf))
     {
         Tuple *tuple;
+        Tuple *old_tuple;
         TableDef *tbl_def;
 
-        tuple_buf_shift(buf, &tuple, &tbl_def);
+        tuple_buf_shift_update(buf, &old_tuple, &tuple, &tbl_def);
         tuple_unpin(tuple, tbl_def->schema);
+        if (old_tuple != NULL)
+            tuple_unpin(old_tuple, tbl_def->schema);
     }
 
     ol_free(buf->entries);
@@ -45,11 +48,9 @@ tuple_buf_reset(TupleBuf *buf)
     buf->end = 0;
 }
 
-void
-tuple_buf_push(TupleBuf *buf, Tuple *tuple, TableDef *tbl_def)
+static TupleBufEntry *
+tuple_buf_new_entry(TupleBuf *buf)
 {
-    TupleBufEntry *ent;
-
     if (buf->end == buf->size)
     {
         /*
@@ -79,12 +80,37 @@ tuple_buf_push(TupleBuf *buf, Tuple *tuple, TableDef *tbl_def)
         }
     }
 
-    ent = &buf->entries[buf->end];
+    return &buf->entries[buf->end++];
+}
+
+void
+tuple_buf_push(TupleBuf *buf, Tuple *tuple, TableDef *tbl_def)
+{
+    TupleBufEntry *ent;
+
+    ent = tuple_buf_new_entry(buf);
     ent->tuple = tuple;
     ent->tbl_def = tbl_def;
+    ent->old_tuple = NULL;
     tuple_pin(ent->tuple);
+}
 
-    buf->end++;
+/*
+ * Push an update, which replaces "old_tuple" with "new_tuple". Both tuples
+ * must belong to the same table.
+ */
+void
+tuple_buf_push_update(TupleBuf *buf, Tuple *old_tuple, Tuple *new_tuple,
+                      TableDef *tbl_def)
+{
+    TupleBufEntry *ent;
+
+    ent = tuple_buf_new_entry(buf);
+    ent->tuple = new_tuple;
+    ent->tbl_def = tbl_def;
+    ent->old_tuple = old_tuple;
+    tuple_pin(ent->tuple);
+    tuple_pin(ent->old_tuple);
 }
 
 /*
@@ -94,6 +120,19 @@ tuple_buf_push(TupleBuf *buf, Tuple *tuple, TableDef *tbl_def)
  */
 void
 tuple_buf_shift(TupleBuf *buf, Tuple **tuple, TableDef **tbl_def)
+{
+    ASSERT(tuple_buf_head(buf)->old_tuple == NULL);
+    tuple_buf_shift_update(buf, NULL, tuple, tbl_def);
+}
+
+/*
+ * Like tuple_buf_shift(), except that the first element may be an update,
+ * in which case the replaced tuple is returned via "old_tuple". For other
+ * elements, "old_tuple" is set to NULL.
+ */
+void
+tuple_buf_shift_update(TupleBuf *buf, Tuple **old_tuple, Tuple **new_tuple,
+                       TableDef **tbl_def)
 {
     TupleBufEntry *ent;
 
@@ -103,8 +142,10 @@ tuple_buf_shift(TupleBuf *buf, Tuple **tuple, TableDef **tbl_def)
     if (tuple_buf_is_empty(buf))
         tuple_buf_reset(buf);
 
-    if (tuple)
-        *tuple = ent->tuple;
+    if (old_tuple)
+        *old_tuple = ent->old_tuple;
+    if (new_tuple)
+        *new_tuple = ent->tuple;
     if (tbl_def)
         *tbl_def = ent->tbl_def;
 }
@@ -119,9 +160,16 @@ tuple_buf_dump(TupleBuf *buf, C4Runtime *c4)
         int offset = buf->start + i;
         TupleBufEntry *ent = &buf->entries[offset];
 
-        c4_log(c4, "%s: (%d) %s => %s",
-               __func__, i,
-               log_tuple(c4, ent->tuple, ent->tbl_def->schema),
-               ent->tbl_def->name);
+        if (ent->old_tuple != NULL)
+            c4_log(c4, "%s: (%d) %s -> %s => %s",
+                   __func__, i,
+                   log_tuple(c4, ent->old_tuple, ent->tbl_def->schema),
+                   log_tuple(c4, ent->tuple, ent->tbl_def->schema),
+                   ent->tbl_def->name);
+        else
+            c4_log(c4, "%s: (%d) %s => %s",
+                   __func__, i,
+                   log_tuple(c4, ent->tuple, ent->tbl_def->schema),
+                   ent->tbl_def->name);
     }
 }
@@ -54,7 +54,6 @@ make_tuple_pool(apr_size_t elem_size, TuplePoolMgr *tpool_mgr)
     tpool = apr_palloc(tpool_mgr->pool, sizeof(*tpool));
     tpool->pool = tpool_mgr->pool;
     tpool->free_head = NULL;
-    /* XXX: Ensure this is word-aligned */
     tpool->elem_size = elem_size;
     tpool->ntotal = 0;
     tpool->nfree = 0;
@@ -136,13 +135,15 @@ tpool_mgr_make(apr_pool_t *pool)
 
 /*
  * This is not efficient, but we don't expect that it will be called in the
- * critical path.
+ * critical path. Since packed tuples need not be a multiple of the word size,
+ * we round up the element size so that every element is suitably aligned.
  */
 TuplePool *
 get_tuple_pool(TuplePoolMgr *tpool_mgr, apr_size_t elem_size)
 {
     TuplePool *tpool;
 
+    elem_size = APR_ALIGN_DEFAULT(Max(elem_size, sizeof(FreeListElem)));
     for (tpool = tpool_mgr->head; tpool != NULL; tpool = tpool->next)
     {
         if (tpool->elem_size == elem_size)
@@ -13,6 +13,8 @@ class C4
     attach_function 'c4_make', [:pointer, :int], :pointer
     attach_function 'c4_install_file', [:pointer, :string], :int
     attach_function 'c4_install_str', [:pointer, :string], :int
+    attach_function 'c4_compile_str', [:pointer, :string], :string
+    attach_function 'c4_load_library', [:pointer, :string], :int
     attach_function 'c4_dump_table', [:pointer, :string], :string
     attach_function 'c4_destroy', [:pointer], :void
     attach_function 'c4_terminate', [], :void
@@ -33,6 +35,15 @@ class C4
     s = C4Lib.c4_install_str(@c4, inprog)
   end
 
+  def compile_str(inprog)
+    C4Lib.c4_compile_str(@c4, inprog)
+  end
+
+  # TODO: check status
+  def load_library(path)
+    s = C4Lib.c4_load_library(@c4, path)
+  end
+
   def dump_table(tbl_name)
     C4Lib.c4_dump_table(@c4, tbl_name)
   end
@@ -4,22 +4,44 @@ require_relative './C4'
 
 INPUT_DIR="input"
 OUTPUT_DIR="output"
+COMPILED_OUTPUT_DIR="output_compiled"
 EXPECTED_DIR="expected"
 DIFF_FILE="regress.diffs"
+C4_INCLUDE_DIR="../libc4/include"
 
-def make_output_dir
-  FileUtils.remove_dir(OUTPUT_DIR) if File.directory?(OUTPUT_DIR)
-  Dir.mkdir(OUTPUT_DIR)
+def make_output_dir(dir)
+  FileUtils.remove_dir(dir) if File.directory?(dir)
+  Dir.mkdir(dir)
 end
 
-def run_tests(c4, test_name)
+# Compile the expressions of the test's program with c4c (via the C4 API),
+# build them into a shared library, and load it into the C4 instance. The
+# compiled expressions should give the same results as the interpreter.
+def load_compiled_exprs(c4, test)
+  prog = File.readlines("#{INPUT_DIR}/#{test}").reject { |l| l =~ /^\\dump / }
+  src_file = "#{COMPILED_OUTPUT_DIR}/#{test}.c"
+  lib_file = File.expand_path("#{COMPILED_OUTPUT_DIR}/#{test}.so")
+  File.open(src_file, 'w') do |f|
+    f.write(c4.compile_str(prog.join))
+  end
+
+  apr_includes = `apr-1-config --includes`.strip
+  unless system("cc -shared -fPIC -I#{C4_INCLUDE_DIR} #{apr_includes} " +
+                "#{src_file} -o #{lib_file}")
+    raise "Failed to build compiled expressions for test \"#{test}\""
+  end
+  c4.load_library(lib_file)
+end
+
+def run_tests(c4, test_name, output_dir, compiled)
   puts "===="
   tests = Dir.entries(INPUT_DIR).reject { |i| i.match(/^\./) }
   ran_tests = []
   tests.each do |test|
     next unless (test_name.nil? or test == test_name)
     ran_tests << test
-    print "Running test \"#{test}\"..."
+    print "Running test \"#{test}\"#{compiled ? " (compiled)" : ""}..."
+    load_compiled_exprs(c4, test) if compiled
     input = ""
     output = ""
     File.open("#{INPUT_DIR}/#{test}").each_line do |line|
@@ -35,7 +57,7 @@ def run_tests(c4, test_name)
     end
     puts " done"
 
-    File.open("#{OUTPUT_DIR}/#{test}", 'w') do |f|
+    File.open("#{output_dir}/#{test}", 'w') do |f|
       f.write(output)
     end
   end
@@ -43,10 +65,10 @@ def run_tests(c4, test_name)
   puts "===="
   num_fails = 0
   ran_tests.each do |test|
-    `diff -ur #{EXPECTED_DIR}/#{test} #{OUTPUT_DIR}/#{test} >> #{DIFF_FILE}`
+    `diff -ur #{EXPECTED_DIR}/#{test} #{output_dir}/#{test} >> #{DIFF_FILE}`
     if $? != 0
       num_fails += 1
-      puts "Test \"#{test}\" failed!"
+      puts "Test \"#{test}\"#{compiled ? " (compiled)" : ""} failed!"
     end
   end
 
@@ -57,8 +79,14 @@ def run_tests(c4, test_name)
   end
 end
 
-make_output_dir
+make_output_dir(OUTPUT_DIR)
+make_output_dir(COMPILED_OUTPUT_DIR)
 File.delete(DIFF_FILE) if File.exists?(DIFF_FILE)
 c = C4.new
-run_tests(c, ARGV[0])
+run_tests(c, ARGV[0], OUTPUT_DIR, false)
+# The tests' tables already exist in the first instance, so run the
+# compiled tests in a fresh one
+c_compiled = C4.new
+run_tests(c_compiled, ARGV[0], COMPILED_OUTPUT_DIR, true)
+c_compiled.destroy
 c.destroy